@@ -11,6 +11,7 @@ import (
     "io"
     "io/ioutil"
     "log"
+    "math"
     "os"
     "os/signal"
     "path"
@@ -24,6 +25,7 @@ import (
     "strings"
     "sync"
     "syscall"
+    "time"
 
     "github.com/spf13/cobra"
     "golang.org/x/exp/slices"
@@ -272,6 +274,19 @@ func persistentPreRunEFunc(command *cobra.Command, args []string) error {
         return errors.New(fmt.Sprintf("dump stack size %d is not 8-byte aligned.", gconfig.StackSize))
     }
     mconfig.StackSize = gconfig.StackSize
+    if gconfig.StackDedup > 0 && !gconfig.UnwindStack {
+        return errors.New("--stack-dedup only works with --stack option")
+    }
+    mconfig.StackDedup = gconfig.StackDedup
+    if gconfig.StackAdapt && !gconfig.UnwindStack {
+        return errors.New("--stack-adaptive only works with --stack option")
+    }
+    mconfig.StackAdapt = gconfig.StackAdapt
+    if gconfig.BpfUnwind && gconfig.UnwindStack {
+        return errors.New("--bpf-unwind can not be used with --stack option")
+    }
+    mconfig.BpfUnwind = gconfig.BpfUnwind
+    mconfig.BpfStats = gconfig.BpfStats
     mconfig.ShowRegs = gconfig.ShowRegs
     mconfig.GetOff = gconfig.GetOff
     mconfig.Debug = gconfig.Debug
@@ -282,6 +297,25 @@ func persistentPreRunEFunc(command *cobra.Command, args []string) error {
     mconfig.DumpHex = gconfig.DumpHex
     mconfig.ShowTime = gconfig.ShowTime
     mconfig.ShowUid = gconfig.ShowUid
+    mconfig.Dedup = gconfig.Dedup
+    mconfig.IoTop = gconfig.IoTop
+    mconfig.Flow = gconfig.Flow
+    mconfig.Profile = gconfig.Profile
+    mconfig.ProfileOut = gconfig.ProfileOut
+    mconfig.Heap = gconfig.Heap
+    mconfig.Lock = gconfig.Lock
+    mconfig.Offcpu = gconfig.Offcpu
+    if gconfig.Heap > 0 || gconfig.Lock > 0 {
+        // 分配函数和 pthread 固定在 libc 中 与 -l 指定的库无关
+        mconfig.LibcPath, err = util.FindLib("libc.so", gconfig.LibraryDirs)
+        if err != nil {
+            return err
+        }
+    }
+    mconfig.FoldOut = gconfig.FoldOut
+    if gconfig.FoldOut != "" && !gconfig.UnwindStack {
+        return errors.New("--fold only works with --stack option")
+    }
 
     // 1. hook uprobe
     mconfig.InitStackUprobeConfig()
@@ -294,6 +328,26 @@ func persistentPreRunEFunc(command *cobra.Command, args []string) error {
     if err != nil {
         return err
     }
+    err = mconfig.Parse_ArmPoints(gconfig.ArmPoint, gconfig.Library, gconfig.LibraryDirs)
+    if err != nil {
+        return err
+    }
+    mconfig.Parse_ArmSyscalls(gconfig.ArmSyscall)
+    err = mconfig.Parse_CountPoints(gconfig.CountPoint, gconfig.Library, gconfig.LibraryDirs)
+    if err != nil {
+        return err
+    }
+    mconfig.Count = gconfig.Count
+    mconfig.CountCaller = gconfig.CountCaller
+    mconfig.ArmTimeout = uint64(gconfig.ArmTimeout) * 1000 * 1000
+    if len(mconfig.ArmSyscalls) > 0 {
+        if gconfig.SysCall == "" {
+            return errors.New("--arm-syscall only works with --syscall option")
+        }
+        if mconfig.ArmTimeout == 0 {
+            return errors.New("must set --arm-timeout when use --arm-syscall option")
+        }
+    }
     signal, err := util.ParseSignal(gconfig.UprobeSignal)
     if err != nil {
         return err
@@ -301,9 +355,62 @@ func persistentPreRunEFunc(command *cobra.Command, args []string) error {
     mconfig.UprobeSignal = signal
 
     // 2. hook syscall
+    if gconfig.IoTop > 0 && gconfig.Flow > 0 {
+        return errors.New("--iotop and --flow can not be used together")
+    }
+    if gconfig.IoTop > 0 && gconfig.SysCall == "" {
+        gconfig.SysCall = config.IoTopSyscalls()
+    }
+    if gconfig.Flow > 0 && gconfig.SysCall == "" {
+        gconfig.SysCall = config.FlowSyscallNames()
+    }
     mconfig.InitSyscallConfig()
     mconfig.SysCallConf.Parse_SysWhitelist(gconfig)
     mconfig.SysCallConf.Parse_SysBlacklist(gconfig.NoSysCall)
+    if gconfig.Daemon {
+        if !mconfig.SysCallConf.Enable || len(gconfig.HookPoint) > 0 {
+            return errors.New("--daemon only works with -s/--syscall option")
+        }
+        if gconfig.Name != "" || gconfig.Uid != "" || gconfig.Pid != "" || gconfig.Tid != "" {
+            return errors.New("--daemon can not be used with -n/-u/-p/-t, set them in each session")
+        }
+        if gconfig.IoTop > 0 || gconfig.Flow > 0 || gconfig.FoldOut != "" || gconfig.Offcpu > 0 || gconfig.IoUring {
+            return errors.New("--daemon can not be used with --iotop/--flow/--fold/--offcpu/--io-uring")
+        }
+        mconfig.Daemon = true
+    }
+    if gconfig.MaxOverhead != "" {
+        if !mconfig.SysCallConf.Enable && len(gconfig.HookPoint) == 0 {
+            return errors.New("--max-overhead only works with -s/--syscall or -w/--point option")
+        }
+        if gconfig.IoTop > 0 || gconfig.Flow > 0 || gconfig.FoldOut != "" || gconfig.Profile > 0 || gconfig.Heap > 0 || gconfig.Lock > 0 || len(gconfig.CountPoint) > 0 {
+            return errors.New("--max-overhead can not be used with --iotop/--flow/--fold/--profile/--heap/--lock/--count")
+        }
+        value, err := strconv.ParseFloat(strings.TrimSuffix(gconfig.MaxOverhead, "%"), 64)
+        if err != nil || value <= 0 || value > 100 {
+            return errors.New(fmt.Sprintf("--max-overhead %s invaild, support (0%%, 100%%]", gconfig.MaxOverhead))
+        }
+        mconfig.MaxOverhead = value
+    }
+    if gconfig.Snapshot != "" {
+        if !mconfig.SysCallConf.Enable && len(gconfig.HookPoint) == 0 {
+            return errors.New("--snapshot only works with -s/--syscall or -w/--point option")
+        }
+        if gconfig.UprobeSignal != "" || gconfig.Daemon {
+            return errors.New("--snapshot can not be used with --kill/--daemon")
+        }
+        err = event.SetupSnapshot(logger, gconfig.Snapshot, gconfig.SnapshotDir, gconfig.SnapshotMax)
+        if err != nil {
+            return err
+        }
+        // 命中后先在内核中停住进程 读取完成后由用户态恢复
+        mconfig.UprobeSignal = uint32(syscall.SIGSTOP)
+    }
+    if gconfig.FdPath {
+        config.EnableFdPath()
+    }
+    mconfig.FdPath = gconfig.FdPath
+    mconfig.StrDict = gconfig.StrDict
 
     // 3. watch breakpoint
     var brk_base uint64 = 0x0
@@ -319,35 +426,54 @@ func persistentPreRunEFunc(command *cobra.Command, args []string) error {
     }
 
     if gconfig.BrkAddr != "" && strings.HasPrefix(gconfig.BrkAddr, "0x") {
-        if gconfig.BrkLen <= 0 && gconfig.BrkLen > 8 {
+        if gconfig.BrkLen <= 0 || gconfig.BrkLen > 8 {
             return errors.New(fmt.Sprintf("BrkLen %d invaild, support [1, 8]", gconfig.BrkLen))
         }
         mconfig.BrkLen = gconfig.BrkLen
         mconfig.BrkPid = gconfig.BrkPid
-        infos := strings.Split(gconfig.BrkAddr, ":")
-        if len(infos) > 2 {
-            return errors.New(fmt.Sprintf("parse for %s failed, format invaild", gconfig.BrkAddr))
-        }
-        if len(infos) == 2 {
-            if infos[1] == "r" {
-                mconfig.BrkType = util.HW_BREAKPOINT_R
-            } else if infos[1] == "w" {
-                mconfig.BrkType = util.HW_BREAKPOINT_W
-            } else if infos[1] == "x" {
-                mconfig.BrkType = util.HW_BREAKPOINT_X
-            } else if infos[1] == "rw" {
-                mconfig.BrkType = util.HW_BREAKPOINT_RW
-            } else {
-                return errors.New(fmt.Sprintf("parse BrkType for %s failed, choose:r,w,x,rw", infos[1]))
+        var brk_points []*config.BrkPoint
+        for _, brk_str := range strings.Split(gconfig.BrkAddr, ",") {
+            brk_point, err := config.ParseBrkPoint(brk_str, brk_base, gconfig.BrkLen)
+            if err != nil {
+                return err
             }
-        } else {
-            mconfig.BrkType = util.HW_BREAKPOINT_X
+            brk_points = append(brk_points, brk_point)
         }
-        addr, err := strconv.ParseUint(strings.TrimPrefix(infos[0], "0x"), 16, 64)
-        if err != nil {
-            return errors.New(fmt.Sprintf("parse for %s failed, err:%v", gconfig.BrkAddr, err))
+        if len(gconfig.BrkCond) > 0 {
+            brk_cond := &config.BrkCond{}
+            find_lib := func(lib string) (uint64, uint64, error) {
+                if gconfig.BrkPid <= 0 {
+                    return 0, 0, errors.New("must set --brk-pid when use lr@lib condition")
+                }
+                return event.FindLibRange(uint32(gconfig.BrkPid), lib)
+            }
+            for _, cond_str := range gconfig.BrkCond {
+                err := brk_cond.Parse(cond_str, find_lib)
+                if err != nil {
+                    return err
+                }
+            }
+            for _, brk_point := range brk_points {
+                brk_point.Cond = brk_cond
+            }
+        }
+        if len(brk_points) == 1 && gconfig.BrkLimit == 0 && len(gconfig.BrkCond) == 0 {
+            // 单个断点 每次命中都输出
+            mconfig.BrkAddr = brk_points[0].Addr
+            mconfig.BrkType = brk_points[0].Type
+        } else {
+            // 多个断点 由 eBPF 程序统计命中次数 只输出前 N 次
+            mconfig.BrkPoints = brk_points
+            mconfig.BrkLimit = gconfig.BrkLimit
+            if mconfig.BrkLimit == 0 {
+                if len(gconfig.BrkCond) > 0 {
+                    // 条件断点默认输出全部满足条件的命中
+                    mconfig.BrkLimit = math.MaxUint32
+                } else {
+                    mconfig.BrkLimit = config.DEFAULT_BRK_LIMIT
+                }
+            }
         }
-        mconfig.BrkAddr = brk_base + addr
     }
 
     // 检查hook设定
@@ -372,15 +498,38 @@ func persistentPreRunEFunc(command *cobra.Command, args []string) error {
         }
         logger.Printf("set breakpoint at kernel:%t, addr:0x%x", mconfig.BrkKernel, mconfig.BrkAddr)
     }
+    if len(mconfig.BrkPoints) > 0 {
+        enable_hook = true
+        for _, brk_point := range mconfig.BrkPoints {
+            logger.Printf("set breakpoint at kernel:%t, %s", brk_point.IsKernel(), brk_point.String())
+        }
+    }
+    if gconfig.Profile > 0 {
+        enable_hook = true
+        logger.Printf("profile at %dHz", gconfig.Profile)
+    }
+    if gconfig.Heap > 0 {
+        enable_hook = true
+        logger.Printf("heap track in %s, report every %ds", mconfig.LibcPath, gconfig.Heap)
+    }
+    if gconfig.Lock > 0 {
+        enable_hook = true
+        logger.Printf("lock track in %s, report every %ds", mconfig.LibcPath, gconfig.Lock)
+    }
+    if len(mconfig.CountPoints) > 0 {
+        enable_hook = true
+        logger.Printf("count hook, count:%d", len(mconfig.CountPoints))
+    }
     if !enable_hook {
-        logger.Fatal("hook nothing, plz set -w/--point or -s/--syscall or --brk")
+        logger.Fatal("hook nothing, plz set -w/--point or -s/--syscall or --brk or --profile or --heap or --lock or --count")
     }
     return nil
 }
 
 func runFunc(command *cobra.Command, args []string) {
     stopper := make(chan os.Signal, 1)
-    signal.Notify(stopper, os.Interrupt, syscall.SIGTERM)
+    // adb 断开时是 SIGHUP 同样要正常退出 恢复 bpf_stats_enabled 等设置
+    signal.Notify(stopper, os.Interrupt, syscall.SIGTERM, syscall.SIGHUP)
     ctx, cancelFun := context.WithCancel(context.TODO())
     if gconfig.Rpc {
         rpc.SetupRpc(ctx, Logger, gconfig)
@@ -392,16 +541,44 @@ func runFunc(command *cobra.Command, args []string) {
     var wg sync.WaitGroup
 
     var modNames []string
-    if mconfig.BrkAddr != 0 {
+    if mconfig.BrkAddr != 0 || len(mconfig.BrkPoints) > 0 {
         modNames = append(modNames, module.MODULE_NAME_BRK)
+    } else if gconfig.Profile > 0 {
+        // 采样模式 perf 模块负责提供 maps 信息用于符号化
+        modNames = append(modNames, module.MODULE_NAME_PERF)
+        modNames = append(modNames, module.MODULE_NAME_PROFILE)
+    } else if gconfig.Heap > 0 {
+        // 同样需要 perf 模块提供 maps 信息用于符号化
+        modNames = append(modNames, module.MODULE_NAME_PERF)
+        modNames = append(modNames, module.MODULE_NAME_HEAP)
+    } else if gconfig.Lock > 0 {
+        modNames = append(modNames, module.MODULE_NAME_PERF)
+        modNames = append(modNames, module.MODULE_NAME_LOCK)
+    } else if len(gconfig.CountPoint) > 0 {
+        modNames = append(modNames, module.MODULE_NAME_PERF)
+        modNames = append(modNames, module.MODULE_NAME_COUNT)
+    } else if gconfig.SysCall != "" && len(gconfig.HookPoint) > 0 {
+        // 同时指定了 syscall 和 uprobe 则合并到一个模块 共用同一个事件流
+        modNames = append(modNames, module.MODULE_NAME_PERF)
+        modNames = append(modNames, module.MODULE_NAME_UNIFIED)
     } else if gconfig.SysCall != "" {
         modNames = append(modNames, module.MODULE_NAME_PERF)
         modNames = append(modNames, module.MODULE_NAME_SYSCALL)
     } else if len(gconfig.HookPoint) > 0 {
         modNames = append(modNames, module.MODULE_NAME_PERF)
         modNames = append(modNames, module.MODULE_NAME_STACK)
+    } else if gconfig.Offcpu > 0 || gconfig.IoUring {
+        modNames = append(modNames, module.MODULE_NAME_PERF)
     } else {
-        Logger.Fatal("hook nothing, plz set -w/--point or -s/--syscall or --brk")
+        Logger.Fatal("hook nothing, plz set -w/--point or -s/--syscall or --brk or --profile or --heap or --lock or --count or --offcpu or --io-uring")
+    }
+    if gconfig.Offcpu > 0 {
+        // 只挂 sched 相关的点 可以和其他模式同时运行
+        modNames = append(modNames, module.MODULE_NAME_OFFCPU)
+    }
+    if gconfig.IoUring {
+        // 同样可以和其他模式同时运行 事件按相同的格式输出
+        modNames = append(modNames, module.MODULE_NAME_IO_URING)
     }
     for _, modName := range modNames {
         // 现在合并成只有一个模块了 所以直接通过名字获取
@@ -411,6 +588,7 @@ func runFunc(command *cobra.Command, args []string) {
         err := mod.Run()
         if err != nil {
             Logger.Printf("%s\tmodule Run failed, [skip it]. error:%+v", mod.Name(), err)
+            util.RestoreBpfStats()
             os.Exit(1)
         }
         runModules[mod.Name()] = mod
@@ -423,9 +601,17 @@ func runFunc(command *cobra.Command, args []string) {
     }
     if runMods > 0 {
         Logger.Printf("start %d modules", runMods)
+        if gconfig.FoldOut != "" && gconfig.FoldInterval > 0 {
+            go saveFoldedLoop(ctx)
+        }
+        if gconfig.Daemon {
+            rpc.SetupRpc(ctx, Logger, gconfig)
+            go rpc.StartSessionServer(mconfig, gconfig.DaemonPath)
+        }
         <-stopper
     } else {
         Logger.Println("No runnable modules, Exit(1)")
+        util.RestoreBpfStats()
         os.Exit(1)
     }
     cancelFun()
@@ -435,13 +621,44 @@ func runFunc(command *cobra.Command, args []string) {
         Logger.Println("mod Close")
         wg.Done()
         if err != nil {
+            event.CloseSnapshot()
+            util.RestoreBpfStats()
             Logger.Fatalf("%s:module close failed. error:%+v", mod.Name(), err)
         }
     }
     wg.Wait()
+    // 模块关闭之后不会再有新的命中 恢复所有被 --snapshot 停住的进程
+    event.CloseSnapshot()
+    util.RestoreBpfStats()
+    if gconfig.FoldOut != "" {
+        saveFolded()
+    }
     os.Exit(0)
 }
 
+func saveFolded() {
+    count, err := event.DumpFolded(gconfig.FoldOut)
+    if err != nil {
+        Logger.Printf("save folded stacks failed, err:%v", err)
+        return
+    }
+    Logger.Printf("save %d folded stacks to %s", count, gconfig.FoldOut)
+}
+
+// 定期覆盖写入 中途被强制结束也能留下结果
+func saveFoldedLoop(ctx context.Context) {
+    ticker := time.NewTicker(time.Duration(gconfig.FoldInterval) * time.Second)
+    defer ticker.Stop()
+    for {
+        select {
+        case <-ctx.Done():
+            return
+        case <-ticker.C:
+            saveFolded()
+        }
+    }
+}
+
 func addLibPath(name string) {
     content, err := util.RunCommand("pm", "path", name)
     if err != nil {
@@ -590,13 +807,20 @@ func init() {
     rootCmd.PersistentFlags().StringArrayVarP(&gconfig.ArgFilter, "filter", "f", []string{}, "arg filter rule")
 
     rootCmd.PersistentFlags().StringVar(&gconfig.UprobeSignal, "kill", "", "send signal when hit uprobe hook, e.g. SIGSTOP/SIGABRT/SIGTRAP/...")
+    rootCmd.PersistentFlags().StringVar(&gconfig.Snapshot, "snapshot", "", "stop process when hit hook, save memory to tar.gz then resume, anon for all anonymous rw regions or start-end ranges, e.g. anon,0x7b00000000-0x7b00100000")
+    rootCmd.PersistentFlags().StringVar(&gconfig.SnapshotDir, "snapshot-dir", "snapshots", "directory to save memory snapshots")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.SnapshotMax, "snapshot-max", 8, "max snapshot count, later hits are resumed without snapshot, 0 means unlimited")
     rootCmd.PersistentFlags().BoolVar(&gconfig.Rpc, "rpc", false, "enable rpc")
     rootCmd.PersistentFlags().StringVar(&gconfig.RpcPath, "rpc-path", "127.0.0.1:41718", "rpc path, default 127.0.0.1:41718")
+    rootCmd.PersistentFlags().BoolVar(&gconfig.Daemon, "daemon", false, "share attached syscall programs between sessions, clients connect to --daemon-path with their own filters")
+    rootCmd.PersistentFlags().StringVar(&gconfig.DaemonPath, "daemon-path", "/data/local/tmp/stackplz.sock", "daemon unix socket path, only root and the daemon user can connect")
     // 硬件断点设定
     rootCmd.PersistentFlags().StringVar(&gconfig.BrkAddr, "brk", "", "set hardware breakpoint address")
     rootCmd.PersistentFlags().IntVar(&gconfig.BrkPid, "brk-pid", -1, "set hardware breakpoint pid")
     rootCmd.PersistentFlags().StringVar(&gconfig.BrkLib, "brk-lib", "", "as library base address")
     rootCmd.PersistentFlags().Uint64Var(&gconfig.BrkLen, "brk-len", 4, "hardware breakpoint length, default 4, support [1, 8]")
+    rootCmd.PersistentFlags().StringArrayVar(&gconfig.BrkCond, "brk-cond", []string{}, "only output breakpoint hits matching condition, e.g. x0=0x10 [x1+8]=str:abc lr@libc.so")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.BrkLimit, "brk-limit", 0, "only output first N hits of each breakpoint, others are counted in kernel")
     // 缓冲区大小设定 单位M
     rootCmd.PersistentFlags().Uint32VarP(&gconfig.Buffer, "buffer", "b", 8, "perf cache buffer size, default 8M")
     rootCmd.PersistentFlags().Uint32Var(&gconfig.MaxOp, "maxop", 64, "max operation count for uprobe, at least 192 for string array")
@@ -604,6 +828,11 @@ func init() {
     rootCmd.PersistentFlags().BoolVar(&gconfig.ManualStack, "mstack", false, "manual parse stack")
     rootCmd.PersistentFlags().BoolVar(&gconfig.UnwindStack, "stack", false, "enable unwindstack")
     rootCmd.PersistentFlags().Uint32VarP(&gconfig.StackSize, "stack-size", "", 8192, "stack dump size, default 8192 bytes, max 65528 bytes")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.StackDedup, "stack-dedup", 0, "only dump stack the first time a call site is seen (or every N hits when N > 1), reuse the cached backtrace for others")
+    rootCmd.PersistentFlags().BoolVar(&gconfig.StackAdapt, "stack-adaptive", false, "estimate needed stack size by walking frame pointers, send shallow stacks with a smaller dump size")
+    rootCmd.PersistentFlags().BoolVar(&gconfig.BpfUnwind, "bpf-unwind", false, "unwind user stack in eBPF with rules from .eh_frame, only return addresses are sent")
+    rootCmd.PersistentFlags().StringVar(&gconfig.MaxOverhead, "max-overhead", "", "cpu budget for eBPF programs and stackplz itself, e.g. 2%, sample hot hooks or stop capturing stack when exceeded")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.BpfStats, "bpf-stats", 0, "enable kernel.bpf_stats_enabled, print run count and run time of each eBPF program every N seconds")
     rootCmd.PersistentFlags().BoolVar(&gconfig.ShowRegs, "regs", false, "show regs")
     rootCmd.PersistentFlags().BoolVar(&gconfig.GetOff, "getoff", false, "try get pc and lr offset")
     // 日志设定
@@ -620,9 +849,30 @@ func init() {
     rootCmd.PersistentFlags().BoolVarP(&gconfig.DumpHex, "dumphex", "", false, "dump buffer as hex")
     rootCmd.PersistentFlags().BoolVarP(&gconfig.ShowTime, "showtime", "", false, "show event boot time info")
     rootCmd.PersistentFlags().BoolVarP(&gconfig.ShowUid, "showuid", "", false, "show process uid info")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.IoTop, "iotop", 0, "count syscall io by fd in kernel, print table every N seconds instead of events")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.Profile, "profile", 0, "sample user stacks at N Hz, count in kernel and save folded stacks")
+    rootCmd.PersistentFlags().StringVar(&gconfig.ProfileOut, "profile-out", "stackplz_profile.folded", "file to save folded stacks for --profile, pprof format if it ends with .pb.gz")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.Heap, "heap", 0, "track libc malloc/free in kernel, print outstanding bytes by stack every N seconds")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.Offcpu, "offcpu", 0, "measure off-cpu time of traced threads in kernel, print top blocking syscalls and stacks every N seconds")
+    rootCmd.PersistentFlags().BoolVar(&gconfig.IoUring, "io-uring", false, "trace io_uring requests, pair submit and completion in kernel, print opcode, fd, len, result and latency")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.Lock, "lock", 0, "measure pthread mutex and futex wait time in kernel, print top contended locks every N seconds")
+    rootCmd.PersistentFlags().StringArrayVar(&gconfig.CountPoint, "count", []string{}, "count hits of every function matched by pattern in kernel, e.g. libfoo.so:Java_* or libfoo.so")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.Count, "count-interval", 5, "print hit table every N seconds for --count")
+    rootCmd.PersistentFlags().BoolVar(&gconfig.CountCaller, "count-caller", false, "also split --count hits by caller lr")
+    rootCmd.PersistentFlags().StringVar(&gconfig.FoldOut, "fold", "", "count identical backtraces per hook and save folded stacks to file instead of logging events")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.FoldInterval, "fold-interval", 0, "also save folded stacks every N seconds")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.Flow, "flow", 0, "count socket traffic by fd in kernel, print flow table every N seconds instead of events")
+    rootCmd.PersistentFlags().BoolVarP(&gconfig.FdPath, "fdpath", "", false, "resolve fd args to file path in kernel")
+    rootCmd.PersistentFlags().BoolVar(&gconfig.StrDict, "str-dict", false, "send repeated string args of the same process as a 4-byte dictionary id")
+    rootCmd.PersistentFlags().BoolVarP(&gconfig.Dedup, "dedup", "", false, "fold identical consecutive syscalls into one repeat record")
     rootCmd.PersistentFlags().BoolVarP(&gconfig.NoCheck, "nocheck", "", false, "disable check for bpf")
     rootCmd.PersistentFlags().BoolVarP(&gconfig.Btf, "btf", "", false, "declare BTF enabled")
     // syscall hook
     rootCmd.PersistentFlags().StringVarP(&gconfig.SysCall, "syscall", "s", "", "filter syscalls")
     rootCmd.PersistentFlags().StringVar(&gconfig.NoSysCall, "no-syscall", "", "syscall black list, max 20")
+    // 仅在 arm 点内追踪
+    rootCmd.PersistentFlags().StringArrayVar(&gconfig.ArmPoint, "arm", []string{}, "only trace threads inside this function, e.g. decrypt or libfoo.so:0x1234")
+    rootCmd.PersistentFlags().StringVar(&gconfig.ArmSyscall, "arm-syscall", "", "start tracing thread after these syscalls, need --arm-timeout")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.ArmTimeout, "arm-timeout", 0, "disarm thread after N ms, 0 means no timeout")
+    rootCmd.PersistentFlags().Uint32Var(&gconfig.SysKprobeMax, "sys-kprobe", 16, "use kprobe on syscall functions when syscall count <= this value, 0 to always use raw_tracepoint")
 }
@@ -35,6 +35,8 @@ static __always_inline int load_args(args_t *args, u32 event_id)
     args->args[4] = saved_args->args[4];
     args->args[5] = saved_args->args[5];
     args->flag = saved_args->flag;
+    args->regs = saved_args->regs;
+    args->ts = saved_args->ts;
 
     return 0;
 }
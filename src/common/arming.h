@@ -0,0 +1,77 @@
+#ifndef __STACKPLZ_ARMING_H__
+#define __STACKPLZ_ARMING_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+#include "common/context.h"
+#include "common/filtering.h"
+
+// 进入 arm 点时计数加一 离开时减一 计数为 0 时线程不再被追踪
+static __always_inline void arm_thread(program_data_t *p)
+{
+    u32 host_tid = p->event->context.host_tid;
+    arm_state_t *state = bpf_map_lookup_elem(&armed_threads, &host_tid);
+    if (state != NULL) {
+        state->depth += 1;
+        state->ts = p->event->context.ts;
+        return;
+    }
+    arm_state_t new_state = {};
+    new_state.depth = 1;
+    new_state.ts = p->event->context.ts;
+    bpf_map_update_elem(&armed_threads, &host_tid, &new_state, BPF_ANY);
+}
+
+static __always_inline void disarm_thread(program_data_t *p)
+{
+    u32 host_tid = p->event->context.host_tid;
+    arm_state_t *state = bpf_map_lookup_elem(&armed_threads, &host_tid);
+    if (state == NULL) {
+        return;
+    }
+    if (state->depth > 1) {
+        state->depth -= 1;
+        return;
+    }
+    bpf_map_delete_elem(&armed_threads, &host_tid);
+}
+
+// syscall 作为 arm 点时 没有对应的返回点 只能依靠超时解除
+static __always_inline void try_arm_by_syscall(program_data_t *p, u32 sysno)
+{
+    u32 arm_key = sysno + ARM_SYSCALL_START;
+    u32 *arm_value = bpf_map_lookup_elem(&common_list, &arm_key);
+    if (arm_value == NULL) {
+        return;
+    }
+    if (!match_trace_filter(p)) {
+        return;
+    }
+    arm_thread(p);
+}
+
+SEC("uprobe/arm")
+int probe_arm(struct pt_regs* ctx) {
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!match_trace_filter(&p))
+        return 0;
+    arm_thread(&p);
+    return 0;
+}
+
+SEC("uretprobe/disarm")
+int probe_disarm(struct pt_regs* ctx) {
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!match_trace_filter(&p))
+        return 0;
+    disarm_thread(&p);
+    return 0;
+}
+
+#endif
@@ -192,7 +192,7 @@ static __always_inline int save_str_to_buf(event_data_t *event, void *ptr, u8 in
 }
 
 
-static __always_inline int events_perf_submit(program_data_t *p, u32 id)
+static __always_inline int events_perf_submit_to(program_data_t *p, u32 id, void *perf_map)
 {
     p->event->context.eventid = id;
 
@@ -204,7 +204,12 @@ static __always_inline int events_perf_submit(program_data_t *p, u32 id)
                  :
                  : [size] "r"(size), [max_size] "i"(MAX_EVENT_SIZE));
 
-    return bpf_perf_event_output(p->ctx, &events, BPF_F_CURRENT_CPU, p->event, size);
+    return bpf_perf_event_output(p->ctx, perf_map, BPF_F_CURRENT_CPU, p->event, size);
+}
+
+static __always_inline int events_perf_submit(program_data_t *p, u32 id)
+{
+    return events_perf_submit_to(p, id, &events);
 }
 
 static __always_inline str_buf_t *make_str_buf() {
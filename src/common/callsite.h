@@ -0,0 +1,119 @@
+#ifndef __STACKPLZ_CALLSITE_H__
+#define __STACKPLZ_CALLSITE_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+#include "common/buffer.h"
+#include "common/sample.h"
+
+// 没有 BPF_FETCH 的内核上拿不到原子加的返回值
+// 每个 cpu 单独计数 高 8 位放 cpu 号 这样 id 不会重复
+static __always_inline u32 callsite_new_id()
+{
+    u32 zero = 0;
+    u32 *next_id = bpf_map_lookup_elem(&callsite_next_id, &zero);
+    if (next_id == NULL)
+        return 0;
+    *next_id += 1;
+    return ((bpf_get_smp_processor_id() & 0xff) << 24) | (*next_id & 0xffffff);
+}
+
+#define STACK_WALK_MAX_FRAMES 32
+// 最后一帧之上还有调用者的局部变量 多留一些给回溯用
+#define STACK_SIZE_SLACK 512
+#define STACK_SIZE_MAX 65536
+
+// 沿 x29 链向上走 最外层帧记录的位置减去 sp 就是回溯实际需要的栈大小
+// 没有帧指针的代码会让链提前断开 由每个线程记住的大小兜底
+static __always_inline u32 stack_size_needed(u64 sp, u64 fp)
+{
+    u64 top = sp;
+    for (int i = 0; i < STACK_WALK_MAX_FRAMES; i++) {
+        if (fp < sp || fp - sp >= STACK_SIZE_MAX)
+            break;
+        top = fp;
+        u64 next_fp = 0;
+        if (bpf_probe_read_user(&next_fp, sizeof(next_fp), (void *) fp) != 0)
+            break;
+        // 栈向低地址增长 上一帧的 fp 一定更大
+        if (next_fp <= fp)
+            break;
+        fp = next_fp;
+    }
+    // 帧记录本身是 fp lr 两个 8 字节
+    return (u32) (top - sp) + 16 + STACK_SIZE_SLACK;
+}
+
+// 按估算的大小在两个档位之间选择 小档位的 perf 事件栈数据更少
+static __always_inline int stack_tier_submit(program_data_t *p, u32 id, common_filter_t *filter, u64 sp, u64 fp)
+{
+    if (!(filter->ctrl_flags & CTRL_STACK_ADAPTIVE) || filter->is_32bit)
+        return events_perf_submit_to(p, id, &stack_events);
+
+    u32 needed = stack_size_needed(sp, fp);
+    u32 tid = p->event->context.host_tid;
+    u32 *learned = bpf_map_lookup_elem(&stack_learned, &tid);
+    if (learned == NULL) {
+        bpf_map_update_elem(&stack_learned, &tid, &needed, BPF_ANY);
+    } else if (needed >= *learned) {
+        *learned = needed;
+    } else {
+        // 线程曾经走得更深 慢慢衰减 而不是马上缩小
+        u32 prev = *learned;
+        *learned = prev - ((prev - needed) >> 3);
+        needed = prev;
+    }
+
+    if (needed <= filter->stack_small)
+        return events_perf_submit_to(p, id, &stack_events_small);
+    return events_perf_submit_to(p, id, &stack_events);
+}
+
+// 调用点去重模式下 同一个 (进程, 事件, hook 点, pc, lr) 只在首次或每 N 次时
+// 把事件发到带栈数据的 map 其余发到 events 由用户态按 id 补上缓存的栈
+// 只开启自适应时 每个事件都带栈 只是大小按需选择
+// 开销控制模式下带栈的事件同样发到 stack_events 这样可以随时关闭取栈
+static __always_inline int callsite_perf_submit(program_data_t *p, u32 id, common_filter_t *filter, u32 point, u64 pc, u64 lr, u64 sp, u64 fp)
+{
+    if ((filter->ctrl_flags & CTRL_STACK_SWITCH) && sample_stack_off())
+        return events_perf_submit(p, id);
+
+    if (!(filter->ctrl_flags & CTRL_STACK_DEDUP)) {
+        if (filter->ctrl_flags & (CTRL_STACK_ADAPTIVE | CTRL_STACK_SWITCH))
+            return stack_tier_submit(p, id, filter, sp, fp);
+        return events_perf_submit(p, id);
+    }
+
+    callsite_key_t key = {};
+    key.pc = pc;
+    key.lr = lr;
+    key.tgid = p->event->context.host_pid;
+    key.eventid = id;
+    key.point = point;
+
+    bool need_stack = false;
+    callsite_t *site = bpf_map_lookup_elem(&callsite_map, &key);
+    if (site == NULL) {
+        callsite_t new_site = {};
+        new_site.id = callsite_new_id();
+        new_site.hits = 1;
+        bpf_map_update_elem(&callsite_map, &key, &new_site, BPF_ANY);
+        p->event->context.callsite = new_site.id;
+        need_stack = true;
+    } else {
+        // 并发下可能少计一次 只影响重新取栈的时机
+        u32 hits = site->hits + 1;
+        site->hits = hits;
+        p->event->context.callsite = site->id;
+        if (filter->stack_every > 1 && hits % filter->stack_every == 0)
+            need_stack = true;
+    }
+
+    if (need_stack)
+        return stack_tier_submit(p, id, filter, sp, fp);
+    return events_perf_submit_to(p, id, &events);
+}
+
+#endif
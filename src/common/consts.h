@@ -10,7 +10,7 @@
 
 #if defined(__MODULE_STACK)
     #define MAX_OP_COUNT 64
-#elif defined(__MODULE_SYSCALL)
+#elif defined(__MODULE_SYSCALL) || defined(__MODULE_UNIFIED)
     #define MAX_OP_COUNT 256
 #else
     #define MAX_OP_COUNT 512
@@ -24,6 +24,28 @@
 #define MAX_BUF_READ_SIZE    4096
 #define ARGS_BUF_SIZE       32000
 
+// 内核中按 .eh_frame 规则回溯 映射和规则都用二分查找 次数要能覆盖上限
+// 用户态把规则超过 (1 << UNWIND_ROW_SEARCH) - 1 条的库拆成多个映射 控制每帧的查找次数
+#define UNWIND_MAX_MAPPINGS 256
+#define UNWIND_MAPPING_SEARCH 9
+#define UNWIND_ROW_SEARCH 16
+#define UNWIND_MAX_FRAMES 32
+#define UNWIND_TRAILER_MAGIC 0x444e5755
+#define UNWIND_TRAILER_SIZE (8 + UNWIND_MAX_FRAMES * 8)
+
+// 会话位图放在 event_context_t 的一个字节中
+#define MAX_SESSIONS 8
+#define SESSION_ANY 0xffffffff
+#define SESSION_SYSCALL_WORDS 8
+
+// 每个 hook 点单独的采样比例 syscall 按调用号 uprobe 按 point_key 放在后半段
+#define SAMPLE_MAX_HOOKS 1024
+#define SAMPLE_UPROBE_START 512
+
+// 字符串字典 只有不超过这个长度的字符串才会编码 新字符串的 size 带上这一位
+#define STR_DICT_MAX_LEN 256
+#define STR_DICT_NEW (1 << 30)
+
 // 配合 common_list 使用的 它们的间隔范围都是 0x400
 // 意味着它们每个选项有 1024 大小的范围 用于过滤完全足够了
 // 不过要注意 common_list 的总大小上限设置的是 1024
@@ -35,6 +57,10 @@
 #define PID_BLACKLIST_START PID_WHITELIST_START + 0x400
 #define TID_WHITELIST_START PID_BLACKLIST_START + 0x400
 #define TID_BLACKLIST_START TID_WHITELIST_START + 0x400
+#define ARM_SYSCALL_START TID_BLACKLIST_START + 0x400
+#define SYS_COALESCE_START ARM_SYSCALL_START + 0x400
+#define SYS_IO_START SYS_COALESCE_START + 0x400
+#define SYS_FLOW_START SYS_IO_START + 0x400
 
 #define THREAD_NAME_WHITELIST 1
 #define THREAD_NAME_BLACKLIST 2
@@ -0,0 +1,87 @@
+#ifndef __STACKPLZ_DEDUP_H__
+#define __STACKPLZ_DEDUP_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+#include "common/buffer.h"
+
+#define DEDUP_ARGS_COUNT 4
+
+// 输出被抑制的重复 syscall 的汇总 之后复用 event 继续输出当前事件
+static __always_inline void submit_repeat(program_data_t *p, dedup_state_t *state)
+{
+    repeat_info_t info = {};
+    info.count = state->count;
+    info.first_ts = state->first_ts;
+    info.last_ts = state->last_ts;
+    info.bytes = state->bytes;
+    u32 sysno = state->sysno;
+    u64 lr = state->lr;
+    save_to_submit_buf(p->event, (void *) &sysno, sizeof(u32), 0);
+    save_to_submit_buf(p->event, (void *) &lr, sizeof(u64), 1);
+    save_to_submit_buf(p->event, (void *) &info, sizeof(repeat_info_t), 2);
+    events_perf_submit(p, SYSCALL_REPEAT);
+    p->event->buf_off = 0;
+    p->event->context.argnum = 0;
+}
+
+// 与上一次 syscall 的调用号 参数 LR 都相同时返回 true 此次事件不再输出
+// 在 SYS_COALESCE 中的 read/write 类 syscall 只比较 fd 返回时累加字节数
+static __always_inline bool dedup_sys_enter(program_data_t *p, u32 sysno, args_t *saved_regs, u64 lr)
+{
+    u32 host_tid = p->event->context.host_tid;
+    u64 now = p->event->context.ts;
+    u32 coalesce_key = sysno + SYS_COALESCE_START;
+    bool fd_only = bpf_map_lookup_elem(&common_list, &coalesce_key) != NULL;
+
+    dedup_state_t *state = bpf_map_lookup_elem(&dedup_map, &host_tid);
+    if (state != NULL) {
+        bool same = state->sysno == sysno && state->lr == lr && state->args[0] == saved_regs->args[0];
+        if (same && !fd_only) {
+            #pragma unroll
+            for (int i = 1; i < DEDUP_ARGS_COUNT; i++) {
+                if (state->args[i] != saved_regs->args[i]) {
+                    same = false;
+                }
+            }
+        }
+        if (same) {
+            state->count += 1;
+            state->last_ts = now;
+            return true;
+        }
+        if (state->count > 0) {
+            submit_repeat(p, state);
+        }
+    }
+
+    dedup_state_t new_state = {};
+    new_state.sysno = sysno;
+    new_state.lr = lr;
+    #pragma unroll
+    for (int i = 0; i < DEDUP_ARGS_COUNT; i++) {
+        new_state.args[i] = saved_regs->args[i];
+    }
+    new_state.first_ts = now;
+    new_state.last_ts = now;
+    bpf_map_update_elem(&dedup_map, &host_tid, &new_state, BPF_ANY);
+    return false;
+}
+
+static __always_inline void dedup_sys_exit(program_data_t *p, u32 sysno, u64 ret)
+{
+    if ((s64) ret <= 0)
+        return;
+    u32 coalesce_key = sysno + SYS_COALESCE_START;
+    if (bpf_map_lookup_elem(&common_list, &coalesce_key) == NULL)
+        return;
+    u32 host_tid = p->event->context.host_tid;
+    dedup_state_t *state = bpf_map_lookup_elem(&dedup_map, &host_tid);
+    if (state != NULL) {
+        state->bytes += ret;
+    }
+}
+
+#endif
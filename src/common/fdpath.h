@@ -0,0 +1,152 @@
+#ifndef __STACKPLZ_FDPATH_H__
+#define __STACKPLZ_FDPATH_H__
+
+#include "vmlinux_510.h"
+
+#include "bpf_helpers.h"
+#include "bpf_tracing.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/buffer.h"
+#include "memory.h"
+#include "maps.h"
+#include "types.h"
+
+// 路径拼接在 percpu buf 的前半段 从中间往前写
+#define FD_PATH_BUF_MASK ((MAX_PERCPU_BUFSIZE >> 1) - 1)
+
+static __always_inline struct file *get_file_from_fd(u32 fd)
+{
+    struct task_struct *task = (struct task_struct *) bpf_get_current_task();
+    struct files_struct *files = READ_KERN(task->files);
+    if (files == NULL) return NULL;
+    struct fdtable *fdt = READ_KERN(files->fdt);
+    if (fdt == NULL) return NULL;
+    unsigned int max_fds = READ_KERN(fdt->max_fds);
+    if (fd >= max_fds) return NULL;
+    struct file **fds = READ_KERN(fdt->fd);
+    struct file *file = NULL;
+    bpf_probe_read(&file, sizeof(file), &fds[fd]);
+    return file;
+}
+
+// 沿 dentry 链向上拼出完整路径 跨越挂载点时切换到父 mount
+// 返回路径在 string_p->buf 中的起始偏移
+static __always_inline u32 build_file_path(struct file *file, buf_t *string_p)
+{
+    char slash = '/';
+    int zero = 0;
+    struct path f_path = READ_KERN(file->f_path);
+    struct dentry *dentry = f_path.dentry;
+    struct vfsmount *vfsmnt = f_path.mnt;
+    struct mount *mnt_p = real_mount(vfsmnt);
+    struct mount *mnt_parent_p = READ_KERN(mnt_p->mnt_parent);
+    struct dentry *mnt_root;
+    struct dentry *d_parent;
+    struct qstr d_name;
+    unsigned int len;
+    unsigned int off;
+    int sz;
+
+    u32 buf_off = (MAX_PERCPU_BUFSIZE >> 1);
+
+    #pragma unroll
+    for (int i = 0; i < MAX_PATH_COMPONENTS; i++) {
+        mnt_root = READ_KERN(vfsmnt->mnt_root);
+        d_parent = READ_KERN(dentry->d_parent);
+        if (dentry == mnt_root || dentry == d_parent) {
+            if (dentry != mnt_root) {
+                // 不在挂载点上 说明已经被删除或者是伪文件系统
+                break;
+            }
+            if (mnt_p != mnt_parent_p) {
+                dentry = READ_KERN(mnt_p->mnt_mountpoint);
+                mnt_p = mnt_parent_p;
+                mnt_parent_p = READ_KERN(mnt_p->mnt_parent);
+                vfsmnt = &mnt_p->mnt;
+                continue;
+            }
+            // 到达根目录
+            break;
+        }
+        d_name = READ_KERN(dentry->d_name);
+        len = (d_name.len + 1) & (MAX_STRING_SIZE - 1);
+        off = buf_off - len;
+        if (off > buf_off) break;
+        sz = bpf_probe_read_str(&(string_p->buf[off & FD_PATH_BUF_MASK]), len, (void *) d_name.name);
+        if (sz <= 1) break;
+        // 用 / 覆盖掉 \0
+        buf_off -= 1;
+        bpf_probe_read(&(string_p->buf[buf_off & (MAX_PERCPU_BUFSIZE - 1)]), 1, &slash);
+        buf_off -= sz - 1;
+        dentry = d_parent;
+    }
+
+    if (buf_off == (MAX_PERCPU_BUFSIZE >> 1)) {
+        // pipe/socket/memfd 之类的没有路径 直接取 d_name
+        d_name = READ_KERN(dentry->d_name);
+        bpf_probe_read_str(&(string_p->buf[0]), MAX_STRING_SIZE, (void *) d_name.name);
+        return 0;
+    }
+    // 补上开头的 / 以及把最后多出来的 / 换成 \0
+    buf_off -= 1;
+    bpf_probe_read(&(string_p->buf[buf_off & (MAX_PERCPU_BUFSIZE - 1)]), 1, &slash);
+    bpf_probe_read(&(string_p->buf[(MAX_PERCPU_BUFSIZE >> 1) - 1]), 1, &zero);
+    return buf_off & FD_PATH_BUF_MASK;
+}
+
+// 同一个 (tgid, fd, file) 只走一次 dentry 链 之后直接从缓存取
+// 文件释放后 file 指针可能被新打开的文件复用 所以 fd 被关闭或者被 dup3 覆盖时要删除缓存
+static __noinline int save_fd_path_to_buf(event_data_t *event, u32 fd, u8 index)
+{
+    struct file *file = get_file_from_fd(fd);
+    if (file == NULL) return 0;
+
+    fd_path_key_t key = {0};
+    key.tgid = bpf_get_current_pid_tgid() >> 32;
+    key.fd = fd;
+    key.file = (u64) file;
+
+    fd_path_t *cached = bpf_map_lookup_elem(&fd_path_cache, &key);
+    if (cached == NULL) {
+        buf_t *string_p = get_buf(STRING_BUF_IDX);
+        if (string_p == NULL) return 0;
+        u32 off = build_file_path(file, string_p);
+        bpf_map_update_elem(&fd_path_cache, &key, &(string_p->buf[off & FD_PATH_BUF_MASK]), BPF_ANY);
+        cached = bpf_map_lookup_elem(&fd_path_cache, &key);
+        if (cached == NULL) return 0;
+    }
+    return save_str_to_buf(event, (void *) cached->path, index);
+}
+
+static __always_inline void fd_path_forget(u32 fd)
+{
+    struct file *file = get_file_from_fd(fd);
+    if (file == NULL) return;
+
+    fd_path_key_t key = {0};
+    key.tgid = bpf_get_current_pid_tgid() >> 32;
+    key.fd = fd;
+    key.file = (u64) file;
+    bpf_map_delete_elem(&fd_path_cache, &key);
+}
+
+// 只挂 close 和 dup3 两个 syscall 进入时 fd 还指向原来的文件
+// arm64 上没有 dup2 libc 中的 dup2 也是通过 dup3 实现的
+SEC("kprobe/fd_path_close")
+int kprobe_fd_path_close(struct pt_regs *ctx)
+{
+    struct pt_regs *regs = (struct pt_regs *)PT_REGS_PARM1(ctx);
+    fd_path_forget((u32) READ_KERN(regs->regs[0]));
+    return 0;
+}
+
+SEC("kprobe/fd_path_dup3")
+int kprobe_fd_path_dup3(struct pt_regs *ctx)
+{
+    struct pt_regs *regs = (struct pt_regs *)PT_REGS_PARM1(ctx);
+    fd_path_forget((u32) READ_KERN(regs->regs[1]));
+    return 0;
+}
+
+#endif
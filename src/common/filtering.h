@@ -5,7 +5,7 @@
 #include "maps.h"
 #include "types.h"
 
-static __always_inline u64 should_trace(program_data_t *p)
+static __always_inline u64 match_trace_filter(program_data_t *p)
 {
 
     config_entry_t *config = p->config;
@@ -103,8 +103,42 @@ static __always_inline u64 should_trace(program_data_t *p)
     if (((filter->trace_uid_group & GROUP_ISO) == GROUP_ISO) && (context->uid >= 99000) && (context->uid <= 99999)) {
         return 1;
     }
+    // 守护进程模式下 进程由各个会话的条件筛选 这里只做黑名单过滤
+    if (filter->ctrl_flags & CTRL_SESSION) {
+        return 1;
+    }
 
     return 0;
 }
 
+static __always_inline u64 is_thread_armed(program_data_t *p)
+{
+    config_entry_t *config = p->config;
+    if (config->arm_flags == 0) {
+        return 1;
+    }
+    u32 host_tid = p->event->context.host_tid;
+    arm_state_t *state = bpf_map_lookup_elem(&armed_threads, &host_tid);
+    if (state == NULL) {
+        return 0;
+    }
+    if (state->depth == 0) {
+        return 0;
+    }
+    // 超时自动解除 避免 uretprobe 丢失导致一直处于 arm 状态
+    if (config->arm_timeout > 0 && p->event->context.ts - state->ts > config->arm_timeout) {
+        bpf_map_delete_elem(&armed_threads, &host_tid);
+        return 0;
+    }
+    return 1;
+}
+
+static __always_inline u64 should_trace(program_data_t *p)
+{
+    if (!match_trace_filter(p)) {
+        return 0;
+    }
+    return is_thread_armed(p);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,116 @@
+#ifndef __STACKPLZ_FLOW_H__
+#define __STACKPLZ_FLOW_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+
+#ifndef EINPROGRESS
+    #define EINPROGRESS 115
+#endif
+
+#define FLOW_PEER_MASK (sizeof(((flow_stat_t *)0)->peer) - 1)
+
+static __always_inline void flow_read_peer(flow_stat_t *flow, u64 addr, u32 len)
+{
+    if (addr == 0 || len == 0)
+        return;
+    // sockaddr_un 也只有 110 字节 不会被截断
+    if (len > FLOW_PEER_MASK)
+        len = FLOW_PEER_MASK;
+    len &= FLOW_PEER_MASK;
+    if (bpf_probe_read_user(flow->peer, len, (void *) addr) == 0)
+        flow->peer_len = len;
+}
+
+// 新连接直接覆盖旧的记录 fd 复用时统计从头开始
+static __always_inline void flow_new(io_key_t *key, u64 ts, u64 addr, u32 len)
+{
+    flow_stat_t flow = {};
+    flow.first_ts = ts;
+    flow.last_ts = ts;
+    flow_read_peer(&flow, addr, len);
+    bpf_map_update_elem(&flow_stats, key, &flow, BPF_ANY);
+}
+
+// flow 模式下 syscall 返回时按 (进程, fd) 累加流量 不输出事件
+// read/write 只统计已知的连接 避免把普通文件也算进来
+static __always_inline void flow_sys_exit(program_data_t *p, u32 sysno, args_t *saved_regs, u64 ret)
+{
+    u32 flow_key = sysno + SYS_FLOW_START;
+    u32 *kind = bpf_map_lookup_elem(&common_list, &flow_key);
+    if (kind == NULL)
+        return;
+
+    s64 sret = (s64) ret;
+    u64 ts = p->event->context.ts;
+    io_key_t key = {};
+    key.tgid = p->event->context.host_pid;
+    key.fd = (u32) saved_regs->args[0];
+
+    switch (*kind) {
+        case FLOW_CONNECT:
+            if (sret < 0 && sret != -EINPROGRESS)
+                return;
+            flow_new(&key, ts, saved_regs->args[1], (u32) saved_regs->args[2]);
+            return;
+        case FLOW_ACCEPT:
+        {
+            if (sret < 0)
+                return;
+            key.fd = (u32) sret;
+            u32 addrlen = 0;
+            if (saved_regs->args[2] != 0)
+                bpf_probe_read_user(&addrlen, sizeof(addrlen), (void *) saved_regs->args[2]);
+            flow_new(&key, ts, saved_regs->args[1], addrlen);
+            return;
+        }
+        case FLOW_CLOSE:
+        {
+            // 关闭后移到 flow_closed 由用户态输出最后一次之后删除
+            // 用户态删除时 key 带有 first_ts 不会误删同一个 fd 上的新连接
+            flow_stat_t *closed = bpf_map_lookup_elem(&flow_stats, &key);
+            if (closed == NULL)
+                return;
+            closed->closed = 1;
+            flow_closed_key_t closed_key = {};
+            closed_key.tgid = key.tgid;
+            closed_key.fd = key.fd;
+            closed_key.first_ts = closed->first_ts;
+            bpf_map_update_elem(&flow_closed, &closed_key, closed, BPF_ANY);
+            bpf_map_delete_elem(&flow_stats, &key);
+            return;
+        }
+        default:
+            break;
+    }
+
+    if (sret <= 0)
+        return;
+
+    flow_stat_t *flow = bpf_map_lookup_elem(&flow_stats, &key);
+    if (flow == NULL) {
+        if (*kind == FLOW_READ || *kind == FLOW_WRITE)
+            return;
+        // 追踪开始前就建立的连接 没有对端地址 sendto 可以从参数中取
+        if (*kind == FLOW_SENDTO)
+            flow_new(&key, ts, saved_regs->args[4], (u32) saved_regs->args[5]);
+        else
+            flow_new(&key, ts, 0, 0);
+        flow = bpf_map_lookup_elem(&flow_stats, &key);
+        if (flow == NULL)
+            return;
+    }
+
+    flow->last_ts = ts;
+    if (*kind == FLOW_SENDTO || *kind == FLOW_SEND || *kind == FLOW_WRITE) {
+        __sync_fetch_and_add(&flow->tx_bytes, ret);
+        __sync_fetch_and_add(&flow->tx_pkts, 1);
+    } else {
+        __sync_fetch_and_add(&flow->rx_bytes, ret);
+        __sync_fetch_and_add(&flow->rx_pkts, 1);
+    }
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __STACKPLZ_FORK_H__
+#define __STACKPLZ_FORK_H__
+
+#include "vmlinux_510.h"
+
+#include "bpf_helpers.h"
+#include "common/common.h"
+#include "common/context.h"
+#include "common/task.h"
+#include "maps.h"
+
+// 为了实现仅指定单个pid时 能追踪其产生的子进程 设计如下
+// 维护一个 map child_parent_map
+// - 其 key 为进程 pid
+// - 其 value 为其父进程 pid
+// 首次通过 sys_enter 的过滤之后 向该map存放第一个key value -> {12345: 12345}
+// sched_process_fork 获取进程的父进程信息 检查map 发现父进程存在其中 则更新map -> {12345: 12345, 22222: 12345}
+// 各个模块共用这一份处理 带 include guard 合并编译时也只有一个定义
+
+SEC("raw_tracepoint/sched_process_fork")
+int tracepoint__sched__sched_process_fork(struct bpf_raw_tracepoint_args *ctx)
+{
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+
+    struct task_struct *parent = (struct task_struct *) ctx->args[0];
+    struct task_struct *child = (struct task_struct *) ctx->args[1];
+
+    u32 parent_ns_pid = get_task_ns_pid(parent);
+    u32 child_ns_pid = get_task_ns_pid(child);
+
+    u32* pid = bpf_map_lookup_elem(&child_parent_map, &parent_ns_pid);
+    if (unlikely(pid == NULL)) return 0;
+
+    if (*pid == parent_ns_pid){
+        // map中取出的父进程pid 与这里fork产生子进程的父进程pid相同
+        // 说明这个进程是我们自己添加的 那么现在把新产生的这个子进程 pid 放入 map
+        bpf_map_update_elem(&child_parent_map, &child_ns_pid, &parent_ns_pid, BPF_ANY);
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __STACKPLZ_IOSTAT_H__
+#define __STACKPLZ_IOSTAT_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+
+// 第一个参数不是 fd 的 syscall 比如 openat 的 dirfd 不参与统计
+static __always_inline u32 *iostat_kind(u32 sysno)
+{
+    u32 io_key = sysno + SYS_IO_START;
+    return bpf_map_lookup_elem(&common_list, &io_key);
+}
+
+// iotop 模式下 syscall 返回时按 (进程, fd) 累加 不输出事件
+// 读写方向由 SYS_IO_START 范围中的 io_kind_e 决定
+static __always_inline void iostat_sys_exit(program_data_t *p, u32 sysno, args_t *saved_regs, u64 ret)
+{
+    u32 *kind = iostat_kind(sysno);
+    if (kind == NULL)
+        return;
+
+    io_key_t key = {};
+    key.tgid = p->event->context.host_pid;
+    key.fd = (u32) saved_regs->args[0];
+
+    io_stat_t *stat = bpf_map_lookup_elem(&io_stats, &key);
+    if (stat == NULL) {
+        io_stat_t zero = {};
+        bpf_map_update_elem(&io_stats, &key, &zero, BPF_NOEXIST);
+        stat = bpf_map_lookup_elem(&io_stats, &key);
+        if (stat == NULL)
+            return;
+    }
+
+    stat->latency_ns += p->event->context.ts - saved_regs->ts;
+    if ((s64) ret < 0) {
+        stat->errors += 1;
+        return;
+    }
+    if (*kind == IO_WRITE) {
+        stat->wr_ops += 1;
+        stat->wr_bytes += ret;
+    } else {
+        stat->rd_ops += 1;
+        stat->rd_bytes += ret;
+    }
+}
+
+#endif
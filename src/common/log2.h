@@ -0,0 +1,21 @@
+#ifndef __STACKPLZ_LOG2_H__
+#define __STACKPLZ_LOG2_H__
+
+#include "vmlinux_510.h"
+
+#include "bpf_helpers.h"
+
+// log2 直方图的区间下标 与 bcc 的 log2l 相同 不使用循环
+static __always_inline u32 log2_u64(u64 v)
+{
+    u32 r, shift;
+    r = (v > 0xFFFFFFFF) << 5; v >>= r;
+    shift = (v > 0xFFFF) << 4; v >>= shift; r |= shift;
+    shift = (v > 0xFF) << 3; v >>= shift; r |= shift;
+    shift = (v > 0xF) << 2; v >>= shift; r |= shift;
+    shift = (v > 0x3) << 1; v >>= shift; r |= shift;
+    r |= (v >> 1);
+    return r;
+}
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef __STACKPLZ_SAMPLE_H__
+#define __STACKPLZ_SAMPLE_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+
+// --max-overhead 模式下 用户态按测量到的开销调整每个 hook 点的采样比例
+// 比例为 N 时平均 N 次只输出一次 未设置或者为 1 时全部输出
+// 命中次数在采样之前计数 用户态据此找出最热的 hook 点
+static __always_inline bool sample_hit(u32 key)
+{
+    key &= SAMPLE_MAX_HOOKS - 1;
+    u64 *hits = bpf_map_lookup_elem(&sample_hits, &key);
+    if (hits != NULL)
+        *hits += 1;
+    u32 *ratio = bpf_map_lookup_elem(&sample_ratio, &key);
+    if (ratio == NULL || *ratio <= 1)
+        return true;
+    return bpf_get_prandom_u32() % *ratio == 0;
+}
+
+// 超出预算时用户态可以关闭取栈 事件改为发到不带栈数据的 events
+static __always_inline bool sample_stack_off()
+{
+    u32 zero = 0;
+    overhead_ctl_t *ctl = bpf_map_lookup_elem(&overhead_ctl, &zero);
+    return ctl != NULL && ctl->stack_off != 0;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __STACKPLZ_SESSION_H__
+#define __STACKPLZ_SESSION_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+
+// 守护进程模式下 多个会话共用同一组 eBPF 程序
+// 全局过滤只排除所有会话都不关心的事件 这里再按每个会话的条件给事件打上位图
+// 没有任何会话关心的事件直接丢弃 用户态按位图分发给各个会话
+static __always_inline u8 session_match(program_data_t *p, u32 sysno)
+{
+    event_context_t *context = &p->event->context;
+    u64 bit = 1ULL << (sysno & 63);
+    u32 word = (sysno >> 6) & (SESSION_SYSCALL_WORDS - 1);
+    u8 mask = 0;
+    for (u32 i = 0; i < MAX_SESSIONS; i++) {
+        u32 key = i;
+        session_filter_t *session = bpf_map_lookup_elem(&session_filters, &key);
+        if (session == NULL || session->active == 0)
+            continue;
+        if (session->uid != SESSION_ANY && session->uid != context->uid)
+            continue;
+        if (session->pid != SESSION_ANY && session->pid != context->pid)
+            continue;
+        if ((session->syscalls[word] & bit) == 0)
+            continue;
+        mask |= 1 << i;
+    }
+    return mask;
+}
+
+#endif
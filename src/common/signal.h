@@ -0,0 +1,25 @@
+#ifndef __STACKPLZ_SIGNAL_H__
+#define __STACKPLZ_SIGNAL_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+
+// arm64 上 SIGSTOP 的值
+#define SIGNAL_STOP 19
+
+// 发送 common_filter 中设置的信号 是 SIGSTOP 时记录停住的进程和事件的时间戳
+// 事件丢失或者没有被处理时 用户态据此找到还停着的进程并恢复 见 event/event_snapshot.go
+static __always_inline void filter_send_signal(program_data_t *p, common_filter_t *filter)
+{
+    if (bpf_send_signal(filter->signal) != 0)
+        return;
+    if (filter->signal != SIGNAL_STOP)
+        return;
+    u32 tgid = p->event->context.host_pid;
+    u64 ts = p->event->context.ts;
+    bpf_map_update_elem(&stopped_procs, &tgid, &ts, BPF_ANY);
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef __STACKPLZ_STRDICT_H__
+#define __STACKPLZ_STRDICT_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+#include "common/buffer.h"
+
+// 同一个进程反复读取的字符串 比如 /proc/self/maps 库路径 属性名 只在第一次完整发送
+// 之后只发送 4 字节的 id 格式如下 size 为负数时表示引用
+//   普通   [index][size][string]
+//   新字符串 [index][size | STR_DICT_NEW][string][id]
+//   引用   [index][-id]
+// 各个 cpu 的事件到达用户态的顺序不固定 引用可能先于定义 所以内容同时存一份到 str_dict_values
+
+// 没有 BPF_FETCH 的内核上拿不到原子加的返回值 做法与 callsite_new_id 相同
+// 0 表示没有分配到 id 0 号 cpu 的计数回绕时跳过
+static __always_inline u32 str_dict_new_id()
+{
+    u32 zero = 0;
+    u32 *next_id = bpf_map_lookup_elem(&str_dict_next_id, &zero);
+    if (next_id == NULL)
+        return 0;
+    *next_id += 1;
+    if ((*next_id & 0x3fffff) == 0)
+        *next_id += 1;
+    return ((bpf_get_smp_processor_id() & 0xff) << 22) | (*next_id & 0x3fffff);
+}
+
+// FNV-1a 长度包含结尾的 0
+static __always_inline u64 str_dict_hash(event_data_t *event, u32 start, u32 sz)
+{
+    u64 hash = 0xcbf29ce484222325ULL;
+    for (u32 i = 0; i < STR_DICT_MAX_LEN; i++) {
+        if (i >= sz)
+            break;
+        hash ^= (u8) event->args[start + i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// 返回值与 save_str_to_buf 一致 len 为读取到的字符串长度 dict 为调用方已经取出的 CTRL_STR_DICT
+static __always_inline int save_str_dict_to_buf(event_data_t *event, void *ptr, u8 index, u32 *len, bool dict)
+{
+    if (!dict) {
+        u32 old_off = event->buf_off;
+        int status = save_str_to_buf(event, ptr, index);
+        *len = event->buf_off - (old_off + sizeof(int) + 1);
+        return status;
+    }
+
+    u32 off = event->buf_off;
+    if (off > ARGS_BUF_SIZE - (MAX_STRING_SIZE + 1 + sizeof(int) + sizeof(u32)))
+        return 0;
+    u32 start = off + 1 + sizeof(int);
+    int sz = bpf_probe_read_str(&(event->args[start]), MAX_STRING_SIZE, ptr);
+    if (sz <= 0)
+        return 0;
+    *len = sz;
+    event->args[off] = index;
+
+    // 太长的字符串很少重复 直接发送
+    if (sz > STR_DICT_MAX_LEN) {
+        __builtin_memcpy(&(event->args[off + 1]), &sz, sizeof(int));
+        event->buf_off = start + sz;
+        event->context.argnum++;
+        return 1;
+    }
+
+    str_dict_key_t key = {};
+    key.tgid = event->context.host_pid;
+    key.hash = str_dict_hash(event, start, sz);
+    u32 *id = bpf_map_lookup_elem(&str_dict, &key);
+    if (id != NULL) {
+        int ref = -(int) *id;
+        __builtin_memcpy(&(event->args[off + 1]), &ref, sizeof(int));
+        event->buf_off = start;
+        event->context.argnum++;
+        return 1;
+    }
+
+    u32 new_id = str_dict_new_id();
+    int size = sz;
+    if (new_id != 0) {
+        // 直接从 start 开始取 STR_DICT_MAX_LEN 字节 用户态按结尾的 0 截断
+        bpf_map_update_elem(&str_dict_values, &new_id, (str_dict_value_t *) &(event->args[start]), BPF_ANY);
+        bpf_map_update_elem(&str_dict, &key, &new_id, BPF_ANY);
+        size |= STR_DICT_NEW;
+    }
+    __builtin_memcpy(&(event->args[off + 1]), &size, sizeof(int));
+    u32 end = start + sz;
+    if (new_id != 0) {
+        if (end > ARGS_BUF_SIZE - sizeof(u32))
+            return 0;
+        __builtin_memcpy(&(event->args[end]), &new_id, sizeof(u32));
+        end += sizeof(u32);
+    }
+    event->buf_off = end;
+    event->context.argnum++;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef __STACKPLZ_UNWIND_H__
+#define __STACKPLZ_UNWIND_H__
+
+#include "vmlinux_510.h"
+#include "bpf_helpers.h"
+#include "types.h"
+#include "maps.h"
+
+// 用户态预先把各个库 .eh_frame 中的 CFA 规则转换为 unwind_row_t 放入 unwind_rows
+// 每个进程的可执行映射按起始地址排序后放入 unwind_procs
+// 这里逐帧查表回溯 只把 pc 追加到事件末尾 不再需要复制整个栈到用户态
+
+// 去掉返回地址中的 PAC 签名
+#define UNWIND_PC_MASK 0x0000ffffffffffffULL
+
+// 映射按起始地址排序 找最后一个 start <= pc 的映射
+static __always_inline unwind_mapping_t *unwind_find_mapping(unwind_proc_t *proc, u64 pc)
+{
+    u32 lo = 0;
+    u32 hi = proc->count;
+    if (hi > UNWIND_MAX_MAPPINGS)
+        hi = UNWIND_MAX_MAPPINGS;
+    for (int i = 0; i < UNWIND_MAPPING_SEARCH; i++) {
+        if (lo >= hi)
+            break;
+        u32 mid = (lo + hi) / 2;
+        if (pc < proc->maps[mid & (UNWIND_MAX_MAPPINGS - 1)].start)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo == 0)
+        return NULL;
+    unwind_mapping_t *m = &proc->maps[(lo - 1) & (UNWIND_MAX_MAPPINGS - 1)];
+    if (pc >= m->end)
+        return NULL;
+    return m;
+}
+
+// 规则同样按 pc 排序 找最后一条 pc <= vaddr 的规则
+static __always_inline unwind_row_t *unwind_find_row(unwind_mapping_t *m, u64 vaddr)
+{
+    u32 lo = 0;
+    u32 hi = m->row_count;
+    for (int i = 0; i < UNWIND_ROW_SEARCH; i++) {
+        if (lo >= hi)
+            break;
+        u32 mid = (lo + hi) / 2;
+        u32 idx = m->row_start + mid;
+        unwind_row_t *row = bpf_map_lookup_elem(&unwind_rows, &idx);
+        if (row == NULL)
+            return NULL;
+        if (vaddr < row->pc)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo == 0)
+        return NULL;
+    u32 idx = m->row_start + lo - 1;
+    return bpf_map_lookup_elem(&unwind_rows, &idx);
+}
+
+// 在事件参数之后追加 [magic][nr][pc * nr] 不计入 argnum
+// 用户态解析完参数后 在剩余的数据中按 magic 识别
+// 进程还没有加载规则时从第一帧开始沿 x29 链回溯
+// 已经加载规则的进程 第一帧找不到规则就停止 之后的帧所在的库没有 .eh_frame 时退回到 x29 链
+static __always_inline void unwind_user_stack(program_data_t *p, common_filter_t *filter, u64 pc, u64 sp, u64 fp, u64 lr)
+{
+    if (!(filter->ctrl_flags & CTRL_BPF_UNWIND) || filter->is_32bit)
+        return;
+
+    event_data_t *event = p->event;
+    u32 off = event->buf_off;
+    if (off > ARGS_BUF_SIZE - UNWIND_TRAILER_SIZE)
+        return;
+
+    u32 tgid = event->context.host_pid;
+    unwind_proc_t *proc = bpf_map_lookup_elem(&unwind_procs, &tgid);
+
+    u32 nr = 0;
+    for (int i = 0; i < UNWIND_MAX_FRAMES; i++) {
+        bpf_probe_read_kernel(&event->args[off + 8 + i * 8], sizeof(u64), &pc);
+        nr++;
+
+        // 返回地址指向调用指令的下一条 要按调用指令所在的位置查规则
+        u64 lookup_pc = i == 0 ? pc : pc - 1;
+        unwind_mapping_t *m = NULL;
+        unwind_row_t *row = NULL;
+        if (proc != NULL)
+            m = unwind_find_mapping(proc, lookup_pc);
+        if (m != NULL && m->row_count > 0)
+            row = unwind_find_row(m, lookup_pc - m->bias);
+
+        u64 ra = 0;
+        if (row != NULL && row->cfa_reg == UNWIND_REG_END)
+            break;
+        if (row != NULL && row->cfa_reg != UNWIND_REG_NONE) {
+            u64 cfa = (row->cfa_reg == UNWIND_REG_FP ? fp : sp) + row->cfa_off;
+            if (row->ra_off == 0) {
+                // 只有第一帧的 lr 是可信的
+                if (i > 0)
+                    break;
+                ra = lr;
+            } else if (bpf_probe_read_user(&ra, sizeof(ra), (void *) (cfa + row->ra_off)) != 0) {
+                break;
+            }
+            if (row->fp_off != 0 && bpf_probe_read_user(&fp, sizeof(fp), (void *) (cfa + row->fp_off)) != 0)
+                break;
+            sp = cfa;
+        } else if (i == 0 && proc != NULL) {
+            // 第一帧没有规则时 lr 不一定还是返回地址 到此为止 只输出当前 pc
+            break;
+        } else {
+            if (fp < sp)
+                break;
+            u64 record[2] = {};
+            if (bpf_probe_read_user(record, sizeof(record), (void *) fp) != 0)
+                break;
+            // 栈向低地址增长 上一帧的 fp 一定更大
+            if (record[0] != 0 && record[0] <= fp)
+                break;
+            sp = fp + 16;
+            fp = record[0];
+            ra = record[1];
+        }
+        ra &= UNWIND_PC_MASK;
+        if (ra == 0)
+            break;
+        pc = ra;
+    }
+
+    u32 magic = UNWIND_TRAILER_MAGIC;
+    bpf_probe_read_kernel(&event->args[off], sizeof(u32), &magic);
+    bpf_probe_read_kernel(&event->args[off + 4], sizeof(u32), &nr);
+    event->buf_off = off + 8 + nr * 8;
+}
+
+#endif
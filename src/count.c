@@ -0,0 +1,52 @@
+#include "types.h"
+#include "common/arguments.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/context.h"
+#include "common/filtering.h"
+#include "common/arming.h"
+#include "common/fork.h"
+
+#include "utils.h"
+
+// 同一个程序挂到所有匹配的符号上 命中时只按 pc 计数
+// 不读取参数 不输出事件 用户态根据 pc 反查符号 所以挂载数量不受 probe_stack_N 的限制
+
+typedef struct count_key {
+    u64 pc;
+    u64 lr;
+    u32 tgid;
+    u32 padding;
+} count_key_t;
+
+// percpu 不需要原子操作 用户态读取时再累加
+BPF_PERCPU_HASH(count_hits, count_key_t, u64, 65536);
+
+SEC("uprobe/count")
+int probe_count(struct pt_regs* ctx) {
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!should_trace(&p))
+        return 0;
+
+    u32 filter_key = 0;
+    common_filter_t* filter = bpf_map_lookup_elem(&common_filter, &filter_key);
+    if (unlikely(filter == NULL)) return 0;
+
+    count_key_t key = {};
+    // uprobe 命中时 pc 就是符号的地址
+    key.pc = PT_REGS_IP(ctx);
+    key.tgid = p.event->context.host_pid;
+    if (filter->ctrl_flags & CTRL_COUNT_CALLER)
+        key.lr = ctx->regs[30];
+
+    u64 *count = bpf_map_lookup_elem(&count_hits, &key);
+    if (count == NULL) {
+        u64 one = 1;
+        bpf_map_update_elem(&count_hits, &key, &one, BPF_NOEXIST);
+        return 0;
+    }
+    *count += 1;
+    return 0;
+}
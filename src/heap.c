@@ -0,0 +1,191 @@
+#include "types.h"
+#include "common/arguments.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/context.h"
+#include "common/filtering.h"
+#include "common/arming.h"
+#include "common/fork.h"
+
+#include "utils.h"
+
+// 挂载 libc 的 malloc/calloc/realloc/free 在内核中记录未释放的内存
+// 按 (进程, 用户栈) 聚合字节数和次数 用户态只定期读取聚合结果 不经过 events
+
+#define HEAP_STACK_DEPTH 127
+
+// 进入分配函数时记下大小和栈 返回时才知道地址
+typedef struct heap_pending {
+    u64 size;
+    u64 old_ptr;
+    s32 user_stack_id;
+    u32 padding;
+} heap_pending_t;
+
+// 分配函数可能嵌套调用 比如 calloc 内部调用 malloc 或者 hook 了 malloc 的库
+// 每个线程按栈保存 返回时后进先出 超出深度的只计数不记录 保证出入配对
+#define HEAP_PENDING_DEPTH 4
+
+typedef struct heap_pending_stack {
+    u32 depth;
+    u32 padding;
+    heap_pending_t items[HEAP_PENDING_DEPTH];
+} heap_pending_stack_t;
+
+// 不同进程中的地址可能相同 key 需要带上进程
+typedef struct heap_addr_key {
+    u64 addr;
+    u32 tgid;
+    u32 padding;
+} heap_addr_key_t;
+
+typedef struct heap_alloc {
+    u64 size;
+    s32 user_stack_id;
+    u32 padding;
+} heap_alloc_t;
+
+typedef struct heap_key {
+    u32 tgid;
+    s32 user_stack_id;
+} heap_key_t;
+
+typedef struct heap_stat {
+    u64 bytes;
+    u64 count;
+} heap_stat_t;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+    __uint(max_entries, 16384);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, HEAP_STACK_DEPTH * sizeof(u64));
+} heap_stacks SEC(".maps");
+
+BPF_HASH(heap_pending, u32, heap_pending_stack_t, 10240);
+BPF_HASH(heap_allocs, heap_addr_key_t, heap_alloc_t, 262144);
+BPF_HASH(heap_outstanding, heap_key_t, heap_stat_t, 16384);
+
+static __always_inline void heap_outstanding_add(u32 tgid, s32 user_stack_id, s64 bytes, s64 count)
+{
+    heap_key_t key = {};
+    key.tgid = tgid;
+    key.user_stack_id = user_stack_id;
+    heap_stat_t *stat = bpf_map_lookup_elem(&heap_outstanding, &key);
+    if (stat == NULL) {
+        if (bytes < 0)
+            return;
+        heap_stat_t zero = {};
+        bpf_map_update_elem(&heap_outstanding, &key, &zero, BPF_NOEXIST);
+        stat = bpf_map_lookup_elem(&heap_outstanding, &key);
+        if (stat == NULL)
+            return;
+    }
+    __sync_fetch_and_add(&stat->bytes, bytes);
+    __sync_fetch_and_add(&stat->count, count);
+}
+
+// 只处理追踪开始后分配的内存 之前分配的在 heap_allocs 中查不到 直接忽略
+static __always_inline void heap_release(u32 tgid, u64 addr)
+{
+    if (addr == 0)
+        return;
+    heap_addr_key_t key = {};
+    key.addr = addr;
+    key.tgid = tgid;
+    heap_alloc_t *alloc = bpf_map_lookup_elem(&heap_allocs, &key);
+    if (alloc == NULL)
+        return;
+    heap_outstanding_add(tgid, alloc->user_stack_id, -(s64) alloc->size, -1);
+    bpf_map_delete_elem(&heap_allocs, &key);
+}
+
+static __always_inline int heap_enter(struct pt_regs *ctx, u64 size, u64 old_ptr)
+{
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!should_trace(&p))
+        return 0;
+
+    u32 tid = (u32) bpf_get_current_pid_tgid();
+    heap_pending_stack_t *stack = bpf_map_lookup_elem(&heap_pending, &tid);
+    if (stack == NULL) {
+        heap_pending_stack_t zero = {};
+        bpf_map_update_elem(&heap_pending, &tid, &zero, BPF_NOEXIST);
+        stack = bpf_map_lookup_elem(&heap_pending, &tid);
+        if (stack == NULL)
+            return 0;
+    }
+    u32 depth = stack->depth;
+    stack->depth = depth + 1;
+    if (depth >= HEAP_PENDING_DEPTH)
+        return 0;
+    heap_pending_t *pending = &stack->items[depth & (HEAP_PENDING_DEPTH - 1)];
+    pending->size = size;
+    pending->old_ptr = old_ptr;
+    // 入口处回溯 最内层就是分配函数本身
+    pending->user_stack_id = bpf_get_stackid(ctx, &heap_stacks, BPF_F_USER_STACK);
+    return 0;
+}
+
+SEC("uprobe/heap_malloc")
+int probe_heap_malloc(struct pt_regs* ctx) {
+    return heap_enter(ctx, PT_REGS_PARM1(ctx), 0);
+}
+
+SEC("uprobe/heap_calloc")
+int probe_heap_calloc(struct pt_regs* ctx) {
+    return heap_enter(ctx, PT_REGS_PARM1(ctx) * PT_REGS_PARM2(ctx), 0);
+}
+
+SEC("uprobe/heap_realloc")
+int probe_heap_realloc(struct pt_regs* ctx) {
+    return heap_enter(ctx, PT_REGS_PARM2(ctx), PT_REGS_PARM1(ctx));
+}
+
+// malloc/calloc/realloc 共用同一个返回点
+SEC("uretprobe/heap_ret")
+int probe_heap_ret(struct pt_regs* ctx) {
+    u32 tid = (u32) bpf_get_current_pid_tgid();
+    heap_pending_stack_t *stack = bpf_map_lookup_elem(&heap_pending, &tid);
+    if (stack == NULL || stack->depth == 0)
+        return 0;
+    u32 depth = stack->depth - 1;
+    stack->depth = depth;
+    if (depth >= HEAP_PENDING_DEPTH)
+        return 0;
+    heap_pending_t saved = stack->items[depth & (HEAP_PENDING_DEPTH - 1)];
+    if (depth == 0)
+        bpf_map_delete_elem(&heap_pending, &tid);
+
+    u32 tgid = bpf_get_current_pid_tgid() >> 32;
+    u64 addr = PT_REGS_RC(ctx);
+    if (addr == 0) {
+        // bionic 的 realloc(p, 0) 会释放 p 并返回 NULL
+        // 其他情况下 realloc 失败时原来的内存仍然有效
+        if (saved.size == 0)
+            heap_release(tgid, saved.old_ptr);
+        return 0;
+    }
+    heap_release(tgid, saved.old_ptr);
+
+    heap_addr_key_t key = {};
+    key.addr = addr;
+    key.tgid = tgid;
+    heap_alloc_t alloc = {};
+    alloc.size = saved.size;
+    alloc.user_stack_id = saved.user_stack_id;
+    // map 满了就不计入 避免 free 时减成负数
+    if (bpf_map_update_elem(&heap_allocs, &key, &alloc, BPF_ANY) != 0)
+        return 0;
+    heap_outstanding_add(tgid, saved.user_stack_id, (s64) saved.size, 1);
+    return 0;
+}
+
+// free 可能发生在未被追踪的线程 不做过滤 只看地址是否有记录
+SEC("uprobe/heap_free")
+int probe_heap_free(struct pt_regs* ctx) {
+    heap_release(bpf_get_current_pid_tgid() >> 32, PT_REGS_PARM1(ctx));
+    return 0;
+}
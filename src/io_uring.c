@@ -0,0 +1,152 @@
+#include "types.h"
+#include "common/arguments.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/context.h"
+#include "common/filtering.h"
+#include "common/arming.h"
+#include "common/fork.h"
+
+#include "utils.h"
+
+// io_uring 的读写不经过 sys_enter 这里挂载 io_uring_submit_sqe 和 io_uring_complete
+// 提交时通过了过滤的请求先记录下来 完成时配对计算耗时 输出一个 IO_URING_COMPLETE 事件
+// 完成可能发生在 io-wq 线程或者中断中 所以事件的 context 使用提交时保存的
+
+// 两个 tracepoint 的参数在 5.10 和 5.15 上不同 但第一个参数都是 io_ring_ctx
+// 完成时的前三个参数都是 (ctx, user_data, res)
+// 提交时 sqe 已经被取出 cached_sq_head 指向下一个 从共享的 sq 中重新读取完整的 sqe
+// IORING_SETUP_SQPOLL 的 ring 由内核线程提交 sq 随时在变化 不追踪
+
+// 与 uapi 中的 IORING_SETUP_SQPOLL 一致
+#define IO_URING_SETUP_SQPOLL (1U << 1)
+
+typedef struct io_uring_key {
+    u64 ring;
+    u64 user_data;
+} io_uring_key_t;
+
+typedef struct io_uring_req {
+    event_context_t context;
+    u8 opcode;
+    u8 flags;
+    u16 padding;
+    s32 fd;
+    u32 len;
+    u32 padding2;
+    u64 off;
+    u64 addr;
+} io_uring_req_t;
+
+// 与 Go 中的 IoUringInfo 一致
+typedef struct io_uring_info {
+    u8 opcode;
+    u8 flags;
+    u16 padding;
+    s32 fd;
+    u32 len;
+    s32 res;
+    u64 off;
+    u64 addr;
+    u64 user_data;
+    u64 latency;
+} io_uring_info_t;
+
+// 完成时不在提交请求的线程上 取栈没有意义 所以单独用一个不带栈数据的 perf map
+BPF_PERF_OUTPUT(io_uring_events, 1024);
+
+// user_data 由应用自己设置 不唯一时后提交的会覆盖前一个 一直没有完成的请求由 LRU 淘汰
+// 5.15 的 io_uring_complete 还没有 req 参数 只能按 (ring, user_data) 配对 覆盖的次数记在这里
+BPF_LRU_HASH(io_uring_pending, io_uring_key_t, io_uring_req_t, 10240);
+BPF_PERCPU_ARRAY(io_uring_collisions, u64, 1);
+
+// sq_entries 是 2 的幂 5.15 上已经没有 sq_mask
+static __always_inline int io_uring_read_sqe(struct io_ring_ctx *ring, struct io_uring_sqe *sqe)
+{
+    u32 head = READ_KERN(ring->cached_sq_head) - 1;
+    u32 entries = READ_KERN(ring->sq_entries);
+    u32 *sq_array = READ_KERN(ring->sq_array);
+    struct io_uring_sqe *sq_sqes = READ_KERN(ring->sq_sqes);
+    if (entries == 0 || sq_array == NULL || sq_sqes == NULL)
+        return -1;
+    u32 index = 0;
+    if (bpf_probe_read_kernel(&index, sizeof(index), &sq_array[head & (entries - 1)]) != 0)
+        return -1;
+    if (index >= entries)
+        return -1;
+    return bpf_probe_read_kernel(sqe, sizeof(*sqe), &sq_sqes[index]);
+}
+
+SEC("raw_tracepoint/io_uring_submit_sqe")
+int tracepoint__io_uring__io_uring_submit_sqe(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct io_ring_ctx *ring = (struct io_ring_ctx *) ctx->args[0];
+    if (READ_KERN(ring->flags) & IO_URING_SETUP_SQPOLL)
+        return 0;
+
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!should_trace(&p))
+        return 0;
+
+    struct io_uring_sqe sqe = {};
+    if (io_uring_read_sqe(ring, &sqe) != 0)
+        return 0;
+
+    io_uring_key_t key = {};
+    key.ring = (u64) ring;
+    key.user_data = sqe.user_data;
+    io_uring_req_t req = {};
+    req.context = p.event->context;
+    req.opcode = sqe.opcode;
+    req.flags = sqe.flags;
+    req.fd = sqe.fd;
+    req.len = sqe.len;
+    req.off = sqe.off;
+    req.addr = sqe.addr;
+    if (bpf_map_update_elem(&io_uring_pending, &key, &req, BPF_NOEXIST) != 0) {
+        // 前一个相同 user_data 的请求还没有完成 它的完成事件会丢失
+        u32 zero = 0;
+        u64 *collisions = bpf_map_lookup_elem(&io_uring_collisions, &zero);
+        if (collisions != NULL)
+            *collisions += 1;
+        bpf_map_update_elem(&io_uring_pending, &key, &req, BPF_ANY);
+    }
+    return 0;
+}
+
+SEC("raw_tracepoint/io_uring_complete")
+int tracepoint__io_uring__io_uring_complete(struct bpf_raw_tracepoint_args *ctx)
+{
+    io_uring_key_t key = {};
+    key.ring = ctx->args[0];
+    key.user_data = ctx->args[1];
+    io_uring_req_t *req = bpf_map_lookup_elem(&io_uring_pending, &key);
+    if (req == NULL)
+        return 0;
+
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    u64 now = p.event->context.ts;
+    p.event->context = req->context;
+    p.event->context.ts = now;
+    p.event->context.argnum = 0;
+
+    io_uring_info_t info = {};
+    info.opcode = req->opcode;
+    info.flags = req->flags;
+    info.fd = req->fd;
+    info.len = req->len;
+    info.res = (s32) ctx->args[2];
+    info.off = req->off;
+    info.addr = req->addr;
+    info.user_data = key.user_data;
+    info.latency = now - req->context.ts;
+    bpf_map_delete_elem(&io_uring_pending, &key);
+
+    save_to_submit_buf(p.event, (void *) &info, sizeof(io_uring_info_t), 0);
+    events_perf_submit_to(&p, IO_URING_COMPLETE, &io_uring_events);
+    return 0;
+}
@@ -0,0 +1,241 @@
+#include "types.h"
+#include "common/arguments.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/context.h"
+#include "common/filtering.h"
+#include "common/arming.h"
+#include "common/fork.h"
+#include "common/log2.h"
+
+#include "utils.h"
+
+// 挂载 libc 的 pthread_mutex_lock/unlock 以及内核的 futex
+// 在内核中按 (进程, 锁地址, 调用者 lr) 统计等待时间的 log2 直方图和持有时间
+// 用户态只定期读取统计结果 不经过 events
+// 没有竞争的 pthread_mutex_lock 只在用户态自旋或原子操作 不计入统计
+// 只有加锁期间进入了会阻塞的 futex 才算一次等待 栈也在这时才取
+
+#define LOCK_STACK_DEPTH 127
+#define LOCK_HIST_SLOTS 32
+
+#define FUTEX_WAIT 0
+#define FUTEX_LOCK_PI 6
+#define FUTEX_WAIT_BITSET 9
+#define FUTEX_WAIT_REQUEUE_PI 11
+#define FUTEX_CMD_MASK ~(128 | 256)
+
+enum lock_kind_e
+{
+    LOCK_MUTEX = 1,
+    LOCK_FUTEX,
+};
+
+typedef struct lock_pending {
+    u64 addr;
+    u64 lr;
+    u64 ts;
+    s32 user_stack_id;
+    u32 contended;
+} lock_pending_t;
+
+typedef struct lock_key {
+    u64 addr;
+    u64 lr;
+    u32 tgid;
+    u32 kind;
+} lock_key_t;
+
+typedef struct lock_stat {
+    u64 count;
+    u64 wait_ns;
+    u64 max_ns;
+    u64 hold_count;
+    u64 hold_ns;
+    s32 user_stack_id;
+    u32 padding;
+    u64 hist[LOCK_HIST_SLOTS];
+} lock_stat_t;
+
+typedef struct lock_held_key {
+    u64 addr;
+    u32 tgid;
+    u32 padding;
+} lock_held_key_t;
+
+typedef struct lock_held {
+    u64 lr;
+    u64 ts;
+} lock_held_t;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+    __uint(max_entries, 16384);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, LOCK_STACK_DEPTH * sizeof(u64));
+} lock_stacks SEC(".maps");
+
+// mutex 竞争时内部同样会走 futex 两者分开存放 避免互相覆盖
+// 线程退出或者锁没有解开时不会删除 使用 LRU 避免残留的记录占满 map
+BPF_LRU_HASH(lock_pending, u32, lock_pending_t, 10240);
+BPF_LRU_HASH(futex_pending, u32, lock_pending_t, 10240);
+BPF_LRU_HASH(lock_held_map, lock_held_key_t, lock_held_t, 10240);
+BPF_HASH(lock_stats, lock_key_t, lock_stat_t, 10240);
+// lock_stat_t 太大不适合放在栈上 新建记录时以这里的零值为模板 不会被写入
+BPF_ARRAY(lock_stat_zero, lock_stat_t, 1);
+
+static __always_inline lock_stat_t *lock_stat_get(lock_key_t *key, s32 user_stack_id)
+{
+    lock_stat_t *stat = bpf_map_lookup_elem(&lock_stats, key);
+    if (stat != NULL)
+        return stat;
+    u32 zero_key = 0;
+    lock_stat_t *zero = bpf_map_lookup_elem(&lock_stat_zero, &zero_key);
+    if (zero == NULL)
+        return NULL;
+    bpf_map_update_elem(&lock_stats, key, zero, BPF_NOEXIST);
+    stat = bpf_map_lookup_elem(&lock_stats, key);
+    if (stat != NULL)
+        stat->user_stack_id = user_stack_id;
+    return stat;
+}
+
+static __always_inline void lock_wait_done(lock_pending_t *pending, u32 kind)
+{
+    u64 delta = bpf_ktime_get_ns() - pending->ts;
+    lock_key_t key = {};
+    key.addr = pending->addr;
+    key.lr = pending->lr;
+    key.tgid = bpf_get_current_pid_tgid() >> 32;
+    key.kind = kind;
+    lock_stat_t *stat = lock_stat_get(&key, pending->user_stack_id);
+    if (stat == NULL)
+        return;
+    u32 slot = log2_u64(delta);
+    if (slot >= LOCK_HIST_SLOTS)
+        slot = LOCK_HIST_SLOTS - 1;
+    __sync_fetch_and_add(&stat->count, 1);
+    __sync_fetch_and_add(&stat->wait_ns, delta);
+    __sync_fetch_and_add(&stat->hist[slot], 1);
+    // 并发下可能丢失一次更新 最大值只作参考
+    if (delta > stat->max_ns)
+        stat->max_ns = delta;
+}
+
+// stack 为 false 时只记录时间 发生竞争后再回溯
+static __always_inline int lock_enter(void *ctx, void *pending_map, u64 addr, u64 lr, bool stack)
+{
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!should_trace(&p))
+        return 0;
+
+    u32 tid = (u32) bpf_get_current_pid_tgid();
+    lock_pending_t pending = {};
+    pending.addr = addr;
+    pending.lr = lr;
+    pending.user_stack_id = -1;
+    if (stack)
+        pending.user_stack_id = bpf_get_stackid(ctx, &lock_stacks, BPF_F_USER_STACK);
+    // 回溯也有开销 放在取时间之前
+    pending.ts = bpf_ktime_get_ns();
+    bpf_map_update_elem(pending_map, &tid, &pending, BPF_ANY);
+    return 0;
+}
+
+SEC("uprobe/lock_mutex")
+int probe_mutex_lock(struct pt_regs* ctx) {
+    // 函数入口处 x30 就是调用者的返回地址
+    return lock_enter(ctx, &lock_pending, PT_REGS_PARM1(ctx), ctx->regs[30], false);
+}
+
+SEC("uretprobe/lock_mutex_ret")
+int probe_mutex_lock_ret(struct pt_regs* ctx) {
+    u32 tid = (u32) bpf_get_current_pid_tgid();
+    lock_pending_t *pending = bpf_map_lookup_elem(&lock_pending, &tid);
+    if (pending == NULL)
+        return 0;
+    lock_pending_t saved = *pending;
+    bpf_map_delete_elem(&lock_pending, &tid);
+    if (PT_REGS_RC(ctx) != 0)
+        return 0;
+
+    if (saved.contended)
+        lock_wait_done(&saved, LOCK_MUTEX);
+
+    // 解锁时只给已有的记录累计持有时间 没有记录的就不需要记下加锁时间
+    lock_key_t key = {};
+    key.addr = saved.addr;
+    key.lr = saved.lr;
+    key.tgid = bpf_get_current_pid_tgid() >> 32;
+    key.kind = LOCK_MUTEX;
+    if (bpf_map_lookup_elem(&lock_stats, &key) == NULL)
+        return 0;
+
+    lock_held_key_t held_key = {};
+    held_key.addr = saved.addr;
+    held_key.tgid = key.tgid;
+    lock_held_t held = {};
+    held.lr = saved.lr;
+    held.ts = bpf_ktime_get_ns();
+    bpf_map_update_elem(&lock_held_map, &held_key, &held, BPF_ANY);
+    return 0;
+}
+
+// 持有时间计入加锁时的调用点 解锁可能在其他线程 不做过滤
+// 只有发生过竞争的锁才有记录 没有竞争过的锁不统计持有时间
+SEC("uprobe/lock_mutex_unlock")
+int probe_mutex_unlock(struct pt_regs* ctx) {
+    lock_held_key_t held_key = {};
+    held_key.addr = PT_REGS_PARM1(ctx);
+    held_key.tgid = bpf_get_current_pid_tgid() >> 32;
+    lock_held_t *held = bpf_map_lookup_elem(&lock_held_map, &held_key);
+    if (held == NULL)
+        return 0;
+    u64 delta = bpf_ktime_get_ns() - held->ts;
+    lock_key_t key = {};
+    key.addr = held_key.addr;
+    key.lr = held->lr;
+    key.tgid = held_key.tgid;
+    key.kind = LOCK_MUTEX;
+    bpf_map_delete_elem(&lock_held_map, &held_key);
+    lock_stat_t *stat = bpf_map_lookup_elem(&lock_stats, &key);
+    if (stat == NULL)
+        return 0;
+    __sync_fetch_and_add(&stat->hold_count, 1);
+    __sync_fetch_and_add(&stat->hold_ns, delta);
+    return 0;
+}
+
+// 与 syscall.c 一样直接挂 __arm64_sys_futex 第一个参数是用户态的 pt_regs
+// 只统计会阻塞的操作 wake 之类的直接忽略
+SEC("kprobe/lock_futex")
+int kprobe_futex(struct pt_regs* ctx) {
+    struct pt_regs *regs = (struct pt_regs *) PT_REGS_PARM1(ctx);
+    u32 op = (u32) READ_KERN(regs->regs[1]);
+    u32 cmd = op & FUTEX_CMD_MASK;
+    if (cmd != FUTEX_WAIT && cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_LOCK_PI && cmd != FUTEX_WAIT_REQUEUE_PI)
+        return 0;
+    // 在 pthread_mutex_lock 中阻塞 标记这次加锁发生了竞争
+    u32 tid = (u32) bpf_get_current_pid_tgid();
+    lock_pending_t *mutex = bpf_map_lookup_elem(&lock_pending, &tid);
+    if (mutex != NULL && !mutex->contended) {
+        mutex->contended = 1;
+        mutex->user_stack_id = bpf_get_stackid(ctx, &lock_stacks, BPF_F_USER_STACK);
+    }
+    return lock_enter(ctx, &futex_pending, READ_KERN(regs->regs[0]), READ_KERN(regs->regs[30]), true);
+}
+
+SEC("kretprobe/lock_futex")
+int kretprobe_futex(struct pt_regs* ctx) {
+    u32 tid = (u32) bpf_get_current_pid_tgid();
+    lock_pending_t *pending = bpf_map_lookup_elem(&futex_pending, &tid);
+    if (pending == NULL)
+        return 0;
+    lock_pending_t saved = *pending;
+    bpf_map_delete_elem(&futex_pending, &tid);
+    // 超时或者被信号打断同样是等待 一并计入
+    lock_wait_done(&saved, LOCK_FUTEX);
+    return 0;
+}
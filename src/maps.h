@@ -19,6 +19,9 @@
 #define BPF_LRU_HASH(_name, _key_type, _value_type, _max_entries)                                  \
     BPF_MAP(_name, BPF_MAP_TYPE_LRU_HASH, _key_type, _value_type, _max_entries)
 
+#define BPF_PERCPU_HASH(_name, _key_type, _value_type, _max_entries)                               \
+    BPF_MAP(_name, BPF_MAP_TYPE_PERCPU_HASH, _key_type, _value_type, _max_entries)
+
 #define BPF_PERCPU_ARRAY(_name, _value_type, _max_entries)                                         \
     BPF_MAP(_name, BPF_MAP_TYPE_PERCPU_ARRAY, u32, _value_type, _max_entries)
 
@@ -30,6 +33,8 @@
 
 BPF_PERCPU_ARRAY(bufs, buf_t, MAX_BUFFERS);                        // percpu global buffer variables
 BPF_PERF_OUTPUT(events, 1024);      // events submission
+BPF_PERF_OUTPUT(stack_events, 1024); // events with user stack, only used when callsite dedup or adaptive stack is on
+BPF_PERF_OUTPUT(stack_events_small, 1024); // events with a smaller user stack dump, only used when adaptive stack is on
 BPF_HASH(args_map, u64, args_t, 1024);                             // persist args between function entry and return
 BPF_HASH(child_parent_map, u32, u32, 512);
 BPF_HASH(common_filter, u32, common_filter_t, 1);
@@ -50,5 +55,26 @@ BPF_HASH(uprobe_point_args, u32, point_args_t, 6);
 BPF_HASH(sysenter_point_args, u32, point_args_t, 512);
 BPF_HASH(sysexit_point_args, u32, point_args_t, 512);
 BPF_ARRAY(base_config, config_entry_t, 1);
+// 下面这些 map 只在对应的选项开启时使用 这里都只声明一项
+// 开启时由用户态通过 MapSpecEditors 调整为实际需要的大小 见 module/maps.go
+BPF_HASH(armed_threads, u32, arm_state_t, 1);
+BPF_LRU_HASH(dedup_map, u32, dedup_state_t, 1);
+BPF_PERCPU_HASH(io_stats, io_key_t, io_stat_t, 1);
+BPF_HASH(flow_stats, io_key_t, flow_stat_t, 1);
+BPF_LRU_HASH(flow_closed, flow_closed_key_t, flow_stat_t, 1);
+BPF_LRU_HASH(fd_path_cache, fd_path_key_t, fd_path_t, 1);
+BPF_LRU_HASH(callsite_map, callsite_key_t, callsite_t, 1);
+BPF_PERCPU_ARRAY(callsite_next_id, u32, 1);
+BPF_LRU_HASH(stack_learned, u32, u32, 1);
+BPF_ARRAY(unwind_rows, unwind_row_t, 1);
+BPF_HASH(unwind_procs, u32, unwind_proc_t, 1);
+BPF_ARRAY(session_filters, session_filter_t, 1);
+BPF_ARRAY(sample_ratio, u32, 1);
+BPF_PERCPU_ARRAY(sample_hits, u64, 1);
+BPF_ARRAY(overhead_ctl, overhead_ctl_t, 1);
+BPF_LRU_HASH(str_dict, str_dict_key_t, u32, 1);
+BPF_LRU_HASH(str_dict_values, u32, str_dict_value_t, 1);
+BPF_PERCPU_ARRAY(str_dict_next_id, u32, 1);
+BPF_LRU_HASH(stopped_procs, u32, u64, 1);
 
 #endif /* __MAPS_H__ */
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "types.h"
+#include "common/arguments.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/context.h"
+#include "common/filtering.h"
+#include "common/arming.h"
+#include "common/fork.h"
+#include "common/log2.h"
+
+#include "utils.h"
+
+// 挂载 sched_switch 和 sched_wakeup 统计被追踪线程的 off-cpu 时间
+// 切出时记录时间 当前所在的 syscall 和用户栈 被唤醒时记录时间 切回时统计
+// 按 (线程, syscall, 用户栈) 累计总时间 其中在运行队列上等待的时间 以及 log2 直方图
+// 用户态只定期读取统计结果 不经过 events
+
+#define OFFCPU_STACK_DEPTH 127
+#define OFFCPU_HIST_SLOTS 32
+// arm64 的内核栈大小随 KASAN 和页大小变化 在 16K 到 64K 之间 pt_regs 在栈顶
+#define OFFCPU_THREAD_SIZE_MIN 16384
+#define OFFCPU_THREAD_SIZE_MAX 65536
+// 不同线程得到相同的结果达到这个次数才确定下来
+#define OFFCPU_THREAD_SIZE_VOTES 4
+// 不在 syscall 中 比如在用户态被抢占
+#define OFFCPU_NO_SYSCALL -1
+
+typedef struct offcpu_start {
+    u64 ts;
+    u64 wake_ts;
+    u32 tgid;
+    s32 sysno;
+    s32 user_stack_id;
+    u32 preempt;
+} offcpu_start_t;
+
+typedef struct offcpu_size_vote {
+    u32 size;
+    u32 votes;
+    u32 last_tid;
+    u32 padding;
+} offcpu_size_vote_t;
+
+typedef struct offcpu_key {
+    u32 tgid;
+    u32 tid;
+    s32 sysno;
+    s32 user_stack_id;
+} offcpu_key_t;
+
+typedef struct offcpu_stat {
+    u64 count;
+    u64 total_ns;
+    u64 max_ns;
+    u64 runq_ns;
+    u64 preempt_count;
+    u64 hist[OFFCPU_HIST_SLOTS];
+} offcpu_stat_t;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+    __uint(max_entries, 16384);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, OFFCPU_STACK_DEPTH * sizeof(u64));
+} offcpu_stacks SEC(".maps");
+
+// 线程退出时不会再切回 用 LRU 自动淘汰
+BPF_LRU_HASH(offcpu_start_map, u32, offcpu_start_t, 10240);
+BPF_HASH(offcpu_stats, offcpu_key_t, offcpu_stat_t, 10240);
+// offcpu_stat_t 太大不适合放在栈上 新建记录时以这里的零值为模板 不会被写入
+BPF_ARRAY(offcpu_stat_zero, offcpu_stat_t, 1);
+// 确定下来的内核栈大小 为 0 时还没有确定
+BPF_ARRAY(offcpu_thread_size, u32, 1);
+BPF_ARRAY(offcpu_thread_size_vote, offcpu_size_vote_t, 1);
+
+// 确定之前没有办法知道 pt_regs 的位置 syscall 一律按 NO_SYSCALL 统计
+static __always_inline struct pt_regs *offcpu_task_regs(struct task_struct *task)
+{
+    u32 zero = 0;
+    u32 *size = bpf_map_lookup_elem(&offcpu_thread_size, &zero);
+    if (size == NULL || *size == 0)
+        return NULL;
+    void *stack = READ_KERN(task->stack);
+    if (stack == NULL)
+        return NULL;
+    return (struct pt_regs *) (stack + *size) - 1;
+}
+
+// 进入内核时 syscallno 会被设置 从中断或异常进入时为 NO_SYSCALL
+static __always_inline s32 offcpu_task_sysno(struct task_struct *task)
+{
+    struct pt_regs *regs = offcpu_task_regs(task);
+    if (regs == NULL)
+        return OFFCPU_NO_SYSCALL;
+    s32 sysno = READ_KERN(regs->syscallno);
+    if (sysno < 0 || sysno >= 512)
+        return OFFCPU_NO_SYSCALL;
+    return sysno;
+}
+
+static __always_inline offcpu_stat_t *offcpu_stat_get(offcpu_key_t *key)
+{
+    offcpu_stat_t *stat = bpf_map_lookup_elem(&offcpu_stats, key);
+    if (stat != NULL)
+        return stat;
+    u32 zero_key = 0;
+    offcpu_stat_t *zero = bpf_map_lookup_elem(&offcpu_stat_zero, &zero_key);
+    if (zero == NULL)
+        return NULL;
+    bpf_map_update_elem(&offcpu_stats, key, zero, BPF_NOEXIST);
+    return bpf_map_lookup_elem(&offcpu_stats, key);
+}
+
+// 切回时统计 只有切出时通过了过滤的线程才会有记录
+static __always_inline void offcpu_switch_in(struct task_struct *next, u64 now)
+{
+    u32 tid = READ_KERN(next->pid);
+    offcpu_start_t *start = bpf_map_lookup_elem(&offcpu_start_map, &tid);
+    if (start == NULL)
+        return;
+    offcpu_start_t saved = *start;
+    bpf_map_delete_elem(&offcpu_start_map, &tid);
+
+    offcpu_key_t key = {};
+    key.tgid = saved.tgid;
+    key.tid = tid;
+    key.sysno = saved.sysno;
+    key.user_stack_id = saved.user_stack_id;
+    offcpu_stat_t *stat = offcpu_stat_get(&key);
+    if (stat == NULL)
+        return;
+
+    u64 delta = now - saved.ts;
+    // 被抢占时一直在运行队列上 没有唤醒的时间则同样全部计入
+    u64 wake_ts = saved.wake_ts;
+    if (wake_ts == 0 || wake_ts > now)
+        wake_ts = saved.ts;
+    u32 slot = log2_u64(delta);
+    if (slot >= OFFCPU_HIST_SLOTS)
+        slot = OFFCPU_HIST_SLOTS - 1;
+    __sync_fetch_and_add(&stat->count, 1);
+    __sync_fetch_and_add(&stat->total_ns, delta);
+    __sync_fetch_and_add(&stat->runq_ns, now - wake_ts);
+    __sync_fetch_and_add(&stat->hist[slot], 1);
+    if (saved.preempt)
+        __sync_fetch_and_add(&stat->preempt_count, 1);
+    // 并发下可能丢失一次更新 最大值只作参考
+    if (delta > stat->max_ns)
+        stat->max_ns = delta;
+}
+
+// 触发时 current 仍然是 prev 可以直接取它的用户栈
+// 5.10 和 5.15 上的参数都是 (preempt, prev, next) 之后的内核在末尾增加了 prev_state
+SEC("raw_tracepoint/sched_switch")
+int tracepoint__sched__sched_switch(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct task_struct *prev = (struct task_struct *) ctx->args[1];
+    struct task_struct *next = (struct task_struct *) ctx->args[2];
+    u64 now = bpf_ktime_get_ns();
+
+    offcpu_switch_in(next, now);
+
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+    if (!should_trace(&p))
+        return 0;
+
+    u32 tid = p.event->context.host_tid;
+    offcpu_start_t start = {};
+    start.tgid = p.event->context.host_pid;
+    start.sysno = offcpu_task_sysno(prev);
+    start.user_stack_id = bpf_get_stackid(ctx, &offcpu_stacks, BPF_F_USER_STACK);
+    // 被抢占时仍然在运行队列上 不会有唤醒
+    if (ctx->args[0]) {
+        start.preempt = 1;
+        start.wake_ts = now;
+    }
+    start.ts = now;
+    bpf_map_update_elem(&offcpu_start_map, &tid, &start, BPF_ANY);
+    return 0;
+}
+
+// sys_enter 的第一个参数就是栈顶的 pt_regs 以它为锚点计算内核栈大小
+// 要求多个不同线程的结果一致 确定之后每次只多一次 map 查询
+SEC("raw_tracepoint/sys_enter")
+int raw_syscalls_sys_enter(struct bpf_raw_tracepoint_args *ctx)
+{
+    u32 zero = 0;
+    u32 *size = bpf_map_lookup_elem(&offcpu_thread_size, &zero);
+    if (size == NULL || *size != 0)
+        return 0;
+    offcpu_size_vote_t *vote = bpf_map_lookup_elem(&offcpu_thread_size_vote, &zero);
+    if (vote == NULL)
+        return 0;
+    struct task_struct *task = (struct task_struct *) bpf_get_current_task();
+    u64 stack = (u64) READ_KERN(task->stack);
+    u64 top = ctx->args[0] + sizeof(struct pt_regs);
+    if (stack == 0 || top <= stack)
+        return 0;
+    u64 thread_size = top - stack;
+    // 只可能是 16K 32K 64K 之一
+    if (thread_size < OFFCPU_THREAD_SIZE_MIN || thread_size > OFFCPU_THREAD_SIZE_MAX || (thread_size & (thread_size - 1)) != 0)
+        return 0;
+    u32 tid = bpf_get_current_pid_tgid();
+    // 并发下计数可能不准 只会让确定的时间晚一些
+    if (vote->size != thread_size) {
+        vote->size = thread_size;
+        vote->votes = 1;
+        vote->last_tid = tid;
+        return 0;
+    }
+    if (vote->last_tid == tid)
+        return 0;
+    vote->last_tid = tid;
+    vote->votes += 1;
+    if (vote->votes >= OFFCPU_THREAD_SIZE_VOTES)
+        *size = thread_size;
+    return 0;
+}
+
+// 唤醒到切回之间是在运行队列上等待 cpu 的时间
+SEC("raw_tracepoint/sched_wakeup")
+int tracepoint__sched__sched_wakeup(struct bpf_raw_tracepoint_args *ctx)
+{
+    struct task_struct *task = (struct task_struct *) ctx->args[0];
+    u32 tid = READ_KERN(task->pid);
+    offcpu_start_t *start = bpf_map_lookup_elem(&offcpu_start_map, &tid);
+    if (start == NULL || start->wake_ts != 0)
+        return 0;
+    start->wake_ts = bpf_ktime_get_ns();
+    return 0;
+}
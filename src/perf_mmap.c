@@ -28,24 +28,179 @@ struct {
 //     __uint(max_entries, 32 * 1024 * 1024 /* 32 MB */);
 // } fake_events SEC(".maps");
 
-// SEC("perf_event")
-// int perf_event_handler(void *ctx) {
-//     struct bpf_perf_event_data *bpf_ctx = (struct bpf_perf_event_data *)(ctx);
-//     struct pt_regs *regs = (struct pt_regs *)(&bpf_ctx->regs);
-
-//     // u64 pc = READ_KERN(regs->pc);
-//     // u64 sp = READ_KERN(regs->sp);
-//     u64 pc = 0;
-//     u64 sp = 0;
-
-//     bpf_probe_read_user(&pc, sizeof(pc), &regs->pc);
-//     bpf_probe_read_user(&sp, sizeof(sp), &regs->sp);
-//     int pid = bpf_get_current_pid_tgid() >> 32;
-//     // // save_to_submit_buf(p.event, (void *) &pc, sizeof(u64), 2);
-//     // // save_to_submit_buf(p.event, (void *) &sp, sizeof(u64), 3);
-
-//     // bpf_printk("[perf_event] pc:0x%lx sp:0x%lx\n", pc, sp);
-//     bpf_printk("[perf_event] called pid:%d\n", pid);
-//     // bpf_printk("[perf_event] called pc:0x%lx\n", &regs->pc);
-//     return 0;
-// }
\ No newline at end of file
+// 多个硬件断点共用一个 perf_event 程序 按地址和调用位置统计命中次数
+// 只有每个地址的前 N 次命中 或者用户请求时 才输出完整的事件
+typedef struct brk_hit_key {
+    u64 addr;
+    u64 pc;
+} brk_hit_key_t;
+
+typedef struct brk_config {
+    u32 sample_limit;
+    u32 padding;
+    s64 extra_samples;
+} brk_config_t;
+
+enum brk_cond_flag_e {
+    BRK_COND_REG = 1 << 0,
+    BRK_COND_MEM = 1 << 1,
+    BRK_COND_LR = 1 << 2,
+};
+
+#define BRK_COND_MEM_MAX 16
+#define BRK_REG_SP 31
+#define BRK_REG_PC 32
+
+// 断点条件 设置的各项需要同时满足
+typedef struct brk_cond {
+    u32 flags;
+    u32 reg_index;
+    u64 reg_value;
+    u32 mem_reg_index;
+    s32 mem_offset;
+    u32 mem_len;
+    u32 padding;
+    u8 mem_pattern[BRK_COND_MEM_MAX];
+    u64 lr_start;
+    u64 lr_end;
+} brk_cond_t;
+
+typedef struct brk_event {
+    u32 pid;
+    u32 tid;
+    u64 addr;
+    u64 pc;
+    u64 lr;
+    u64 sp;
+    u64 hits;
+} brk_event_t;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __type(key, brk_hit_key_t);
+    __type(value, u64);
+    __uint(max_entries, 10240);
+} brk_hits SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __type(key, u64);
+    __type(value, u64);
+    __uint(max_entries, 64);
+} brk_addr_hits SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __type(key, u32);
+    __type(value, brk_config_t);
+    __uint(max_entries, 1);
+} brk_config SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __type(key, u64);
+    __type(value, brk_cond_t);
+    __uint(max_entries, 64);
+} brk_conds SEC(".maps");
+
+// ctx 只能以常量偏移访问 所以展开后逐个比较
+static __always_inline u64 brk_read_reg(struct bpf_perf_event_data *ctx, u32 index)
+{
+    if (index == BRK_REG_SP)
+        return ctx->regs.sp;
+    if (index == BRK_REG_PC)
+        return ctx->regs.pc;
+    u64 value = 0;
+    #pragma unroll
+    for (u32 i = 0; i < 31; i++) {
+        if (i == index) {
+            value = ctx->regs.regs[i];
+        }
+    }
+    return value;
+}
+
+static __always_inline bool brk_match_cond(struct bpf_perf_event_data *ctx, u64 addr)
+{
+    brk_cond_t *cond = bpf_map_lookup_elem(&brk_conds, &addr);
+    if (cond == NULL)
+        return true;
+    if (cond->flags & BRK_COND_REG) {
+        if (brk_read_reg(ctx, cond->reg_index) != cond->reg_value)
+            return false;
+    }
+    if (cond->flags & BRK_COND_LR) {
+        u64 lr = ctx->regs.regs[30];
+        if (lr < cond->lr_start || lr >= cond->lr_end)
+            return false;
+    }
+    if (cond->flags & BRK_COND_MEM) {
+        u8 buf[BRK_COND_MEM_MAX] = {};
+        u64 ptr = brk_read_reg(ctx, cond->mem_reg_index) + (s64)cond->mem_offset;
+        // 只读取要比较的字节 避免匹配内容在页尾时 多读的部分缺页导致整体失败
+        u32 mem_len = cond->mem_len;
+        if (mem_len > BRK_COND_MEM_MAX)
+            mem_len = BRK_COND_MEM_MAX;
+        if (bpf_probe_read_user(buf, mem_len, (void *)ptr) != 0)
+            return false;
+        #pragma unroll
+        for (u32 i = 0; i < BRK_COND_MEM_MAX; i++) {
+            if (i < mem_len && buf[i] != cond->mem_pattern[i])
+                return false;
+        }
+    }
+    return true;
+}
+
+static __always_inline u64 brk_count_hit(void *map, void *key)
+{
+    u64 *count = bpf_map_lookup_elem(map, key);
+    if (count != NULL) {
+        // 5.10 不支持 BPF_FETCH 这里不使用原子操作的返回值 计数在并发时只是近似
+        __sync_fetch_and_add(count, 1);
+        return *count;
+    }
+    u64 one = 1;
+    bpf_map_update_elem(map, key, &one, BPF_NOEXIST);
+    return 1;
+}
+
+SEC("perf_event")
+int perf_event_handler(struct bpf_perf_event_data *ctx) {
+    u32 zero = 0;
+    brk_config_t *config = bpf_map_lookup_elem(&brk_config, &zero);
+    if (config == NULL)
+        return 0;
+
+    // 对于断点事件 addr 就是断点地址
+    u64 addr = ctx->addr;
+    // 不满足条件的命中直接忽略 也不计数
+    if (!brk_match_cond(ctx, addr))
+        return 0;
+    brk_hit_key_t key = {};
+    key.addr = addr;
+    key.pc = ctx->regs.pc;
+    brk_count_hit(&brk_hits, &key);
+    u64 hits = brk_count_hit(&brk_addr_hits, &addr);
+
+    bool emit = hits <= config->sample_limit;
+    if (!emit && config->extra_samples > 0) {
+        __sync_fetch_and_add(&config->extra_samples, -1);
+        emit = true;
+    }
+    if (!emit)
+        return 0;
+
+    u64 pid_tgid = bpf_get_current_pid_tgid();
+    brk_event_t event = {};
+    event.pid = pid_tgid >> 32;
+    event.tid = pid_tgid;
+    event.addr = addr;
+    event.pc = ctx->regs.pc;
+    event.lr = ctx->regs.regs[30];
+    event.sp = ctx->regs.sp;
+    event.hits = hits;
+    bpf_perf_event_output(ctx, &brk_events, BPF_F_CURRENT_CPU, &event, sizeof(event));
+    // 返回 0 不再走断点事件本身的 overflow 处理
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "types.h"
+#include "common/arguments.h"
+#include "common/common.h"
+#include "common/consts.h"
+#include "common/context.h"
+#include "common/filtering.h"
+#include "common/arming.h"
+#include "common/fork.h"
+
+#include "utils.h"
+
+// 按固定频率在每个 cpu 上采样 只在内核中按 (进程, 用户栈) 计数
+// 用户态退出时读取计数和栈 输出 folded 格式 不经过 events
+
+#define PROFILE_STACK_DEPTH 127
+
+typedef struct profile_key {
+    u32 tgid;
+    s32 user_stack_id;
+} profile_key_t;
+
+struct {
+    __uint(type, BPF_MAP_TYPE_STACK_TRACE);
+    __uint(max_entries, 16384);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, PROFILE_STACK_DEPTH * sizeof(u64));
+} profile_stacks SEC(".maps");
+
+BPF_HASH(profile_counts, profile_key_t, u64, 40960);
+// profile_counts 满了之后新的栈无法计数 在这里累计丢弃的采样数
+BPF_PERCPU_ARRAY(profile_drops, u64, 1);
+
+SEC("perf_event")
+int profile_handler(struct bpf_perf_event_data *ctx)
+{
+    program_data_t p = {};
+    if (!init_program_data(&p, ctx))
+        return 0;
+
+    if (!should_trace(&p))
+        return 0;
+
+    profile_key_t key = {};
+    key.tgid = p.event->context.host_pid;
+    // 栈回溯失败时 id 为负数 同样计数 避免采样数对不上
+    key.user_stack_id = bpf_get_stackid(ctx, &profile_stacks, BPF_F_USER_STACK);
+
+    u64 *count = bpf_map_lookup_elem(&profile_counts, &key);
+    if (count == NULL) {
+        u64 one = 1;
+        if (bpf_map_update_elem(&profile_counts, &key, &one, BPF_NOEXIST) == 0)
+            return 0;
+        // 可能是其他 cpu 刚插入了同一个 key 再查一次
+        count = bpf_map_lookup_elem(&profile_counts, &key);
+        if (count == NULL) {
+            u32 zero = 0;
+            u64 *drops = bpf_map_lookup_elem(&profile_drops, &zero);
+            if (drops != NULL)
+                *drops += 1;
+            return 0;
+        }
+    }
+    __sync_fetch_and_add(count, 1);
+    return 0;
+}
@@ -4,35 +4,13 @@
 #include "common/consts.h"
 #include "common/context.h"
 #include "common/filtering.h"
+#include "common/arming.h"
 
 #include "utils.h"
-
-SEC("raw_tracepoint/sched_process_fork")
-int tracepoint__sched__sched_process_fork(struct bpf_raw_tracepoint_args *ctx)
-{
-    long ret = 0;
-    program_data_t p = {};
-    if (!init_program_data(&p, ctx))
-        return 0;
-
-    struct task_struct *parent = (struct task_struct *) ctx->args[0];
-    struct task_struct *child = (struct task_struct *) ctx->args[1];
-
-    u32 parent_ns_pid = get_task_ns_pid(parent);
-    u32 parent_ns_tgid = get_task_ns_tgid(parent);
-    u32 child_ns_pid = get_task_ns_pid(child);
-    u32 child_ns_tgid = get_task_ns_tgid(child);
-
-    u32* pid = bpf_map_lookup_elem(&child_parent_map, &parent_ns_pid);
-    if (unlikely(pid == NULL)) return 0;
-
-    if (*pid == parent_ns_pid){
-        ret = bpf_map_update_elem(&child_parent_map, &child_ns_pid, &parent_ns_pid, BPF_ANY);
-    } else {
-        bpf_printk("[stack] parent pid from map:%d\n", *pid);
-    }
-    return 0;
-}
+#include "common/callsite.h"
+#include "common/unwind.h"
+#include "common/fork.h"
+#include "common/signal.h"
 
 static __always_inline u32 probe_stack_warp(struct pt_regs* ctx, u32 point_key) {
     program_data_t p = {};
@@ -48,6 +26,9 @@ static __always_inline u32 probe_stack_warp(struct pt_regs* ctx, u32 point_key)
     common_filter_t* filter = bpf_map_lookup_elem(&common_filter, &filter_key);
     if (unlikely(filter == NULL)) return 0;
 
+    if ((filter->ctrl_flags & CTRL_SAMPLE) && !sample_hit(SAMPLE_UPROBE_START + point_key))
+        return 0;
+
     save_to_submit_buf(p.event, (void *) &point_key, sizeof(u32), 0);
     u64 lr = 0;
     if(filter->is_32bit) {
@@ -73,6 +54,7 @@ static __always_inline u32 probe_stack_warp(struct pt_regs* ctx, u32 point_key)
     op_ctx->reg_0 = READ_KERN(ctx->regs[0]);
     op_ctx->save_index = 4;
     op_ctx->op_key_index = 0;
+    op_ctx->str_dict = (filter->ctrl_flags & CTRL_STR_DICT) != 0;
 
     read_args(&p, point_args, op_ctx, ctx);
 
@@ -81,9 +63,14 @@ static __always_inline u32 probe_stack_warp(struct pt_regs* ctx, u32 point_key)
         return 0;
     }
 
-    events_perf_submit(&p, UPROBE_ENTER);
+    u64 fp = 0;
+    if (filter->ctrl_flags & (CTRL_STACK_ADAPTIVE | CTRL_BPF_UNWIND)) {
+        bpf_probe_read_kernel(&fp, sizeof(fp), &ctx->regs[29]);
+    }
+    unwind_user_stack(&p, filter, pc, sp, fp, lr);
+    callsite_perf_submit(&p, UPROBE_ENTER, filter, point_key, pc, lr, sp, fp);
     if (filter->signal > 0) {
-        bpf_send_signal(filter->signal);
+        filter_send_signal(&p, filter);
     }
     return 0;
 }
@@ -7,69 +7,34 @@
 #include "common/consts.h"
 #include "common/context.h"
 #include "common/filtering.h"
-
-SEC("raw_tracepoint/sched_process_fork")
-int tracepoint__sched__sched_process_fork(struct bpf_raw_tracepoint_args *ctx)
-{
-    long ret = 0;
+#include "common/arming.h"
+#include "common/dedup.h"
+#include "common/iostat.h"
+#include "common/flow.h"
+#include "common/callsite.h"
+#include "common/unwind.h"
+#include "common/session.h"
+#include "common/fork.h"
+#include "common/signal.h"
+
+// 开启 BTF 的 tp_btf 程序中 regs 可以直接解引用 其他情况只能通过 bpf_probe_read 读取
+// direct 总是常量 内联后不会产生多余的分支
+#define READ_REGS(direct, x) ((direct) ? (x) : READ_KERN(x))
+
+// sys_enter 的第二个参数就是调用号 不需要再从 regs 中读取
+// sys_exit 只有 (regs, ret) 两个参数 调用号仍然取 regs->syscallno
+static __always_inline u32 handle_sys_enter(void *ctx, struct pt_regs *regs, u32 sysno, bool direct) {
     program_data_t p = {};
     if (!init_program_data(&p, ctx))
         return 0;
 
-    struct task_struct *parent = (struct task_struct *) ctx->args[0];
-    struct task_struct *child = (struct task_struct *) ctx->args[1];
-
-    // 为了实现仅指定单个pid时 能追踪其产生的子进程的相关系统调用 设计如下
-    // 维护一个 map
-    // - 其 key 为进程 pid 
-    // - 其 value 为其父进程 pid
-    // 逻辑如下
-    // 当进入此处后，先获取进程本身信息，然后通过自己的父进程 pid 去 map 中取出对应的value
-    // 如果没有取到则说明这个进程不是要追踪的进程
-    // 取到了，则说明这个是之前产生的进程，然后向map存入进程信息 key 就是进程本身 pid 而 value则是父进程pid
-    // 那么最开始的 pid 从哪里来呢 答案是从首次通过 sys_enter 的过滤之后 向该map存放第一个key value
-    // 1. child_parent_map => {}
-    // 2. 出现第一个通过 sys_enter 处的过滤的进程，则更新map -> child_parent_map => {12345: 12345}
-    // 3. sched_process_fork 获取进程的父进程信息，检查map，发现父进程存在其中，则更新map -> child_parent_map => {12345: 12345, 22222: 12345}
-    // 4. sys_enter/sys_exit 有限次遍历 child_parent_map 取出key逐个比较当前进程的pid
-    // 待实现...
-
-    u32 parent_ns_pid = get_task_ns_pid(parent);
-    u32 parent_ns_tgid = get_task_ns_tgid(parent);
-    u32 child_ns_pid = get_task_ns_pid(child);
-    u32 child_ns_tgid = get_task_ns_tgid(child);
-
-    // bpf_printk("[syscall] parent_ns_pid:%d child_ns_pid:%d\n", parent_ns_pid, child_ns_pid);
-    u32* pid = bpf_map_lookup_elem(&child_parent_map, &parent_ns_pid);
-    if (unlikely(pid == NULL)) return 0;
-
-    if (*pid == parent_ns_pid){
-        // map中取出的父进程pid 这里fork产生子进程的pid相同
-        // 说明这个进程是我们自己添加的
-        // 那么现在把新产生的这个子进程 pid 放入 map
-        ret = bpf_map_update_elem(&child_parent_map, &child_ns_pid, &parent_ns_pid, BPF_ANY);
-        // bpf_printk("[syscall] parent_ns_pid:%d child_ns_pid:%d ret:%ld\n", parent_ns_pid, child_ns_pid, ret);
-    } else {
-        // 理论上不应该走到这个分支
-        // 因为我们用当前函数这里的 parent 期望的就是其之前map中的
-        bpf_printk("[syscall] parent pid from map:%d\n", *pid);
+    if (unlikely(p.config->arm_flags & ARM_BY_SYSCALL)) {
+        try_arm_by_syscall(&p, sysno);
     }
 
-    return 0;
-}
-
-SEC("raw_tracepoint/sys_enter")
-int raw_syscalls_sys_enter(struct bpf_raw_tracepoint_args* ctx) {
-    program_data_t p = {};
-    if (!init_program_data(&p, ctx))
-        return 0;
-
     if (!should_trace(&p))
         return 0;
 
-    struct pt_regs *regs = (struct pt_regs *)(ctx->args[0]);
-    u64 syscallno = READ_KERN(regs->syscallno);
-    u32 sysno = (u32)syscallno;
     // 先根据调用号确定有没有对应的参数获取方案 没有直接结束
     point_args_t* point_args = bpf_map_lookup_elem(&sysenter_point_args, &sysno);
     if (unlikely(point_args == NULL)) return 0;
@@ -90,35 +55,80 @@ int raw_syscalls_sys_enter(struct bpf_raw_tracepoint_args* ctx) {
     u32 *sysno_blacklist_value = bpf_map_lookup_elem(&common_list, &sysno_blacklist_key);
     if (unlikely(sysno_blacklist_value != NULL)) return 0;
 
+    if (filter->ctrl_flags & CTRL_SESSION) {
+        u8 session_mask = session_match(&p, sysno);
+        if (session_mask == 0) return 0;
+        p.event->context.session = session_mask;
+    }
+
+    // iotop 模式只需要 fd 和进入时间 返回时统计 不输出事件
+    if (filter->ctrl_flags & CTRL_IOTOP) {
+        if (iostat_kind(sysno) == NULL)
+            return 0;
+        args_t io_args = {};
+        io_args.args[0] = READ_REGS(direct, regs->regs[0]);
+        io_args.regs = (u64) regs;
+        io_args.ts = p.event->context.ts;
+        io_args.flag = 3;
+        save_args(&io_args, SYSCALL_ENTER);
+        return 0;
+    }
+
+    // flow 模式同样不输出事件 sendto 需要第 5 个参数取对端地址
+    if (filter->ctrl_flags & CTRL_FLOW) {
+        args_t flow_args = {};
+        if (direct) {
+            __builtin_memcpy(flow_args.args, regs->regs, sizeof(flow_args.args));
+        } else {
+            bpf_probe_read_kernel(flow_args.args, sizeof(flow_args.args), regs->regs);
+        }
+        flow_args.regs = (u64) regs;
+        flow_args.ts = p.event->context.ts;
+        flow_args.flag = 4;
+        save_args(&flow_args, SYSCALL_ENTER);
+        return 0;
+    }
+
+    // 没有保存寄存器 返回时同样会跳过
+    if ((filter->ctrl_flags & CTRL_SAMPLE) && !sample_hit(sysno))
+        return 0;
+
     // 保存寄存器应该放到所有过滤完成之后
     args_t saved_regs = {};
-    saved_regs.args[0] = READ_KERN(regs->regs[0]);
-    saved_regs.args[1] = READ_KERN(regs->regs[1]);
-    saved_regs.args[2] = READ_KERN(regs->regs[2]);
-    saved_regs.args[3] = READ_KERN(regs->regs[3]);
-    saved_regs.args[4] = READ_KERN(regs->regs[4]);
-    saved_regs.args[5] = READ_KERN(regs->regs[5]);
-    save_args(&saved_regs, SYSCALL_ENTER);
-
-    // event->context 已经有进程的信息了
-    save_to_submit_buf(p.event, (void *) &sysno, sizeof(u32), 0);
+    if (direct) {
+        // 一次性复制 x0-x5 不需要调用辅助函数
+        __builtin_memcpy(saved_regs.args, regs->regs, sizeof(saved_regs.args));
+    } else {
+        bpf_probe_read_kernel(saved_regs.args, sizeof(saved_regs.args), regs->regs);
+    }
+    saved_regs.regs = (u64) regs;
 
     // 先获取 lr sp pc 并发送 这样可以尽早计算调用来源情况
     // READ_KERN 好像有问题
     u64 lr = 0;
     if(filter->is_32bit) {
-        bpf_probe_read_kernel(&lr, sizeof(lr), &regs->regs[14]);
-        save_to_submit_buf(p.event, (void *) &lr, sizeof(u64), 1);
+        lr = READ_REGS(direct, regs->regs[14]);
     }
     else {
-        bpf_probe_read_kernel(&lr, sizeof(lr), &regs->regs[30]);
-        save_to_submit_buf(p.event, (void *) &lr, sizeof(u64), 1);
+        lr = READ_REGS(direct, regs->regs[30]);
+    }
+
+    // 连续重复的 syscall 只计数 返回时同样跳过
+    if (filter->ctrl_flags & CTRL_DEDUP) {
+        if (dedup_sys_enter(&p, sysno, &saved_regs, lr)) {
+            saved_regs.flag = 2;
+            save_args(&saved_regs, SYSCALL_ENTER);
+            return 0;
+        }
     }
-    u64 sp = 0;
-    bpf_probe_read_kernel(&sp, sizeof(sp), &regs->sp);
+    save_args(&saved_regs, SYSCALL_ENTER);
+
+    // event->context 已经有进程的信息了
+    save_to_submit_buf(p.event, (void *) &sysno, sizeof(u32), 0);
+    save_to_submit_buf(p.event, (void *) &lr, sizeof(u64), 1);
+    u64 sp = READ_REGS(direct, regs->sp);
     save_to_submit_buf(p.event, (void *) &sp, sizeof(u64), 2);
-    u64 pc = 0;
-    bpf_probe_read_kernel(&pc, sizeof(pc), &regs->pc);
+    u64 pc = READ_REGS(direct, regs->pc);
     save_to_submit_buf(p.event, (void *) &pc, sizeof(u64), 3);
 
     int ctx_index = 0;
@@ -130,6 +140,7 @@ int raw_syscalls_sys_enter(struct bpf_raw_tracepoint_args* ctx) {
     op_ctx->reg_0 = saved_regs.args[0];
     op_ctx->save_index = 4;
     op_ctx->op_key_index = 0;
+    op_ctx->str_dict = (filter->ctrl_flags & CTRL_STR_DICT) != 0;
 
     read_args(&p, point_args, op_ctx, regs);
     
@@ -140,15 +151,19 @@ int raw_syscalls_sys_enter(struct bpf_raw_tracepoint_args* ctx) {
         return 0;
     }
 
-    events_perf_submit(&p, SYSCALL_ENTER);
+    u64 fp = 0;
+    if (filter->ctrl_flags & (CTRL_STACK_ADAPTIVE | CTRL_BPF_UNWIND)) {
+        fp = READ_REGS(direct, regs->regs[29]);
+    }
+    unwind_user_stack(&p, filter, pc, sp, fp, lr);
+    callsite_perf_submit(&p, SYSCALL_ENTER, filter, sysno, pc, lr, sp, fp);
     if (filter->signal > 0) {
-        bpf_send_signal(filter->signal);
+        filter_send_signal(&p, filter);
     }
     return 0;
 }
 
-SEC("raw_tracepoint/sys_exit")
-int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
+static __always_inline u32 handle_sys_exit(void *ctx, struct pt_regs *regs, u64 ret, bool direct) {
 
     program_data_t p = {};
     if (!init_program_data(&p, ctx))
@@ -157,8 +172,7 @@ int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
     if (!should_trace(&p))
         return 0;
 
-    struct pt_regs *regs = (struct pt_regs *)(ctx->args[0]);
-    u64 syscallno = READ_KERN(regs->syscallno);
+    u64 syscallno = READ_REGS(direct, regs->syscallno);
     u32 sysno = (u32)syscallno;
 
     point_args_t* point_args = bpf_map_lookup_elem(&sysexit_point_args, &sysno);
@@ -176,6 +190,18 @@ int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
     if (saved_regs.flag == 1) {
         return 0;
     }
+    if (saved_regs.flag == 2) {
+        dedup_sys_exit(&p, sysno, ret);
+        return 0;
+    }
+    if (saved_regs.flag == 3) {
+        iostat_sys_exit(&p, sysno, &saved_regs, ret);
+        return 0;
+    }
+    if (saved_regs.flag == 4) {
+        flow_sys_exit(&p, sysno, &saved_regs, ret);
+        return 0;
+    }
 
     if (filter->trace_mode == TRACE_COMMON) {
         // 非 追踪全部syscall模式
@@ -189,6 +215,12 @@ int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
     u32 *sysno_blacklist_value = bpf_map_lookup_elem(&common_list, &sysno_blacklist_key);
     if (unlikely(sysno_blacklist_value != NULL)) return 0;
 
+    if (filter->ctrl_flags & CTRL_SESSION) {
+        u8 session_mask = session_match(&p, sysno);
+        if (session_mask == 0) return 0;
+        p.event->context.session = session_mask;
+    }
+
     // 保存系统调用号
     save_to_submit_buf(p.event, (void *) &sysno, sizeof(u32), 0);
 
@@ -200,6 +232,7 @@ int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
     op_ctx->reg_0 = saved_regs.args[0];
     op_ctx->save_index = 1;
     op_ctx->op_key_index = 0;
+    op_ctx->str_dict = (filter->ctrl_flags & CTRL_STR_DICT) != 0;
 
     read_args(&p, point_args, op_ctx, regs);
 
@@ -208,14 +241,80 @@ int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
         return 0;
     }
 
-    // 读取返回值
-    u64 ret = READ_KERN(regs->regs[0]);
+    // 保存返回值
     save_to_submit_buf(p.event, (void *) &ret, sizeof(ret), op_ctx->save_index);
 
+    if (filter->ctrl_flags & (CTRL_STACK_DEDUP | CTRL_STACK_ADAPTIVE | CTRL_STACK_SWITCH)) {
+        // 返回时用户态的 lr pc sp 与进入时一致
+        u64 exit_lr = 0;
+        if (filter->is_32bit) {
+            exit_lr = READ_REGS(direct, regs->regs[14]);
+        } else {
+            exit_lr = READ_REGS(direct, regs->regs[30]);
+        }
+        u64 exit_pc = READ_REGS(direct, regs->pc);
+        u64 exit_sp = READ_REGS(direct, regs->sp);
+        u64 exit_fp = READ_REGS(direct, regs->regs[29]);
+        callsite_perf_submit(&p, SYSCALL_EXIT, filter, sysno, exit_pc, exit_lr, exit_sp, exit_fp);
+        return 0;
+    }
     events_perf_submit(&p, SYSCALL_EXIT);
     return 0;
 }
 
+#ifdef __SYSCALL_BTF
+// 内核开启 BTF 时使用 tp_btf 参数带有类型信息 可以直接访问 pt_regs
+// 没有内核 BTF 的设备上无法加载 tp_btf 所以单独编译为 syscall_btf.o
+SEC("tp_btf/sys_enter")
+int btf_raw_syscalls_sys_enter(u64 *ctx) {
+    struct pt_regs *regs = (struct pt_regs *)ctx[0];
+    return handle_sys_enter(ctx, regs, (u32)ctx[1], true);
+}
+
+SEC("tp_btf/sys_exit")
+int btf_raw_syscalls_sys_exit(u64 *ctx) {
+    struct pt_regs *regs = (struct pt_regs *)ctx[0];
+    u64 ret = ctx[1];
+    return handle_sys_exit(ctx, regs, ret, true);
+}
+#else
+SEC("raw_tracepoint/sys_enter")
+int raw_syscalls_sys_enter(struct bpf_raw_tracepoint_args* ctx) {
+    struct pt_regs *regs = (struct pt_regs *)(ctx->args[0]);
+    return handle_sys_enter(ctx, regs, (u32)ctx->args[1], false);
+}
+
+SEC("raw_tracepoint/sys_exit")
+int raw_syscalls_sys_exit(struct bpf_raw_tracepoint_args* ctx) {
+    struct pt_regs *regs = (struct pt_regs *)(ctx->args[0]);
+    u64 ret = ctx->args[1];
+    return handle_sys_exit(ctx, regs, ret, false);
+}
+#endif
+
+// 白名单中的 syscall 较少时 不再挂 raw_tracepoint
+// 而是直接在对应的 __arm64_sys_xxx 上挂 kprobe/kretprobe
+// 这样其他 syscall 完全不会进入 eBPF 程序
+// __arm64_sys_xxx 的第一个参数就是用户态的 pt_regs
+SEC("kprobe/sys_enter")
+int kprobe_sys_enter(struct pt_regs* ctx) {
+    struct pt_regs *regs = (struct pt_regs *)PT_REGS_PARM1(ctx);
+    u32 sysno = (u32)READ_KERN(regs->syscallno);
+    return handle_sys_enter(ctx, regs, sysno, false);
+}
+
+SEC("kretprobe/sys_exit")
+int kretprobe_sys_exit(struct pt_regs* ctx) {
+    // 返回时 x0 已经被覆盖 用户态 pt_regs 地址从进入时保存的参数中取
+    // 此时返回值还没有写回用户态 pt_regs 所以直接取 kretprobe 的返回值
+    args_t saved_regs;
+    if (load_args(&saved_regs, SYSCALL_ENTER) != 0) {
+        return 0;
+    }
+    struct pt_regs *regs = (struct pt_regs *) saved_regs.regs;
+    u64 ret = PT_REGS_RC(ctx);
+    return handle_sys_exit(ctx, regs, ret, false);
+}
 
 // bpf_printk debug use
 // echo 1 > /sys/kernel/tracing/tracing_on
@@ -9,11 +9,177 @@ typedef struct common_filter {
     u32 trace_mode;
     u32 trace_uid_group;
     u32 signal;
+    u32 ctrl_flags;
+    u32 stack_every;
+    u32 stack_small;
 } common_filter_t;
 
+enum ctrl_flag_e
+{
+    CTRL_DEDUP = 1 << 0,
+    CTRL_IOTOP = 1 << 1,
+    CTRL_FLOW = 1 << 2,
+    CTRL_COUNT_CALLER = 1 << 3,
+    CTRL_STACK_DEDUP = 1 << 4,
+    CTRL_STACK_ADAPTIVE = 1 << 5,
+    CTRL_BPF_UNWIND = 1 << 6,
+    CTRL_SESSION = 1 << 7,
+    CTRL_SAMPLE = 1 << 8,
+    CTRL_STACK_SWITCH = 1 << 9,
+    CTRL_STR_DICT = 1 << 10,
+};
+
+typedef struct io_key {
+    u32 tgid;
+    u32 fd;
+} io_key_t;
+
+// 按 (进程, fd) 统计的读写情况 percpu 不需要原子操作
+typedef struct io_stat {
+    u64 rd_ops;
+    u64 rd_bytes;
+    u64 wr_ops;
+    u64 wr_bytes;
+    u64 errors;
+    u64 latency_ns;
+} io_stat_t;
+
+// iotop 模式下 common_list 中 SYS_IO_START 范围的值
+// 只有第一个参数是 fd 的读写类 syscall 会在这个范围中
+enum io_kind_e
+{
+    IO_READ = 1,
+    IO_WRITE,
+};
+
+// flow 模式下 common_list 中 SYS_FLOW_START 范围的值
+enum flow_kind_e
+{
+    FLOW_CONNECT = 1,
+    FLOW_ACCEPT,
+    FLOW_CLOSE,
+    FLOW_SENDTO,
+    FLOW_SEND,
+    FLOW_RECV,
+    FLOW_WRITE,
+    FLOW_READ,
+};
+
+// 同样以 io_key_t 为 key 对端地址只在 connect/accept 时记录一次
+typedef struct flow_stat {
+    u64 tx_bytes;
+    u64 tx_pkts;
+    u64 rx_bytes;
+    u64 rx_pkts;
+    u64 first_ts;
+    u64 last_ts;
+    u32 closed;
+    u32 peer_len;
+    u8 peer[128];
+} flow_stat_t;
+
+// 已关闭的连接 first_ts 区分同一个 fd 上的先后连接
+typedef struct flow_closed_key {
+    u32 tgid;
+    u32 fd;
+    u64 first_ts;
+} flow_closed_key_t;
+
+typedef struct fd_path_key {
+    u32 tgid;
+    u32 fd;
+    u64 file;
+} fd_path_key_t;
+
+// fd 对应的路径 同一个 file 只解析一次
+typedef struct fd_path {
+    char path[MAX_STRING_SIZE];
+} fd_path_t;
+
+// 调用点 同一个调用点只在首次或每 N 次时取栈
+typedef struct callsite_key {
+    u64 pc;
+    u64 lr;
+    u32 tgid;
+    u32 eventid;
+    u32 point;
+    u32 padding;
+} callsite_key_t;
+
+typedef struct callsite {
+    u32 id;
+    u32 hits;
+} callsite_t;
+
+// 由 .eh_frame 转换来的回溯规则 对 [pc, 下一条规则的 pc) 有效
+// 偏移都是相对 CFA 的 ra_off 为 0 表示返回地址还在 lr 中 fp_off 为 0 表示 x29 没有被保存
+typedef struct unwind_row {
+    u64 pc;
+    s16 cfa_off;
+    u8 cfa_reg;
+    u8 padding;
+    s16 ra_off;
+    s16 fp_off;
+} unwind_row_t;
+
+enum unwind_reg_e
+{
+    UNWIND_REG_SP = 0,
+    UNWIND_REG_FP = 1,
+    // 规则无法用上面的形式表示 按帧指针回溯
+    UNWIND_REG_NONE = 2,
+    // 返回地址未定义 已经是最外层的帧
+    UNWIND_REG_END = 3,
+};
+
+// 进程中的一段可执行映射 pc - bias 即为库中的虚拟地址
+typedef struct unwind_mapping {
+    u64 start;
+    u64 end;
+    u64 bias;
+    u32 row_start;
+    u32 row_count;
+} unwind_mapping_t;
+
+// 守护进程模式下每个会话自己的过滤条件 在通过全局过滤之后计算
+typedef struct session_filter {
+    u32 active;
+    u32 uid;
+    u32 pid;
+    u32 padding;
+    u64 syscalls[SESSION_SYSCALL_WORDS];
+} session_filter_t;
+
+// 开销控制 由用户态按测量结果调整
+typedef struct overhead_ctl {
+    u32 stack_off;
+    u32 padding;
+} overhead_ctl_t;
+
+// 字符串字典 按进程区分 同一个字符串在不同进程中的 id 不同
+typedef struct str_dict_key {
+    u32 tgid;
+    u32 padding;
+    u64 hash;
+} str_dict_key_t;
+
+typedef struct str_dict_value {
+    char buf[STR_DICT_MAX_LEN];
+} str_dict_value_t;
+
+typedef struct unwind_proc {
+    u32 count;
+    u32 padding;
+    unwind_mapping_t maps[UNWIND_MAX_MAPPINGS];
+} unwind_proc_t;
+
 typedef struct args {
     unsigned long args[6];
     u32 flag;
+    // 用户态 pt_regs 地址 kretprobe 方式下在返回时需要用到
+    u64 regs;
+    // 进入时间 用于统计耗时
+    u64 ts;
 } args_t;
 
 typedef struct thread_name {
@@ -45,8 +211,24 @@ enum arg_filter_e
 typedef struct config_entry {
     u32 stackplz_pid;
     u32 thread_whitelist;
+    u32 arm_flags;
+    u32 padding;
+    u64 arm_timeout;
 } config_entry_t;
 
+enum arm_flag_e
+{
+    ARM_BY_UPROBE = 1 << 0,
+    ARM_BY_SYSCALL = 1 << 1,
+};
+
+// 线程进入 arm 状态后 才会被 should_trace 放行
+typedef struct arm_state {
+    u32 depth;
+    u32 padding;
+    u64 ts;
+} arm_state_t;
+
 enum trace_group_e
 {
     GROUP_NONE = 1 << 0,
@@ -61,9 +243,31 @@ enum event_id_e
 {
     SYSCALL_ENTER = 456,
     SYSCALL_EXIT,
-    UPROBE_ENTER
+    UPROBE_ENTER,
+    HW_BREAKPOINT,
+    SYSCALL_REPEAT,
+    IO_URING_COMPLETE
 };
 
+// 每个线程上一次 syscall 的特征 连续相同的 syscall 只记录次数
+typedef struct dedup_state {
+    u32 sysno;
+    u32 count;
+    u64 lr;
+    u64 args[4];
+    u64 first_ts;
+    u64 last_ts;
+    s64 bytes;
+} dedup_state_t;
+
+typedef struct repeat_info {
+    u32 count;
+    u32 padding;
+    u64 first_ts;
+    u64 last_ts;
+    s64 bytes;
+} repeat_info_t;
+
 enum op_code_e
 {
     OP_SKIP = 233,
@@ -94,7 +298,8 @@ enum op_code_e
     OP_FILTER_STRING,
     OP_SAVE_STRING,
     OP_SAVE_PTR_STRING,
-    OP_READ_STD_STRING
+    OP_READ_STD_STRING,
+    OP_SAVE_FD_PATH
 };
 
 enum arm64_reg_e
@@ -198,7 +403,8 @@ typedef struct op_ctx {
     u8 skip_flag;
     u8 match_whitelist;
     u8 match_blacklist;
-    u8 unused;
+    // common_filter 中的 CTRL_STR_DICT 进入时取一次 每个字符串不用再查
+    u8 str_dict;
     u32 loop_index;
     u32 op_key_index;
     u32 op_code;
@@ -237,7 +443,11 @@ typedef struct event_context {
     u32 uid;
     char comm[TASK_COMM_LEN];
     u8 argnum;
-    char padding[7];
+    // 守护进程模式下 事件属于哪些会话 每个会话一位
+    u8 session;
+    char padding[2];
+    // 调用点去重模式下的调用点 id 0 表示没有
+    u32 callsite;
 } event_context_t;
 
 typedef struct event_data {
@@ -0,0 +1,4 @@
+// 同时追踪 syscall 和 uprobe
+// 两者共用同一套过滤 map 和 events 输出 事件按发生顺序出现在同一个事件流中
+#include "syscall.c"
+#include "stack.c"
@@ -10,6 +10,8 @@
 #include "common/common.h"
 #include "common/consts.h"
 #include "common/buffer.h"
+#include "common/fdpath.h"
+#include "common/strdict.h"
 
 typedef struct point_arg_t {
     u32 point_flag;
@@ -202,13 +204,13 @@ static __noinline u32 read_args(program_data_t* p, point_args_t* point_args, op_
             case OP_SAVE_STRING:
                 // fix memory tag
                 op_ctx->read_addr = op_ctx->read_addr & 0xffffffffff;
-                u32 old_off = p->event->buf_off;
-                int save_string_status = save_str_to_buf(p->event, (void*) op_ctx->read_addr, op_ctx->save_index);
+                u32 str_len = 0;
+                int save_string_status = save_str_dict_to_buf(p->event, (void*) op_ctx->read_addr, op_ctx->save_index, &str_len, op_ctx->str_dict);
                 if (save_string_status == 0) {
                     // 失败的情况存一个空数据 暂时没有遇到 有待测试
                     save_bytes_to_buf(p->event, 0, 0, op_ctx->save_index);
                 } else {
-                   op_ctx->str_len = p->event->buf_off - (old_off + sizeof(int) + 1);
+                   op_ctx->str_len = str_len;
                 }
                 op_ctx->save_index += 1;
                 break;
@@ -244,6 +246,20 @@ static __noinline u32 read_args(program_data_t* p, point_args_t* point_args, op_
                 op_ctx->read_addr = ptr;
                 break;
             }
+            case OP_SAVE_FD_PATH:
+            {
+                // read_addr 此时是 fd 的值
+                int fd = (int) op_ctx->read_addr;
+                int status = 0;
+                if (fd >= 0) {
+                    status = save_fd_path_to_buf(p->event, (u32) fd, op_ctx->save_index);
+                }
+                if (status == 0) {
+                    save_bytes_to_buf(p->event, 0, 0, op_ctx->save_index);
+                }
+                op_ctx->save_index += 1;
+                break;
+            }
             default:
                 break;
         }
@@ -40,10 +40,22 @@ func parse_STRING(ctx IArgType, ptr uint64, buf *bytes.Buffer, parse_more bool)
 	if err := binary.Read(buf, binary.LittleEndian, &arg); err != nil {
 		panic(err)
 	}
-	payload := make([]byte, arg.Len)
+	// 开启 --str-dict 时 size 为负数表示之前发送过的字符串 只有 id
+	if int32(arg.Len) < 0 {
+		return fmt.Sprintf("0x%x(%s)", ptr, strDictGet(uint32(-int32(arg.Len))))
+	}
+	is_new := arg.Len&STR_DICT_NEW != 0
+	payload := make([]byte, arg.Len&^STR_DICT_NEW)
 	if err := binary.Read(buf, binary.LittleEndian, &payload); err != nil {
 		panic(err)
 	}
+	if is_new {
+		var id uint32
+		if err := binary.Read(buf, binary.LittleEndian, &id); err != nil {
+			panic(err)
+		}
+		strDictAdd(id, payload)
+	}
 	return fmt.Sprintf("0x%x(%s)", ptr, util.B2STrim(payload))
 }
 
@@ -62,6 +74,32 @@ func r_STD_STRING() IArgType {
 	return at
 }
 
+func parse_FDPATH(ctx IArgType, ptr uint64, buf *bytes.Buffer, parse_more bool) string {
+	if !parse_more {
+		return fmt.Sprintf("%d", int32(ptr))
+	}
+	var arg Arg_str
+	if err := binary.Read(buf, binary.LittleEndian, &arg); err != nil {
+		panic(err)
+	}
+	payload := make([]byte, arg.Len)
+	if err := binary.Read(buf, binary.LittleEndian, &payload); err != nil {
+		panic(err)
+	}
+	if arg.Len == 0 {
+		return fmt.Sprintf("%d", int32(ptr))
+	}
+	return fmt.Sprintf("%d(%s)", int32(ptr), util.B2STrim(payload))
+}
+
+func r_FDPATH() IArgType {
+	// 在内核中由 fd 解析出文件路径 结果会按 (tgid, fd, file) 缓存
+	at := RegisterPre("fdpath", FDPATH, STRUCT)
+	at.AddOp(OPC_SAVE_FD_PATH)
+	at.SetParseCB(parse_FDPATH)
+	return at
+}
+
 func parse_STRING_ARRAY(ctx IArgType, ptr uint64, buf *bytes.Buffer, parse_more bool) string {
 	if !parse_more {
 		return fmt.Sprintf("0x%x", ptr)
@@ -262,6 +262,8 @@ func LazyRegister(type_index uint32) IArgType {
 		return r_SOCKADDR()
 	case BUFFER_X2:
 		return r_BUFFER_X2()
+	case FDPATH:
+		return r_FDPATH()
 	default:
 		panic(fmt.Sprintf("LazyRegister for type_index:%d failed", type_index))
 	}
@@ -35,6 +35,7 @@ const (
 	OP_SAVE_STRING
 	OP_SAVE_PTR_STRING
 	OP_READ_STD_STRING
+	OP_SAVE_FD_PATH
 )
 
 type BaseOpConfig struct {
@@ -289,6 +290,7 @@ var OPC_SAVE_STRING = ROP("SAVE_STRING", OP_SAVE_STRING)
 var OPC_FILTER_STRING = ROP("FILTER_STRING", OP_FILTER_STRING)
 var OPC_SAVE_PTR_STRING = ROP("SAVE_PTR_STRING", OP_SAVE_PTR_STRING)
 var OPC_READ_STD_STRING = ROP("READ_STD_STRING", OP_READ_STD_STRING)
+var OPC_SAVE_FD_PATH = ROP("SAVE_FD_PATH", OP_SAVE_FD_PATH)
 
 func BuildReadRegBreakCount(reg_index uint64) *OpConfig {
 	op := OpConfig{}
@@ -0,0 +1,55 @@
+package argtype
+
+import (
+	"fmt"
+	"stackplz/user/util"
+	"sync"
+)
+
+// 与 consts.h 中的定义一致
+const (
+	STR_DICT_MAX_LEN = 256
+	STR_DICT_NEW     = 1 << 30
+)
+
+// 字典只会增长 超过这个数量时清空 之后的引用通过 str_dict_values 取回
+const STR_DICT_MAX_ENTRIES = 65536
+
+type strDict struct {
+	sync.Mutex
+	values map[uint32]string
+	lookup func(id uint32) (string, bool)
+}
+
+var str_dict = strDict{values: make(map[uint32]string)}
+
+// 引用可能先于定义到达 由模块设置从 str_dict_values 读取的方法
+func SetStrDictLookup(lookup func(id uint32) (string, bool)) {
+	str_dict.Lock()
+	defer str_dict.Unlock()
+	str_dict.lookup = lookup
+}
+
+func strDictAdd(id uint32, payload []byte) {
+	str_dict.Lock()
+	defer str_dict.Unlock()
+	if len(str_dict.values) >= STR_DICT_MAX_ENTRIES {
+		str_dict.values = make(map[uint32]string)
+	}
+	str_dict.values[id] = util.B2STrim(payload)
+}
+
+func strDictGet(id uint32) string {
+	str_dict.Lock()
+	defer str_dict.Unlock()
+	if value, ok := str_dict.values[id]; ok {
+		return value
+	}
+	if str_dict.lookup != nil {
+		if value, ok := str_dict.lookup(id); ok {
+			str_dict.values[id] = value
+			return value
+		}
+	}
+	return fmt.Sprintf("<str#%d>", id)
+}
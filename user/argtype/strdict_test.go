@@ -0,0 +1,60 @@
+package argtype
+
+import (
+	"bytes"
+	"encoding/binary"
+	"testing"
+)
+
+// 按 strdict.h 中的格式构造 [index][size][string][id]
+func strDictArg(size int32, payload string, id uint32) *bytes.Buffer {
+	buf := &bytes.Buffer{}
+	buf.WriteByte(4)
+	binary.Write(buf, binary.LittleEndian, size)
+	buf.WriteString(payload)
+	if size > 0 && size&STR_DICT_NEW != 0 {
+		binary.Write(buf, binary.LittleEndian, id)
+	}
+	return buf
+}
+
+func TestParseStringStrDict(t *testing.T) {
+	str_dict = strDict{values: make(map[uint32]string)}
+	SetStrDictLookup(func(id uint32) (string, bool) {
+		if id == 0x400007 {
+			return "/system/lib64/libc.so", true
+		}
+		return "", false
+	})
+	defer SetStrDictLookup(nil)
+
+	tests := []struct {
+		name string
+		buf  *bytes.Buffer
+		want string
+		left int
+	}{
+		{"plain", strDictArg(6, "/data\x00", 0), "0x10(/data)", 0},
+		{"new", strDictArg(16|STR_DICT_NEW, "/proc/self/maps\x00", 3), "0x10(/proc/self/maps)", 0},
+		{"ref", strDictArg(-3, "", 0), "0x10(/proc/self/maps)", 0},
+		{"ref before define", strDictArg(-0x400007, "", 0), "0x10(/system/lib64/libc.so)", 0},
+		{"ref lost", strDictArg(-9, "", 0), "0x10(<str#9>)", 0},
+		{"next arg untouched", func() *bytes.Buffer {
+			buf := strDictArg(2|STR_DICT_NEW, "a\x00", 5)
+			buf.Write([]byte{1, 2, 3})
+			return buf
+		}(), "0x10(a)", 3},
+	}
+	for _, tt := range tests {
+		got := parse_STRING(nil, 0x10, tt.buf, true)
+		if got != tt.want {
+			t.Errorf("%s: parse_STRING = %q, want %q", tt.name, got, tt.want)
+		}
+		if tt.buf.Len() != tt.left {
+			t.Errorf("%s: %d bytes left, want %d", tt.name, tt.buf.Len(), tt.left)
+		}
+	}
+	if got := strDictGet(5); got != "a" {
+		t.Errorf("strDictGet(5) = %q, want %q", got, "a")
+	}
+}
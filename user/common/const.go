@@ -103,5 +103,6 @@ const (
 	INT_SOCKET_FLAGS
 	INT_FILE_FLAGS
 	INT16_PERM_FLAGS
+	FDPATH
 	CONST_ARGTYPE_END
 )
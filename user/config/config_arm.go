@@ -0,0 +1,83 @@
+package config
+
+import (
+	"errors"
+	"fmt"
+	"stackplz/user/util"
+	"strconv"
+	"strings"
+)
+
+const (
+	ARM_BY_UPROBE uint32 = 1 << iota
+	ARM_BY_SYSCALL
+)
+
+// arm 点 命中时线程进入追踪状态 函数返回时退出
+type ArmPoint struct {
+	LibPath string
+	Symbol  string
+	Offset  uint64
+}
+
+func (this *ArmPoint) String() string {
+	if this.Symbol == "" {
+		return fmt.Sprintf("%s+0x%x", this.LibPath, this.Offset)
+	}
+	return fmt.Sprintf("%s!%s", this.LibPath, this.Symbol)
+}
+
+// decrypt 使用 -l/--lib 指定的库
+// libfoo.so:decrypt libfoo.so:0x1234 指定其他库
+func (this *ModuleConfig) Parse_ArmPoints(configs []string, default_lib string, lib_dirs []string) error {
+	for _, config_str := range configs {
+		lib_name := default_lib
+		sym_or_off := config_str
+		items := strings.SplitN(config_str, ":", 2)
+		if len(items) == 2 {
+			lib_name = items[0]
+			sym_or_off = items[1]
+		}
+		lib_path, err := util.FindLib(lib_name, lib_dirs)
+		if err != nil {
+			return err
+		}
+		if lib_path == "" {
+			return errors.New(fmt.Sprintf("library is empty for arm point %s", config_str))
+		}
+		point := &ArmPoint{}
+		point.LibPath = lib_path
+		if strings.HasPrefix(sym_or_off, "0x") {
+			offset, err := strconv.ParseUint(strings.TrimPrefix(sym_or_off, "0x"), 16, 64)
+			if err != nil {
+				return errors.New(fmt.Sprintf("parse arm point %s failed, err:%v", config_str, err))
+			}
+			point.Offset = offset
+		} else {
+			point.Symbol = sym_or_off
+		}
+		this.ArmPoints = append(this.ArmPoints, point)
+	}
+	return nil
+}
+
+func (this *ModuleConfig) Parse_ArmSyscalls(text string) {
+	if text == "" {
+		return
+	}
+	for _, v := range strings.Split(text, ",") {
+		point := GetSyscallPointByName(v)
+		this.ArmSyscalls = append(this.ArmSyscalls, point.Nr)
+	}
+}
+
+func (this *ModuleConfig) GetArmFlags() uint32 {
+	var flags uint32 = 0
+	if len(this.ArmPoints) > 0 {
+		flags |= ARM_BY_UPROBE
+	}
+	if len(this.ArmSyscalls) > 0 {
+		flags |= ARM_BY_SYSCALL
+	}
+	return flags
+}
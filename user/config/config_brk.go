@@ -0,0 +1,229 @@
+package config
+
+import (
+	"encoding/hex"
+	"errors"
+	"fmt"
+	"stackplz/user/util"
+	"strconv"
+	"strings"
+)
+
+// 同时设置多个硬件断点时的默认输出次数 超出后只计数
+const DEFAULT_BRK_LIMIT uint32 = 8
+
+type BrkPoint struct {
+	Addr uint64
+	Len  uint64
+	Type uint32
+	Cond *BrkCond
+}
+
+func (this *BrkPoint) IsKernel() bool {
+	return this.Addr&0xffffff0000000000 > 0
+}
+
+func (this *BrkPoint) String() string {
+	return fmt.Sprintf("0x%x:%s len:%d", this.Addr, util.BrkTypeName(this.Type), this.Len)
+}
+
+// 0x1234 或者 0x1234:w 形式 默认为 x
+func ParseBrkPoint(text string, base uint64, brk_len uint64) (*BrkPoint, error) {
+	if !strings.HasPrefix(text, "0x") {
+		return nil, errors.New(fmt.Sprintf("parse for %s failed, address must start with 0x", text))
+	}
+	point := &BrkPoint{}
+	point.Len = brk_len
+	infos := strings.Split(text, ":")
+	if len(infos) > 2 {
+		return nil, errors.New(fmt.Sprintf("parse for %s failed, format invaild", text))
+	}
+	if len(infos) == 2 {
+		if infos[1] == "r" {
+			point.Type = util.HW_BREAKPOINT_R
+		} else if infos[1] == "w" {
+			point.Type = util.HW_BREAKPOINT_W
+		} else if infos[1] == "x" {
+			point.Type = util.HW_BREAKPOINT_X
+		} else if infos[1] == "rw" {
+			point.Type = util.HW_BREAKPOINT_RW
+		} else {
+			return nil, errors.New(fmt.Sprintf("parse BrkType for %s failed, choose:r,w,x,rw", infos[1]))
+		}
+	} else {
+		point.Type = util.HW_BREAKPOINT_X
+	}
+	addr, err := strconv.ParseUint(strings.TrimPrefix(infos[0], "0x"), 16, 64)
+	if err != nil {
+		return nil, errors.New(fmt.Sprintf("parse for %s failed, err:%v", text, err))
+	}
+	point.Addr = base + addr
+	return point, nil
+}
+
+type BrkConfigMap struct {
+	sample_limit  uint32
+	padding       uint32
+	extra_samples int64
+}
+
+func (this *ModuleConfig) GetBrkConfigMap(extra_samples int64) BrkConfigMap {
+	config := BrkConfigMap{}
+	config.sample_limit = this.BrkLimit
+	config.extra_samples = extra_samples
+	return config
+}
+
+const (
+	BRK_COND_REG uint32 = 1 << iota
+	BRK_COND_MEM
+	BRK_COND_LR
+)
+
+const BRK_COND_MEM_MAX = 16
+
+const (
+	BRK_REG_LR uint32 = 30
+	BRK_REG_SP uint32 = 31
+	BRK_REG_PC uint32 = 32
+)
+
+// 与 perf_mmap.c 中的 brk_cond_t 一致
+type BrkCond struct {
+	Flags       uint32
+	RegIndex    uint32
+	RegValue    uint64
+	MemRegIndex uint32
+	MemOffset   int32
+	MemLen      uint32
+	Padding     uint32
+	MemPattern  [BRK_COND_MEM_MAX]byte
+	LrStart     uint64
+	LrEnd       uint64
+}
+
+func ParseBrkReg(name string) (uint32, error) {
+	switch name {
+	case "lr":
+		return BRK_REG_LR, nil
+	case "sp":
+		return BRK_REG_SP, nil
+	case "pc":
+		return BRK_REG_PC, nil
+	}
+	if strings.HasPrefix(name, "x") {
+		index, err := strconv.ParseUint(name[1:], 10, 32)
+		if err == nil && index <= 30 {
+			return uint32(index), nil
+		}
+	}
+	return 0, errors.New(fmt.Sprintf("register %s is not supported, choose:x0-x30,lr,sp,pc", name))
+}
+
+func parseBrkValue(text string) (uint64, error) {
+	if strings.HasPrefix(text, "0x") {
+		return strconv.ParseUint(text[2:], 16, 64)
+	}
+	value, err := strconv.ParseInt(text, 10, 64)
+	return uint64(value), err
+}
+
+// [x1+0x8] [x1-8] [x1]
+func (this *BrkCond) parseMemCond(left, right string) error {
+	expr := strings.TrimSuffix(strings.TrimPrefix(left, "["), "]")
+	reg_name := expr
+	var offset int64 = 0
+	if i := strings.IndexAny(expr, "+-"); i > 0 {
+		reg_name = expr[:i]
+		value, err := parseBrkValue(strings.TrimPrefix(expr[i+1:], "+"))
+		if err != nil {
+			return errors.New(fmt.Sprintf("parse offset for %s failed, err:%v", left, err))
+		}
+		offset = int64(value)
+		if expr[i] == '-' {
+			offset = -offset
+		}
+	}
+	reg_index, err := ParseBrkReg(reg_name)
+	if err != nil {
+		return err
+	}
+	var pattern []byte
+	if strings.HasPrefix(right, "hex:") {
+		pattern, err = hex.DecodeString(right[4:])
+		if err != nil {
+			return errors.New(fmt.Sprintf("parse pattern %s failed, err:%v", right, err))
+		}
+	} else if strings.HasPrefix(right, "str:") {
+		pattern = []byte(right[4:])
+	} else {
+		return errors.New(fmt.Sprintf("parse pattern %s failed, must start with hex: or str:", right))
+	}
+	if len(pattern) == 0 || len(pattern) > BRK_COND_MEM_MAX {
+		return errors.New(fmt.Sprintf("pattern %s length must in [1, %d]", right, BRK_COND_MEM_MAX))
+	}
+	this.Flags |= BRK_COND_MEM
+	this.MemRegIndex = reg_index
+	this.MemOffset = int32(offset)
+	this.MemLen = uint32(len(pattern))
+	copy(this.MemPattern[:], pattern)
+	return nil
+}
+
+// 支持下列条件 多个条件需同时满足
+// x0=0x10              寄存器的值
+// [x1+0x8]=hex:41424344 内存内容 最多16字节
+// [x1]=str:abc
+// lr@libfoo.so         返回地址位于库中
+// lr@0x1000-0x2000     返回地址位于地址范围中
+func (this *BrkCond) Parse(text string, find_lib func(string) (uint64, uint64, error)) error {
+	if strings.HasPrefix(text, "lr@") {
+		if this.Flags&BRK_COND_LR != 0 {
+			return errors.New(fmt.Sprintf("duplicate lr condition %s", text))
+		}
+		target := text[3:]
+		items := strings.Split(target, "-")
+		var err error
+		if len(items) == 2 && strings.HasPrefix(items[0], "0x") {
+			this.LrStart, err = parseBrkValue(items[0])
+			if err == nil {
+				this.LrEnd, err = parseBrkValue(items[1])
+			}
+		} else {
+			this.LrStart, this.LrEnd, err = find_lib(target)
+		}
+		if err != nil {
+			return errors.New(fmt.Sprintf("parse condition %s failed, err:%v", text, err))
+		}
+		if this.LrStart >= this.LrEnd {
+			return errors.New(fmt.Sprintf("parse condition %s failed, range is empty", text))
+		}
+		this.Flags |= BRK_COND_LR
+		return nil
+	}
+	items := strings.SplitN(text, "=", 2)
+	if len(items) != 2 {
+		return errors.New(fmt.Sprintf("parse condition %s failed, format invaild", text))
+	}
+	if strings.HasPrefix(items[0], "[") {
+		if this.Flags&BRK_COND_MEM != 0 {
+			return errors.New(fmt.Sprintf("duplicate memory condition %s", text))
+		}
+		return this.parseMemCond(items[0], items[1])
+	}
+	if this.Flags&BRK_COND_REG != 0 {
+		return errors.New(fmt.Sprintf("duplicate register condition %s", text))
+	}
+	reg_index, err := ParseBrkReg(items[0])
+	if err != nil {
+		return err
+	}
+	value, err := parseBrkValue(items[1])
+	if err != nil {
+		return errors.New(fmt.Sprintf("parse condition %s failed, err:%v", text, err))
+	}
+	this.Flags |= BRK_COND_REG
+	this.RegIndex = reg_index
+	this.RegValue = value
+	return nil
+}
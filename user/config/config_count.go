@@ -0,0 +1,133 @@
+package config
+
+import (
+	"debug/elf"
+	"errors"
+	"fmt"
+	"path/filepath"
+	"stackplz/user/util"
+	"strings"
+)
+
+// 一次最多挂载的符号数量 超过时报错 需要缩小匹配范围
+const MAX_COUNT_POINTS = 8192
+
+// 计数模式的 hook 点 每个符号一个 uprobe 只在内核中计数
+type CountPoint struct {
+	LibPath string
+	Symbol  string
+	// 符号地址 与 -w 中的偏移含义一致
+	Offset uint64
+	// 符号在文件中的偏移 用于从 pc 反查符号
+	FileOff uint64
+}
+
+func (this *CountPoint) String() string {
+	return fmt.Sprintf("%s!%s", this.LibPath, this.Symbol)
+}
+
+func elfFileOffset(f *elf.File, vaddr uint64) (uint64, bool) {
+	for _, prog := range f.Progs {
+		if prog.Type != elf.PT_LOAD {
+			continue
+		}
+		if vaddr >= prog.Vaddr && vaddr < prog.Vaddr+prog.Memsz {
+			return vaddr - prog.Vaddr + prog.Off, true
+		}
+	}
+	return 0, false
+}
+
+// 取出库中所有已定义的函数符号 同一地址的别名只保留一个 避免重复计数
+func elfFuncSymbols(f *elf.File) []elf.Symbol {
+	var syms []elf.Symbol
+	dyn_syms, err := f.DynamicSymbols()
+	if err == nil {
+		syms = append(syms, dyn_syms...)
+	}
+	// 没有 strip 的库还可以匹配到内部函数
+	static_syms, err := f.Symbols()
+	if err == nil {
+		syms = append(syms, static_syms...)
+	}
+	var funcs []elf.Symbol
+	seen := make(map[uint64]bool)
+	for _, sym := range syms {
+		if elf.ST_TYPE(sym.Info) != elf.STT_FUNC || sym.Section == elf.SHN_UNDEF || sym.Value == 0 {
+			continue
+		}
+		if seen[sym.Value] {
+			continue
+		}
+		seen[sym.Value] = true
+		funcs = append(funcs, sym)
+	}
+	return funcs
+}
+
+// Java_* 匹配 -l/--lib 指定库中的符号
+// libfoo.so:Java_* 指定其他库 libfoo.so 表示该库的全部函数
+func parseCountPattern(config_str, default_lib string) (string, string, error) {
+	lib_name := default_lib
+	pattern := config_str
+	items := strings.SplitN(config_str, ":", 2)
+	if len(items) == 2 {
+		lib_name = items[0]
+		pattern = items[1]
+	} else if strings.HasSuffix(config_str, ".so") {
+		lib_name = config_str
+		pattern = "*"
+	}
+	if pattern == "" {
+		return "", "", errors.New(fmt.Sprintf("bad count point %s, e.g. libfoo.so:Java_*", config_str))
+	}
+	if _, err := filepath.Match(pattern, ""); err != nil {
+		return "", "", errors.New(fmt.Sprintf("bad count pattern %s, err:%v", config_str, err))
+	}
+	return lib_name, pattern, nil
+}
+
+func (this *ModuleConfig) Parse_CountPoints(configs []string, default_lib string, lib_dirs []string) error {
+	for _, config_str := range configs {
+		lib_name, pattern, err := parseCountPattern(config_str, default_lib)
+		if err != nil {
+			return err
+		}
+		lib_path, err := util.FindLib(lib_name, lib_dirs)
+		if err != nil {
+			return err
+		}
+		if lib_path == "" {
+			return errors.New(fmt.Sprintf("library is empty for count point %s", config_str))
+		}
+		f, err := elf.Open(lib_path)
+		if err != nil {
+			return errors.New(fmt.Sprintf("open %s failed, err:%v", lib_path, err))
+		}
+		matched := 0
+		for _, sym := range elfFuncSymbols(f) {
+			if ok, _ := filepath.Match(pattern, sym.Name); !ok {
+				continue
+			}
+			file_off, ok := elfFileOffset(f, sym.Value)
+			if !ok {
+				continue
+			}
+			point := &CountPoint{}
+			point.LibPath = lib_path
+			point.Symbol = sym.Name
+			point.Offset = sym.Value
+			point.FileOff = file_off
+			this.CountPoints = append(this.CountPoints, point)
+			matched++
+		}
+		f.Close()
+		if matched == 0 {
+			return errors.New(fmt.Sprintf("no function matched by count point %s in %s", pattern, lib_path))
+		}
+		if len(this.CountPoints) > MAX_COUNT_POINTS {
+			return errors.New(fmt.Sprintf("too many count points %d, max %d", len(this.CountPoints), MAX_COUNT_POINTS))
+		}
+	}
+	return nil
+}
@@ -0,0 +1,34 @@
+package config
+
+import "testing"
+
+func TestParseCountPattern(t *testing.T) {
+	tests := []struct {
+		config  string
+		lib     string
+		pattern string
+		err     bool
+	}{
+		{"Java_*", "libdefault.so", "Java_*", false},
+		{"libfoo.so:Java_*", "libfoo.so", "Java_*", false},
+		{"libfoo.so", "libfoo.so", "*", false},
+		{"/data/app/lib/arm64/libfoo.so", "/data/app/lib/arm64/libfoo.so", "*", false},
+		{"libfoo.so:open*", "libfoo.so", "open*", false},
+		{"libfoo.so:[a-", "", "", true},
+		{"libfoo.so:", "", "", true},
+		{"SSL_read", "libdefault.so", "SSL_read", false},
+	}
+	for _, tt := range tests {
+		lib, pattern, err := parseCountPattern(tt.config, "libdefault.so")
+		if (err != nil) != tt.err {
+			t.Errorf("parseCountPattern(%q) err:%v, want err:%v", tt.config, err, tt.err)
+			continue
+		}
+		if tt.err {
+			continue
+		}
+		if lib != tt.lib || pattern != tt.pattern {
+			t.Errorf("parseCountPattern(%q) = (%q, %q), want (%q, %q)", tt.config, lib, pattern, tt.lib, tt.pattern)
+		}
+	}
+}
@@ -8,6 +8,9 @@ import (
 type ConfigMap struct {
 	stackplz_pid     uint32
 	thread_whitelist uint32
+	arm_flags        uint32
+	padding          uint32
+	arm_timeout      uint64
 }
 
 type CommonFilter struct {
@@ -15,8 +18,25 @@ type CommonFilter struct {
 	trace_mode      uint32
 	trace_uid_group uint32
 	signal          uint32
+	ctrl_flags      uint32
+	stack_every     uint32
+	stack_small     uint32
 }
 
+const (
+	CTRL_DEDUP uint32 = 1 << iota
+	CTRL_IOTOP
+	CTRL_FLOW
+	CTRL_COUNT_CALLER
+	CTRL_STACK_DEDUP
+	CTRL_STACK_ADAPTIVE
+	CTRL_BPF_UNWIND
+	CTRL_SESSION
+	CTRL_SAMPLE
+	CTRL_STACK_SWITCH
+	CTRL_STR_DICT
+)
+
 type ThreadFilter struct {
 	ThreadName [16]byte
 }
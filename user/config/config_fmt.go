@@ -2,16 +2,18 @@ package config
 
 // BPF_ 与c的结构体一一对应
 type BPF_event_context struct {
-	Ts      uint64
-	EventId uint32
-	HostTid uint32
-	HostPid uint32
-	Tid     uint32
-	Pid     uint32
-	Uid     uint32
-	Comm    [16]byte
-	Argnum  uint8
-	Padding [7]byte
+	Ts       uint64
+	EventId  uint32
+	HostTid  uint32
+	HostPid  uint32
+	Tid      uint32
+	Pid      uint32
+	Uid      uint32
+	Comm     [16]byte
+	Argnum   uint8
+	Session  uint8
+	Padding  [2]byte
+	Callsite uint32
 }
 
 type FMT_event_context struct {
@@ -53,6 +55,19 @@ type SyscallExitFmt struct {
 	Arg_str string `json:"arg_str"`
 }
 
+type IoUringFmt struct {
+	FMT_event_context
+	Op        string `json:"op"`
+	Fd        int32  `json:"fd"`
+	Fixed     bool   `json:"fixed"`
+	Len       uint32 `json:"len"`
+	Off       string `json:"off"`
+	Addr      string `json:"addr"`
+	UserData  string `json:"user_data"`
+	Res       int32  `json:"res"`
+	LatencyNs uint64 `json:"latency_ns"`
+}
+
 type BPF_record_mmap2 struct {
 	Pid            uint32
 	Tid            uint32
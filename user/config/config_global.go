@@ -17,11 +17,18 @@ type GlobalConfig struct {
     UnwindStack  bool
     ManualStack  bool
     StackSize    uint32
+    StackDedup   uint32
+    StackAdapt   bool
+    BpfUnwind    bool
+    BpfStats     uint32
+    MaxOverhead  string
     ShowRegs     bool
     GetOff       bool
     UprobeSignal string
     Rpc          bool
     RpcPath      string
+    Daemon       bool
+    DaemonPath   string
     Debug        bool
     Quiet        bool
     Buffer       uint32
@@ -30,6 +37,8 @@ type GlobalConfig struct {
     BrkAddr      string
     BrkLib       string
     BrkLen       uint64
+    BrkLimit     uint32
+    BrkCond      []string
     LogFile      string
     DataDir      string
     LibraryDirs  []string
@@ -40,11 +49,34 @@ type GlobalConfig struct {
     DumpHex      bool
     ShowTime     bool
     ShowUid      bool
+    Dedup        bool
+    IoTop        uint32
+    Flow         uint32
+    Profile      uint32
+    ProfileOut   string
+    Heap         uint32
+    Lock         uint32
+    Offcpu       uint32
+    IoUring      bool
+    CountPoint   []string
+    Count        uint32
+    CountCaller  bool
+    FoldOut      string
+    FoldInterval uint32
+    FdPath       bool
+    StrDict      bool
+    Snapshot     string
+    SnapshotDir  string
+    SnapshotMax  uint32
     NoCheck      bool
     Btf          bool
     ExternalBTF  string
     SysCall      string
     NoSysCall    string
+    SysKprobeMax uint32
+    ArmPoint     []string
+    ArmSyscall   string
+    ArmTimeout   uint32
 }
 
 func NewGlobalConfig() *GlobalConfig {
@@ -6,6 +6,7 @@ import (
     "log"
     "os"
     "regexp"
+    "sort"
     "stackplz/user/argtype"
     . "stackplz/user/common"
     "stackplz/user/util"
@@ -104,6 +105,10 @@ func (this *StackUprobeConfig) ParseArgType(arg_str string, point_arg *PointArg)
             }
         }
         point_arg.SetGroupType(EBPF_UPROBE_ENTER)
+    case "fd":
+        // 读取时解析出 fd 对应的文件路径
+        point_arg.SetTypeIndex(FDPATH)
+        point_arg.SetGroupType(EBPF_UPROBE_ENTER)
     case "ptr":
         point_arg.SetTypeIndex(POINTER)
     case "ptr_arr":
@@ -318,6 +323,9 @@ type SyscallConfig struct {
     PointArgs    []*SyscallPoint
     SysWhitelist []uint32
     SysBlacklist []uint32
+    KprobeMax    uint32
+    // 在 kallsyms 中找不到入口函数的 syscall
+    KprobeMissing []string
 }
 
 func (this *SyscallConfig) SetDebug(debug bool) {
@@ -339,6 +347,7 @@ func (this *SyscallConfig) Parse_SysWhitelist(gconfig *GlobalConfig) {
     }
     this.Enable = true
     this.TraceMode = TRACE_COMMON
+    this.KprobeMax = gconfig.SysKprobeMax
     items := strings.Split(gconfig.SysCall, ",")
     var syscall_items []string
     for _, v := range items {
@@ -470,6 +479,141 @@ func (this *SyscallConfig) Parse_SysBlacklist(text string) {
     }
 }
 
+// 白名单数量不超过 KprobeMax 时 直接在各个 syscall 的内核函数上挂 kprobe
+// 这样其他 syscall 不会触发 eBPF 程序 追踪全部时仍然使用 raw_tracepoint
+// 任意一个 syscall 没有入口函数时 比如被内联 未实现或者名字不一致 也回退到 raw_tracepoint
+// 否则这个 syscall 会被静默漏掉
+func (this *SyscallConfig) UseKprobe() (bool, error) {
+    if this.TraceMode != TRACE_COMMON {
+        return false, nil
+    }
+    count := uint32(len(this.SysWhitelist))
+    if count == 0 || count > this.KprobeMax {
+        return false, nil
+    }
+    missing, err := util.FindMissingKallsyms(this.KprobeSymbols())
+    if err != nil {
+        return false, err
+    }
+    this.KprobeMissing = missing
+    return len(missing) == 0, nil
+}
+
+// 连续对同一个 fd 读写时合并为一条记录 只比较 fd 不比较 buf 和长度
+var coalesce_syscalls = []string{"read", "write", "pread64", "pwrite64", "readv", "writev", "recvfrom", "sendto"}
+
+func (this *SyscallConfig) CoalesceSyscalls() []uint32 {
+    var items []uint32
+    for _, name := range coalesce_syscalls {
+        point := GetSyscallPointByName(name)
+        items = append(items, point.Nr)
+    }
+    return items
+}
+
+// 与 io_kind_e 一致
+const (
+    IO_READ uint32 = iota + 1
+    IO_WRITE
+)
+
+// 与 flow_kind_e 一致
+const (
+    FLOW_CONNECT uint32 = iota + 1
+    FLOW_ACCEPT
+    FLOW_CLOSE
+    FLOW_SENDTO
+    FLOW_SEND
+    FLOW_RECV
+    FLOW_WRITE
+    FLOW_READ
+)
+
+// 第一个参数是 fd 的 syscall 以及它们在 iotop 和 flow 中的处理方式 0 表示不参与
+// -s 中指定的其他 syscall 比如 openat 第一个参数不是 fd 会被忽略
+type fdSyscall struct {
+    io   uint32
+    flow uint32
+}
+
+var fd_syscalls = map[string]fdSyscall{
+    "read":     {IO_READ, FLOW_READ},
+    "readv":    {IO_READ, FLOW_READ},
+    "pread64":  {IO_READ, 0},
+    "preadv":   {IO_READ, 0},
+    "preadv2":  {IO_READ, 0},
+    "recvfrom": {IO_READ, FLOW_RECV},
+    "recvmsg":  {IO_READ, FLOW_RECV},
+    "recvmmsg": {IO_READ, 0},
+    "write":    {IO_WRITE, FLOW_WRITE},
+    "writev":   {IO_WRITE, FLOW_WRITE},
+    "pwrite64": {IO_WRITE, 0},
+    "pwritev":  {IO_WRITE, 0},
+    "pwritev2": {IO_WRITE, 0},
+    "sendto":   {IO_WRITE, FLOW_SENDTO},
+    "sendmsg":  {IO_WRITE, FLOW_SEND},
+    "sendmmsg": {IO_WRITE, 0},
+    "connect":  {0, FLOW_CONNECT},
+    "accept":   {0, FLOW_ACCEPT},
+    "accept4":  {0, FLOW_ACCEPT},
+    "close":    {0, FLOW_CLOSE},
+}
+
+func fdSyscallNames(pick func(fdSyscall) uint32) string {
+    var names []string
+    for name, item := range fd_syscalls {
+        if pick(item) != 0 {
+            names = append(names, name)
+        }
+    }
+    sort.Strings(names)
+    return strings.Join(names, ",")
+}
+
+func fdSyscallKinds(pick func(fdSyscall) uint32) map[uint32]uint32 {
+    items := make(map[uint32]uint32)
+    for name, item := range fd_syscalls {
+        if kind := pick(item); kind != 0 {
+            point := GetSyscallPointByName(name)
+            items[point.Nr] = kind
+        }
+    }
+    return items
+}
+
+func pickIo(item fdSyscall) uint32 {
+    return item.io
+}
+
+func pickFlow(item fdSyscall) uint32 {
+    return item.flow
+}
+
+// iotop 和 flow 模式下 没有指定 -s 时默认追踪的 syscall
+func IoTopSyscalls() string {
+    return fdSyscallNames(pickIo)
+}
+
+func FlowSyscallNames() string {
+    return fdSyscallNames(pickFlow)
+}
+
+func (this *SyscallConfig) IoSyscalls() map[uint32]uint32 {
+    return fdSyscallKinds(pickIo)
+}
+
+func (this *SyscallConfig) FlowSyscalls() map[uint32]uint32 {
+    return fdSyscallKinds(pickFlow)
+}
+
+func (this *SyscallConfig) KprobeSymbols() []string {
+    var symbols []string
+    for _, point := range this.PointArgs {
+        symbols = append(symbols, point.KernelSymbol())
+    }
+    return symbols
+}
+
 func (this *SyscallConfig) IsEnable() bool {
     return this.Enable
 }
@@ -510,6 +654,14 @@ type ModuleConfig struct {
     UnwindStack  bool
     ManualStack  bool
     StackSize    uint32
+    StackDedup   uint32
+    StackAdapt   bool
+    BpfUnwind    bool
+    BpfStats     uint32
+    MaxOverhead  float64
+    StrDict      bool
+    FdPath       bool
+    Daemon       bool
     ShowRegs     bool
     GetOff       bool
     RegName      string
@@ -522,11 +674,29 @@ type ModuleConfig struct {
     BrkLen       uint64
     BrkType      uint32
     BrkKernel    bool
+    BrkPoints    []*BrkPoint
+    BrkLimit     uint32
     Color        bool
     FmtJson      bool
     DumpHex      bool
     ShowTime     bool
     ShowUid      bool
+    Dedup        bool
+    IoTop        uint32
+    Flow         uint32
+    Profile      uint32
+    ProfileOut   string
+    Heap         uint32
+    Lock         uint32
+    Offcpu       uint32
+    Count        uint32
+    CountCaller  bool
+    CountPoints  []*CountPoint
+    LibcPath     string
+    FoldOut      string
+    ArmPoints    []*ArmPoint
+    ArmSyscalls  []uint32
+    ArmTimeout   uint64
 
     Name            string
     StackUprobeConf *StackUprobeConfig
@@ -671,15 +841,98 @@ func (this *ModuleConfig) GetCommonFilter() CommonFilter {
 
     filter.trace_uid_group = this.TraceGroup
     filter.signal = this.UprobeSignal
+    if this.Dedup {
+        filter.ctrl_flags |= CTRL_DEDUP
+    }
+    if this.IoTop > 0 {
+        filter.ctrl_flags |= CTRL_IOTOP
+    }
+    if this.Flow > 0 {
+        filter.ctrl_flags |= CTRL_FLOW
+    }
+    if this.CountCaller {
+        filter.ctrl_flags |= CTRL_COUNT_CALLER
+    }
+    if this.StackDedup > 0 {
+        filter.ctrl_flags |= CTRL_STACK_DEDUP
+        filter.stack_every = this.StackDedup
+    }
+    if this.StackAdapt {
+        filter.ctrl_flags |= CTRL_STACK_ADAPTIVE
+        filter.stack_small = this.StackSmallSize()
+    }
+    if this.BpfUnwind {
+        filter.ctrl_flags |= CTRL_BPF_UNWIND
+    }
+    if this.Daemon {
+        filter.ctrl_flags |= CTRL_SESSION
+    }
+    if this.MaxOverhead > 0 {
+        filter.ctrl_flags |= CTRL_SAMPLE
+    }
+    if this.StackSwitch() {
+        filter.ctrl_flags |= CTRL_STACK_SWITCH
+    }
+    if this.StrDict {
+        filter.ctrl_flags |= CTRL_STR_DICT
+    }
     return filter
 }
 
+// 自适应模式下小档位的栈大小 超过的走完整大小
+const STACK_SMALL_SIZE = 2048
+
+func (this *ModuleConfig) StackSmallSize() uint32 {
+    if this.StackSize/2 < STACK_SMALL_SIZE {
+        return (this.StackSize / 2) &^ 7
+    }
+    return STACK_SMALL_SIZE
+}
+
+// 除 events 以外需要读取的带栈数据的 map
+func (this *ModuleConfig) StackEventMaps() []string {
+    var names []string
+    if this.StackDedup > 0 || this.StackAdapt || this.StackSwitch() {
+        names = append(names, "stack_events")
+    }
+    if this.StackAdapt {
+        names = append(names, "stack_events_small")
+    }
+    return names
+}
+
+// 开销控制模式下 带栈的事件单独发送 超出预算时可以只发 events
+func (this *ModuleConfig) StackSwitch() bool {
+    return this.MaxOverhead > 0 && this.UnwindStack
+}
+
+// 返回 map 对应的 perf 事件是否带栈数据 以及栈数据的大小
+// 去重 自适应或者开销控制模式下 events 不再带栈数据
+func (this *ModuleConfig) GetStackSample(map_name string) (bool, uint32) {
+    if !this.UnwindStack {
+        return false, this.StackSize
+    }
+    switch map_name {
+    case "stack_events":
+        return true, this.StackSize
+    case "stack_events_small":
+        return true, this.StackSmallSize()
+    case "events":
+        return this.StackDedup == 0 && !this.StackAdapt && !this.StackSwitch(), this.StackSize
+    case "io_uring_events":
+        return false, this.StackSize
+    }
+    return true, this.StackSize
+}
+
 func (this *ModuleConfig) GetConfigMap() ConfigMap {
     config := ConfigMap{}
     config.stackplz_pid = this.SelfPid
     if len(this.TNameWhitelist) > 0 {
         config.thread_whitelist = 1
     }
+    config.arm_flags = this.GetArmFlags()
+    config.arm_timeout = this.ArmTimeout
     if this.Debug {
         this.logger.Printf("ConfigMap{stackplz_pid=%d}", config.stackplz_pid)
     }
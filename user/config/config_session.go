@@ -0,0 +1,114 @@
+package config
+
+import (
+	"encoding/json"
+	"errors"
+	"fmt"
+	"stackplz/user/util"
+	"strings"
+
+	"golang.org/x/exp/slices"
+)
+
+// 与 consts.h 中的定义一致
+const (
+	MAX_SESSIONS          = 8
+	SESSION_ANY           = 0xffffffff
+	SESSION_SYSCALL_WORDS = 8
+)
+
+// 与 session_filter_t 一致
+type SessionFilter struct {
+	Active   uint32
+	Uid      uint32
+	Pid      uint32
+	Padding  uint32
+	Syscalls [SESSION_SYSCALL_WORDS]uint64
+}
+
+// 客户端连接守护进程后发送的第一条消息 不指定的条件表示不限制
+// {"name":"com.starbucks.cn","syscall":"openat,read"}
+// {"uid":10123} {"pid":1234,"syscall":"connect"}
+type SessionRequest struct {
+	Name    string  `json:"name"`
+	Uid     *uint32 `json:"uid"`
+	Pid     *uint32 `json:"pid"`
+	Syscall string  `json:"syscall"`
+}
+
+func (this *SessionRequest) String() string {
+	var items []string
+	if this.Name != "" {
+		items = append(items, fmt.Sprintf("name:%s", this.Name))
+	}
+	if this.Uid != nil {
+		items = append(items, fmt.Sprintf("uid:%d", *this.Uid))
+	}
+	if this.Pid != nil {
+		items = append(items, fmt.Sprintf("pid:%d", *this.Pid))
+	}
+	if this.Syscall != "" {
+		items = append(items, fmt.Sprintf("syscall:%s", this.Syscall))
+	}
+	return strings.Join(items, " ")
+}
+
+func findSyscallNr(name string) (uint32, bool) {
+	for _, point := range GetAllPoints() {
+		if point.Name == name {
+			return point.Nr, true
+		}
+	}
+	return 0, false
+}
+
+// 会话只能在守护进程已经挂载的 syscall 中选择
+func (this *ModuleConfig) ParseSessionRequest(payload []byte) (*SessionFilter, *SessionRequest, error) {
+	req := &SessionRequest{}
+	if err := json.Unmarshal(payload, req); err != nil {
+		return nil, nil, err
+	}
+	filter := &SessionFilter{Active: 1, Uid: SESSION_ANY, Pid: SESSION_ANY}
+	if req.Name != "" {
+		is_find, info := util.Get_PackageInfos().FindPackageByName(req.Name)
+		if !is_find {
+			return nil, nil, errors.New(fmt.Sprintf("can not find pkg_name=%s", req.Name))
+		}
+		filter.Uid = info.Uid
+	}
+	if req.Uid != nil {
+		filter.Uid = *req.Uid
+	}
+	if req.Pid != nil {
+		filter.Pid = *req.Pid
+	}
+	trace_all := this.SysCallConf.TraceMode == TRACE_ALL
+	var nrs []uint32
+	if req.Syscall == "" || req.Syscall == "all" {
+		if trace_all {
+			for i := range filter.Syscalls {
+				filter.Syscalls[i] = ^uint64(0)
+			}
+			return filter, req, nil
+		}
+		nrs = this.SysCallConf.SysWhitelist
+	} else {
+		for _, name := range strings.Split(req.Syscall, ",") {
+			nr, ok := findSyscallNr(name)
+			if !ok {
+				return nil, nil, errors.New(fmt.Sprintf("unknown syscall %s", name))
+			}
+			if !trace_all && !slices.Contains(this.SysCallConf.SysWhitelist, nr) {
+				return nil, nil, errors.New(fmt.Sprintf("syscall %s is not traced by daemon", name))
+			}
+			nrs = append(nrs, nr)
+		}
+	}
+	for _, nr := range nrs {
+		if nr >= SESSION_SYSCALL_WORDS*64 {
+			continue
+		}
+		filter.Syscalls[nr/64] |= 1 << (nr % 64)
+	}
+	return filter, req, nil
+}
@@ -0,0 +1,45 @@
+package config
+
+import "testing"
+
+func TestParseSessionRequest(t *testing.T) {
+	// 守护进程挂载了 openat(56) 和 read(63)
+	whitelist := &ModuleConfig{SysCallConf: &SyscallConfig{SysWhitelist: []uint32{56, 63}}}
+	trace_all := &ModuleConfig{SysCallConf: &SyscallConfig{TraceMode: TRACE_ALL}}
+	var all [SESSION_SYSCALL_WORDS]uint64
+	for i := range all {
+		all[i] = ^uint64(0)
+	}
+	tests := []struct {
+		name     string
+		conf     *ModuleConfig
+		payload  string
+		uid      uint32
+		pid      uint32
+		syscalls [SESSION_SYSCALL_WORDS]uint64
+		err      bool
+	}{
+		{"empty", whitelist, `{}`, SESSION_ANY, SESSION_ANY, [SESSION_SYSCALL_WORDS]uint64{1<<56 | 1<<63}, false},
+		{"uid", whitelist, `{"uid":10123}`, 10123, SESSION_ANY, [SESSION_SYSCALL_WORDS]uint64{1<<56 | 1<<63}, false},
+		{"pid syscall", whitelist, `{"pid":1234,"syscall":"openat"}`, SESSION_ANY, 1234, [SESSION_SYSCALL_WORDS]uint64{1 << 56}, false},
+		{"uid 0", whitelist, `{"uid":0,"syscall":"all"}`, 0, SESSION_ANY, [SESSION_SYSCALL_WORDS]uint64{1<<56 | 1<<63}, false},
+		{"not traced", whitelist, `{"syscall":"connect"}`, 0, 0, [SESSION_SYSCALL_WORDS]uint64{}, true},
+		{"unknown syscall", whitelist, `{"syscall":"nosuch"}`, 0, 0, [SESSION_SYSCALL_WORDS]uint64{}, true},
+		{"bad json", whitelist, `{"uid":"x"}`, 0, 0, [SESSION_SYSCALL_WORDS]uint64{}, true},
+		{"trace all", trace_all, `{}`, SESSION_ANY, SESSION_ANY, all, false},
+		{"trace all syscall", trace_all, `{"syscall":"connect,read"}`, SESSION_ANY, SESSION_ANY, [SESSION_SYSCALL_WORDS]uint64{1 << 63, 0, 0, 1 << (203 - 192)}, false},
+	}
+	for _, tt := range tests {
+		filter, _, err := tt.conf.ParseSessionRequest([]byte(tt.payload))
+		if (err != nil) != tt.err {
+			t.Errorf("%s: err:%v, want err:%v", tt.name, err, tt.err)
+			continue
+		}
+		if tt.err {
+			continue
+		}
+		if filter.Active != 1 || filter.Uid != tt.uid || filter.Pid != tt.pid || filter.Syscalls != tt.syscalls {
+			t.Errorf("%s: filter = %+v, want uid:%d pid:%d syscalls:%x", tt.name, *filter, tt.uid, tt.pid, tt.syscalls)
+		}
+	}
+}
@@ -16,6 +16,23 @@ type SyscallPoint struct {
 	ExitPointArgs  []*PointArg
 }
 
+// 少数 syscall 在内核中的实现函数名与调用名不一致
+var syscallKernelAlias = map[string]string{
+	"fstat":     "newfstat",
+	"uname":     "newuname",
+	"umount2":   "umount",
+	"fadvise64": "fadvise64_64",
+}
+
+// 返回 syscall 在内核中对应的入口符号 用于挂 kprobe
+func (this *SyscallPoint) KernelSymbol() string {
+	name := this.Name
+	if alias, ok := syscallKernelAlias[name]; ok {
+		name = alias
+	}
+	return "__arm64_sys_" + name
+}
+
 func (this *SyscallPoint) DumpOpList(tag string, op_list []uint32) {
 	fmt.Printf("[DumpOpList] %s Name:%s Count:%d\n", tag, this.Name, len(op_list))
 	for index, op_index := range op_list {
@@ -138,6 +155,27 @@ func GetALLOpList() map[uint32]argtype.BaseOpConfig {
 
 var aarch64_syscall_points = SyscallPoints{}
 
+var fd_arg_names = []string{"fd", "dirfd", "olddirfd", "newdirfd", "epfd", "oldfd", "sockfd", "fd_in", "fd_out", "in_fd", "out_fd"}
+
+func EnableFdPath() {
+	// 把 fd 类参数换成 fdpath 在内核中解析出对应的文件路径
+	for _, point := range aarch64_syscall_points.GetAllPoints() {
+		for _, point_args := range [][]*PointArg{point.EnterPointArgs, point.ExitPointArgs} {
+			for _, point_arg := range point_args {
+				if point_arg.TypeIndex != INT || point_arg.RegIndex == REG_ARM64_MAX {
+					continue
+				}
+				for _, name := range fd_arg_names {
+					if point_arg.Name == name {
+						point_arg.SetTypeIndex(FDPATH)
+						break
+					}
+				}
+			}
+		}
+	}
+}
+
 func R(nr uint32, name string, point_args ...*PointArg) {
 	if aarch64_syscall_points.Dup(nr, name) {
 		panic(fmt.Sprintf("register duplicate for nr:%d name:%s", nr, name))
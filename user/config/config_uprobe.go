@@ -25,6 +25,15 @@ func (this *UprobeArgs) GetConfig() UprobePointOpKeyConfig {
 	return config
 }
 
+// 合并追踪时 uprobe 与 syscall 共用同一份 point_args_t 定义 大小与 syscall 一致
+func (this *UprobeArgs) GetUnifiedConfig() SyscallPointOpKeyConfig {
+	config := SyscallPointOpKeyConfig{}
+	for _, point_arg := range this.PointArgs {
+		config.AddPointArg(point_arg)
+	}
+	return config
+}
+
 func (this *UprobeArgs) DumpOpList(tag string, op_list []uint32) {
 	fmt.Printf("[DumpOpList] %s Name:%s Count:%d\n", tag, this.Name, len(op_list))
 	for index, op_index := range op_list {
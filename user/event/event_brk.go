@@ -119,3 +119,67 @@ func (this *BrkEvent) ParseContextStack() {
     }
     return
 }
+
+// 多个断点时由 eBPF 程序输出的事件 命中次数在内核中统计
+type BrkHitEvent struct {
+    BrkEvent
+    Pc   uint64
+    Lr   uint64
+    Sp   uint64
+    Hits uint64
+}
+
+func (this *BrkHitEvent) String() (s string) {
+    s = fmt.Sprintf("[%s] event_addr:0x%x pc:0x%x lr:0x%x sp:0x%x hit_count:%d", this.GetUUID(), this.EventAddr, this.Pc, this.Lr, this.Sp, this.Hits)
+    s = this.GetStackTrace(s)
+    return s
+}
+
+func (this *BrkHitEvent) Check() bool {
+    // 排除自己
+    return this.Pid != this.mconf.SelfPid
+}
+
+func (this *BrkHitEvent) ParseEvent() (IEventStruct, error) {
+    if err := this.ParseContext(); err != nil {
+        panic(fmt.Sprintf("BrkHitEvent.ParseContext() err:%v", err))
+    }
+    return this, nil
+}
+
+func (this *BrkHitEvent) ParseContext() (err error) {
+    this.EventId = HW_BREAKPOINT
+    this.buf = bytes.NewBuffer(this.rec.RawSample)
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.rec.SampleSize); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Pid); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Tid); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.EventAddr); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Pc); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Lr); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Sp); err != nil {
+        return err
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Hits); err != nil {
+        return err
+    }
+    this.ParsePadding()
+    this.ParseContextStack()
+    return nil
+}
+
+func (this *BrkHitEvent) Clone() IEventStruct {
+    event := new(BrkHitEvent)
+    return event
+}
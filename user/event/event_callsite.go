@@ -0,0 +1,194 @@
+package event
+
+import (
+    "container/list"
+    "fmt"
+    "sync"
+    "time"
+)
+
+// 调用点去重模式下 带栈的事件和不带栈的事件来自两个 perf 缓冲区 相互之间没有顺序保证
+// 栈还没到的事件先暂存 带栈的事件到达后一起放出 栈丢失时超时放出
+
+const (
+    // 与 module 中的 CALLSITE_MAP_SIZE 一致 内核中淘汰的调用点之后会分配新的 id
+    CALLSITE_CACHE_SIZE = 10240
+    // 暂存事件的总数上限 超过后直接放出
+    CALLSITE_PENDING_MAX = 4096
+    // 等待带栈事件的时间
+    CALLSITE_PENDING_WAIT = 500 * time.Millisecond
+)
+
+type callsiteEntry struct {
+    id        uint32
+    stackinfo string
+}
+
+type callsiteWaiting struct {
+    since  time.Time
+    events []IEventStruct
+}
+
+type callsiteCache struct {
+    sync.Mutex
+    lru     *list.List
+    stacks  map[uint32]*list.Element
+    waiting map[uint32]*callsiteWaiting
+    pending int
+}
+
+var callsite_cache = &callsiteCache{
+    lru:     list.New(),
+    stacks:  make(map[uint32]*list.Element),
+    waiting: make(map[uint32]*callsiteWaiting),
+}
+
+// 栈丢失时通知模块 由模块让内核之后重新取栈
+var callsite_lost_report func(ids []uint32)
+
+func SetCallsiteLostReporter(report func(ids []uint32)) {
+    callsite_cache.Lock()
+    defer callsite_cache.Unlock()
+    callsite_lost_report = report
+}
+
+func (this *callsiteCache) put(id uint32, stackinfo string) {
+    if elem, ok := this.stacks[id]; ok {
+        elem.Value.(*callsiteEntry).stackinfo = stackinfo
+        this.lru.MoveToFront(elem)
+        return
+    }
+    this.stacks[id] = this.lru.PushFront(&callsiteEntry{id, stackinfo})
+    if this.lru.Len() > CALLSITE_CACHE_SIZE {
+        oldest := this.lru.Back()
+        this.lru.Remove(oldest)
+        delete(this.stacks, oldest.Value.(*callsiteEntry).id)
+    }
+}
+
+func (this *callsiteCache) get(id uint32) (string, bool) {
+    elem, ok := this.stacks[id]
+    if !ok {
+        return "", false
+    }
+    this.lru.MoveToFront(elem)
+    return elem.Value.(*callsiteEntry).stackinfo, true
+}
+
+// 放出等待某个调用点的全部事件 stackinfo 为空表示栈已经丢失
+func (this *callsiteCache) release(id uint32, stackinfo string, found bool) []IEventStruct {
+    w, ok := this.waiting[id]
+    if !ok {
+        return nil
+    }
+    delete(this.waiting, id)
+    this.pending -= len(w.events)
+    if !found {
+        // 记下丢失的结果 之后同一个 id 的事件直接输出 不再每个都等待超时
+        // 栈如果之后又到了 put 会覆盖这里的记录
+        stackinfo = fmt.Sprintf("[callsite:%d lost]", id)
+        this.put(id, stackinfo)
+    }
+    for _, e := range w.events {
+        if ce, ok := e.(ICallsiteEvent); ok {
+            ce.callsiteContext().Stackinfo = stackinfo
+        }
+    }
+    return w.events
+}
+
+type ICallsiteEvent interface {
+    callsiteContext() *ContextEvent
+}
+
+func (this *ContextEvent) callsiteContext() *ContextEvent {
+    return this
+}
+
+// 带上下文的事件返回内核中记录的时间 用于多个 perf map 的事件之间排序
+func EventTs(e IEventStruct) (uint64, bool) {
+    ce, ok := e.(ICallsiteEvent)
+    if !ok {
+        return 0, false
+    }
+    return ce.callsiteContext().Ts, true
+}
+
+// 解析时调用 带栈的事件记录回溯结果 其他事件按 id 补上
+func (this *ContextEvent) fillCallsiteStack() {
+    if this.Callsite == 0 {
+        return
+    }
+    callsite_cache.Lock()
+    defer callsite_cache.Unlock()
+    if this.rec.ExtraOptions.UnwindStack {
+        callsite_cache.put(this.Callsite, this.Stackinfo)
+        return
+    }
+    stackinfo, ok := callsite_cache.get(this.Callsite)
+    if ok {
+        this.Stackinfo = stackinfo
+    } else {
+        this.callsitePending = true
+    }
+}
+
+// 返回现在可以输出的事件 按到达的顺序
+func ResolveCallsite(e IEventStruct) []IEventStruct {
+    ce, ok := e.(ICallsiteEvent)
+    if !ok {
+        return []IEventStruct{e}
+    }
+    ctx := ce.callsiteContext()
+    if ctx.Callsite == 0 {
+        return []IEventStruct{e}
+    }
+    callsite_cache.Lock()
+    defer callsite_cache.Unlock()
+    if ctx.callsitePending {
+        // 再查一次 暂存期间栈可能已经到了
+        if stackinfo, found := callsite_cache.get(ctx.Callsite); found {
+            ctx.callsitePending = false
+            ctx.Stackinfo = stackinfo
+            return []IEventStruct{e}
+        }
+        if callsite_cache.pending >= CALLSITE_PENDING_MAX {
+            ctx.Stackinfo = fmt.Sprintf("[callsite:%d lost]", ctx.Callsite)
+            return []IEventStruct{e}
+        }
+        w, ok := callsite_cache.waiting[ctx.Callsite]
+        if !ok {
+            w = &callsiteWaiting{since: time.Now()}
+            callsite_cache.waiting[ctx.Callsite] = w
+        }
+        w.events = append(w.events, e)
+        callsite_cache.pending += 1
+        return nil
+    }
+    ready := []IEventStruct{e}
+    if ctx.rec.ExtraOptions.UnwindStack {
+        ready = append(ready, callsite_cache.release(ctx.Callsite, ctx.Stackinfo, true)...)
+    }
+    return ready
+}
+
+// 定期调用 放出等待超时的事件 并通知模块哪些调用点的栈丢失了
+func ExpireCallsites() []IEventStruct {
+    callsite_cache.Lock()
+    var ready []IEventStruct
+    var lost []uint32
+    now := time.Now()
+    for id, w := range callsite_cache.waiting {
+        if now.Sub(w.since) >= CALLSITE_PENDING_WAIT {
+            ready = append(ready, callsite_cache.release(id, "", false)...)
+            lost = append(lost, id)
+        }
+    }
+    report := callsite_lost_report
+    callsite_cache.Unlock()
+    // 需要遍历内核中的 map 不在持有锁时进行
+    if report != nil && len(lost) > 0 {
+        report(lost)
+    }
+    return ready
+}
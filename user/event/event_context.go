@@ -59,6 +59,12 @@ func (this *UnwindBuf) ParseContext(buf *bytes.Buffer) (err error) {
     if err = binary.Read(buf, binary.LittleEndian, &this.DynSize); err != nil {
         return err
     }
+    // 内核实际复制的大小 栈顶附近不足 StackSize 时后面都是无效数据
+    // 截断后事件在队列中占用的内存更少 回溯也不会读到无效数据
+    if this.DynSize > 0 && this.DynSize < this.StackSize {
+        this.Data = this.Data[:this.DynSize]
+        this.StackSize = this.DynSize
+    }
     return nil
 }
 
@@ -83,6 +89,9 @@ type ContextEvent struct {
     Stackinfo    string
     RegsBuffer   RegsBuf
     UnwindBuffer *UnwindBuf
+    UnwindPcs    []uint64
+    // 调用点去重模式下 栈还没有到达 需要等待带栈的事件
+    callsitePending bool
 }
 
 func (this *ContextEvent) GetOffset(addr uint64) string {
@@ -109,16 +118,45 @@ func (this *ContextEvent) ParsePadding() (err error) {
     // 好在 SampleSize 是明确的 这样我们可以正确计算下一部分 perf 数据起始位置
     // ebpf库改为全部读取之后 这里的 4 是 PERF_SAMPLE_RAW 的 size
     padding_size := this.rec.SampleSize + 4 - uint32(this.buf.Cap()-this.buf.Len())
+    this.UnwindPcs = nil
     if padding_size > 0 {
         payload := make([]byte, padding_size)
         if err = binary.Read(this.buf, binary.LittleEndian, &payload); err != nil {
             this.logger.Printf("ContextEvent EventId:%d RawSample:\n%s", this.EventId, util.HexDump(this.rec.RawSample, util.COLORRED))
             panic(err)
         }
+        if this.mconf.BpfUnwind {
+            this.parseUnwindTrailer(payload)
+        }
     }
     return nil
 }
 
+// 与 unwind.h 中的 UNWIND_TRAILER_MAGIC 一致
+const UNWIND_TRAILER_MAGIC = 0x444e5755
+
+// 内核中回溯得到的 pc 追加在参数之后 [magic][nr][pc * nr]
+func (this *ContextEvent) parseUnwindTrailer(payload []byte) {
+    if len(payload) < 8 || binary.LittleEndian.Uint32(payload[0:4]) != UNWIND_TRAILER_MAGIC {
+        return
+    }
+    nr := int(binary.LittleEndian.Uint32(payload[4:8]))
+    if len(payload) < 8+nr*8 {
+        return
+    }
+    for i := 0; i < nr; i++ {
+        this.UnwindPcs = append(this.UnwindPcs, binary.LittleEndian.Uint64(payload[8+i*8:]))
+    }
+}
+
+func (this *ContextEvent) formatUnwindPcs() string {
+    var lines []string
+    for i, pc := range this.UnwindPcs {
+        lines = append(lines, fmt.Sprintf("  #%02d pc %016x  %s", i, pc, this.GetOffset(pc)))
+    }
+    return strings.Join(lines, "\n")
+}
+
 func (this *ContextEvent) ParseEvent() (IEventStruct, error) {
     switch this.rec.RecordType {
     case unix.PERF_RECORD_SAMPLE:
@@ -130,10 +168,12 @@ func (this *ContextEvent) ParseEvent() (IEventStruct, error) {
 
         EventId := this.GetEventId()
         switch EventId {
-        case SYSCALL_ENTER, SYSCALL_EXIT:
+        case SYSCALL_ENTER, SYSCALL_EXIT, SYSCALL_REPEAT:
             return nil, nil
         case UPROBE_ENTER:
             return nil, nil
+        case IO_URING_COMPLETE:
+            return nil, nil
         default:
             this.logger.Printf("ContextEvent.ParseEvent() unsupported EventId:%d\n", EventId)
             this.logger.Printf("ContextEvent.ParseEvent() PERF_RECORD_SAMPLE RawSample:\n" + util.HexDump(this.rec.RawSample, util.COLORRED))
@@ -180,11 +220,17 @@ func (this *ContextEvent) ParseContext() (err error) {
     if err = binary.Read(this.buf, binary.LittleEndian, &this.Argnum); err != nil {
         return err
     }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Session); err != nil {
+        return err
+    }
     if err = binary.Read(this.buf, binary.LittleEndian, &this.Padding); err != nil {
         return err
     }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.Callsite); err != nil {
+        return err
+    }
     // 这一类的说明都是要关注的
-    maps_helper.UpdatePidList(this.Pid)
+    maps_helper.UpdatePidList(this.Pid, this.HostPid)
     return nil
 }
 
@@ -260,6 +306,9 @@ func (this *ContextEvent) GetStackTrace(s string) string {
 
 func (this *ContextEvent) ParseContextStack() (err error) {
     this.Stackinfo = ""
+    if this.mconf.StackDedup > 0 {
+        defer this.fillCallsiteStack()
+    }
     if this.rec.ExtraOptions.UnwindStack {
         // 读取完整的栈数据和寄存器数据 并解析为 UnwindBuf 结构体
         this.UnwindBuffer = &UnwindBuf{}
@@ -290,5 +339,9 @@ func (this *ContextEvent) ParseContextStack() (err error) {
             panic(fmt.Sprintf("UnwindStack ParseContext failed, err:%v", err))
         }
     }
+    // --bpf-unwind 与 --stack 互斥 只会走到这里
+    if len(this.UnwindPcs) > 0 {
+        this.Stackinfo = this.formatUnwindPcs()
+    }
     return nil
 }
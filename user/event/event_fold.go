@@ -0,0 +1,176 @@
+package event
+
+import (
+    "fmt"
+    "hash/fnv"
+    "os"
+    "path"
+    "regexp"
+    "sort"
+    "stackplz/user/util"
+    "strings"
+    "sync"
+)
+
+// 开启 --fold 时 相同的 (hook, 栈) 只计数 不再逐条输出
+// 按 folded 格式写入文件 可以直接交给 flamegraph.pl
+// 在事件处理时就完成计数 不需要先格式化整个事件
+
+// 不同的 (进程, hook, 栈) 超过这个数量后 新出现的栈都计入 [other] 帧 总数仍然正确
+const STACK_FOLD_MAX_ENTRIES = 65536
+
+// 没有栈信息的事件同样计数 避免次数对不上
+const (
+    FOLD_FRAME_UNKNOWN = "[unknown]"
+    FOLD_FRAME_OTHER   = "[other]"
+)
+
+type IFoldEvent interface {
+    // 返回 true 表示事件已经计入 不需要再输出
+    FoldStack() bool
+}
+
+type foldEntry struct {
+    comm   string
+    hook   string
+    frames string
+    count  uint64
+}
+
+type StackFolder struct {
+    sync.Mutex
+    entries map[uint64]*foldEntry
+}
+
+var stack_folder = &StackFolder{entries: make(map[uint64]*foldEntry)}
+
+// unwinddaemon 的格式 #00 pc 000000000004a1c8  /apex/.../libc.so (read+8)
+var unwind_frame_re = regexp.MustCompile(`#\d+\s+pc\s+([0-9a-fA-F]+)\s+(\S+)(?:\s+\((.+)\))?`)
+
+// maps_helper 的格式 0x7b1c2e3f10 <libc.so + 0x4a1c8>
+var maps_frame_re = regexp.MustCompile(`<(\S+) \+ (0x[0-9a-fA-F]+)>`)
+
+func foldFrame(line string) string {
+    var frame string
+    if m := unwind_frame_re.FindStringSubmatch(line); m != nil {
+        if m[3] != "" {
+            // 去掉函数内偏移 这样同一个函数内的不同位置会合并
+            sym := m[3]
+            if i := strings.LastIndex(sym, "+"); i > 0 {
+                sym = sym[:i]
+            }
+            frame = path.Base(m[2]) + ":" + sym
+        } else {
+            frame = fmt.Sprintf("%s+0x%s", path.Base(m[2]), strings.TrimLeft(m[1], "0"))
+        }
+    } else if m := maps_frame_re.FindStringSubmatch(line); m != nil {
+        frame = m[1] + "+" + m[2]
+    } else {
+        frame = strings.Join(strings.Fields(line), "_")
+    }
+    return strings.ReplaceAll(frame, ";", ":")
+}
+
+// 栈信息中最内层在最前面 folded 格式要求从外到内 hook 点作为最内层
+func foldFrames(stackinfo string) string {
+    var frames []string
+    for _, line := range strings.Split(stackinfo, "\n") {
+        if strings.TrimSpace(line) == "" {
+            continue
+        }
+        frames = append(frames, foldFrame(line))
+    }
+    for i, j := 0, len(frames)-1; i < j; i, j = i+1, j-1 {
+        frames[i], frames[j] = frames[j], frames[i]
+    }
+    return strings.Join(frames, ";")
+}
+
+func (this *StackFolder) Add(comm, hook, stackinfo string) {
+    h := fnv.New64a()
+    h.Write([]byte(comm))
+    h.Write([]byte{0})
+    h.Write([]byte(hook))
+    h.Write([]byte{0})
+    h.Write([]byte(stackinfo))
+    key := h.Sum64()
+
+    this.Lock()
+    defer this.Unlock()
+    entry, ok := this.entries[key]
+    if !ok {
+        frames := FOLD_FRAME_OTHER
+        if len(this.entries) >= STACK_FOLD_MAX_ENTRIES {
+            // 溢出的栈按 (进程, hook) 合并 不再解析
+            h = fnv.New64a()
+            h.Write([]byte(comm))
+            h.Write([]byte{0})
+            h.Write([]byte(hook))
+            key = h.Sum64()
+            entry, ok = this.entries[key]
+        } else if stackinfo == "" {
+            frames = FOLD_FRAME_UNKNOWN
+        } else {
+            // 只在第一次出现时解析栈
+            frames = foldFrames(stackinfo)
+        }
+        if !ok {
+            entry = &foldEntry{comm: comm, hook: hook, frames: frames}
+            this.entries[key] = entry
+        }
+    }
+    entry.count += 1
+}
+
+func (this *StackFolder) Dump(path string) (int, error) {
+    this.Lock()
+    folded := make(map[string]uint64)
+    for _, entry := range this.entries {
+        stack := entry.comm
+        if entry.frames != "" {
+            stack += ";" + entry.frames
+        }
+        stack += ";" + entry.hook
+        folded[stack] += entry.count
+    }
+    this.Unlock()
+    lines := make([]string, 0, len(folded))
+    for stack, count := range folded {
+        lines = append(lines, fmt.Sprintf("%s %d", stack, count))
+    }
+    sort.Strings(lines)
+    err := os.WriteFile(path, []byte(strings.Join(lines, "\n")+"\n"), 0644)
+    return len(lines), err
+}
+
+func DumpFolded(path string) (int, error) {
+    return stack_folder.Dump(path)
+}
+
+func (this *ContextEvent) foldHook(hook string) bool {
+    if this.mconf.FoldOut == "" {
+        return false
+    }
+    comm := strings.ReplaceAll(util.B2STrim(this.Comm[:]), ";", ":")
+    stack_folder.Add(comm, strings.ReplaceAll(hook, " ", "_"), this.Stackinfo)
+    return true
+}
+
+// 重复记录本身就是聚合结果 照常输出 返回时没有栈 单独计数
+func (this *SyscallEvent) FoldStack() bool {
+    switch this.EventId {
+    case SYSCALL_ENTER:
+        return this.foldHook(this.nr_point.Name)
+    case SYSCALL_EXIT:
+        return this.foldHook(this.nr_point.Name + "_exit")
+    }
+    return false
+}
+
+func (this *UprobeEvent) FoldStack() bool {
+    return this.foldHook(this.uprobe_point.Name)
+}
+
+func (this *BrkEvent) FoldStack() bool {
+    return this.foldHook(fmt.Sprintf("brk_0x%x", this.EventAddr))
+}
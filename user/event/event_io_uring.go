@@ -0,0 +1,144 @@
+package event
+
+import (
+    "encoding/binary"
+    "encoding/json"
+    "fmt"
+    "stackplz/user/config"
+    "stackplz/user/util"
+    "syscall"
+
+    "golang.org/x/sys/unix"
+)
+
+// 与 io_uring.c 中的 io_uring_info_t 一致 前面是 save_to_submit_buf 的索引
+type IoUringInfo struct {
+    Index     uint8
+    Opcode    uint8
+    Flags     uint8
+    Padding   uint16
+    Fd        int32
+    Len       uint32
+    Res       int32
+    Off       uint64
+    Addr      uint64
+    UserData  uint64
+    LatencyNs uint64
+}
+
+// IOSQE_FIXED_FILE 此时 fd 是注册文件的索引
+const IOSQE_FIXED_FILE = 1 << 0
+
+// 5.15 为止的 IORING_OP_XXX
+var io_uring_ops = []string{
+    "nop", "readv", "writev", "fsync", "read_fixed", "write_fixed", "poll_add", "poll_remove",
+    "sync_file_range", "sendmsg", "recvmsg", "timeout", "timeout_remove", "accept", "async_cancel", "link_timeout",
+    "connect", "fallocate", "openat", "close", "files_update", "statx", "read", "write",
+    "fadvise", "madvise", "send", "recv", "openat2", "epoll_ctl", "splice", "provide_buffers",
+    "remove_buffers", "tee", "shutdown", "renameat", "unlinkat", "mkdirat", "symlinkat", "linkat",
+}
+
+func ioUringOpName(opcode uint8) string {
+    if int(opcode) < len(io_uring_ops) {
+        return io_uring_ops[opcode]
+    }
+    return fmt.Sprintf("op_%d", opcode)
+}
+
+// 提交时记录请求 完成时配对输出 context 是提交请求的线程
+type IoUringEvent struct {
+    ContextEvent
+    info IoUringInfo
+}
+
+func (this *IoUringEvent) ParseEvent() (IEventStruct, error) {
+    data_e, err := this.ContextEvent.ParseEvent()
+    if err != nil {
+        panic("...")
+    }
+    if data_e == nil {
+        if err := this.ParseContext(); err != nil {
+            panic(fmt.Sprintf("IoUringEvent.ParseContext() err:%v", err))
+        }
+        return this, nil
+    }
+    return data_e, nil
+}
+
+func (this *IoUringEvent) ParseContext() (err error) {
+    if this.EventId != IO_URING_COMPLETE {
+        panic(fmt.Sprintf("IoUringEvent.ParseContext() failed, EventId:%d", this.EventId))
+    }
+    if err = binary.Read(this.buf, binary.LittleEndian, &this.info); err != nil {
+        panic(err)
+    }
+    this.ParsePadding()
+    return nil
+}
+
+func (this *IoUringEvent) GetUUID() string {
+    s := fmt.Sprintf("%d|%d|%s", this.Pid, this.Tid, util.B2STrim(this.Comm[:]))
+    if this.mconf.ShowTime {
+        s = fmt.Sprintf("%d|%s", this.Ts, s)
+    }
+    if this.mconf.ShowUid {
+        s = fmt.Sprintf("%d|%s", this.Uid, s)
+    }
+    return s
+}
+
+func (this *IoUringEvent) JsonString() string {
+    info := &this.info
+    v := config.IoUringFmt{}
+    v.Ts = this.Ts
+    v.Event = "io_uring_complete"
+    v.HostTid = this.HostTid
+    v.HostPid = this.HostPid
+    v.Tid = this.Tid
+    v.Pid = this.Pid
+    v.Uid = this.Uid
+    v.Comm = util.B2STrim(this.Comm[:])
+    v.Argnum = this.Argnum
+    v.Op = ioUringOpName(info.Opcode)
+    v.Fd = info.Fd
+    v.Fixed = info.Flags&IOSQE_FIXED_FILE != 0
+    v.Len = info.Len
+    v.Off = fmt.Sprintf("0x%x", info.Off)
+    v.Addr = fmt.Sprintf("0x%x", info.Addr)
+    v.UserData = fmt.Sprintf("0x%x", info.UserData)
+    v.Res = info.Res
+    v.LatencyNs = info.LatencyNs
+    data, err := json.Marshal(v)
+    if err != nil {
+        panic(err)
+    }
+    return string(data)
+}
+
+func (this *IoUringEvent) String() string {
+    if this.mconf.FmtJson {
+        return this.JsonString()
+    }
+    info := &this.info
+    fd := fmt.Sprintf("fd:%d", info.Fd)
+    if info.Flags&IOSQE_FIXED_FILE != 0 {
+        fd = fmt.Sprintf("fixed:%d", info.Fd)
+    }
+    res := fmt.Sprintf("res:%d", info.Res)
+    if info.Res < 0 {
+        res = fmt.Sprintf("res:%d(%s)", info.Res, unix.ErrnoName(syscall.Errno(-info.Res)))
+    }
+    return fmt.Sprintf("[%s] io_uring_%s %s len:%d off:0x%x addr:0x%x user_data:0x%x %s latency:%s", this.GetUUID(), ioUringOpName(info.Opcode), fd, info.Len, info.Off, info.Addr, info.UserData, res, formatLatency(info.LatencyNs))
+}
+
+func formatLatency(ns uint64) string {
+    if ns >= 1000000 {
+        return fmt.Sprintf("%.2fms", float64(ns)/1000000)
+    }
+    return fmt.Sprintf("%.2fus", float64(ns)/1000)
+}
+
+func (this *IoUringEvent) Clone() IEventStruct {
+    event := new(IoUringEvent)
+    return event
+}
@@ -0,0 +1,43 @@
+package event
+
+import (
+    "errors"
+    "fmt"
+)
+
+// 合并追踪 syscall 和 uprobe 时 同一个 events map 中会出现不同类型的事件
+// 先解析公共的 context 再根据 EventId 交给对应的事件去解析
+type MixedEvent struct {
+    ContextEvent
+}
+
+func (this *MixedEvent) ParseEvent() (IEventStruct, error) {
+    data_e, err := this.ContextEvent.ParseEvent()
+    if err != nil {
+        return nil, err
+    }
+    if data_e != nil {
+        return data_e, nil
+    }
+    switch this.EventId {
+    case SYSCALL_ENTER, SYSCALL_EXIT, SYSCALL_REPEAT:
+        event := &SyscallEvent{ContextEvent: this.ContextEvent}
+        if err := event.ParseContext(); err != nil {
+            return nil, errors.New(fmt.Sprintf("SyscallEvent.ParseContext() err:%v", err))
+        }
+        return event, nil
+    case UPROBE_ENTER:
+        event := &UprobeEvent{ContextEvent: this.ContextEvent}
+        if err := event.ParseContext(); err != nil {
+            return nil, errors.New(fmt.Sprintf("UprobeEvent.ParseContext() err:%v", err))
+        }
+        return event, nil
+    default:
+        return nil, errors.New(fmt.Sprintf("MixedEvent unsupported EventId:%d", this.EventId))
+    }
+}
+
+func (this *MixedEvent) Clone() IEventStruct {
+    event := new(MixedEvent)
+    return event
+}
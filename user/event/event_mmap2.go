@@ -41,7 +41,8 @@ func (this *LibInfo) ParseLib() {
     this.LibName = parts[len(parts)-1]
 }
 
-var pid_list []uint32
+// 产生过事件的进程 命名空间中的 pid => 宿主机上的 pid
+var pid_set = make(map[uint32]uint32)
 
 type ProcMaps map[string][]LibInfo
 
@@ -303,20 +304,17 @@ func (this *MapsHelper) ParseMaps(pid uint32, del_old bool) error {
     return nil
 }
 
-func (this *MapsHelper) UpdatePidList(pid uint32) {
+func (this *MapsHelper) UpdatePidList(pid, host_pid uint32) {
     // uprobe syscall 初始化
-    for _, v := range pid_list {
-        if v == pid {
-            return
-        }
-    }
-    pid_list = append(pid_list, pid)
+    maps_lock.Lock()
+    defer maps_lock.Unlock()
+    pid_set[pid] = host_pid
 }
 
 func (this *MapsHelper) UpdateMaps(event *Mmap2Event) {
     maps_lock.Lock()
     defer maps_lock.Unlock()
-    if !slices.Contains(pid_list, event.Pid) {
+    if _, ok := pid_set[event.Pid]; !ok {
         return
     }
     // 遇到 mmap2 事件的时候都去尝试读取maps信息
@@ -513,6 +511,32 @@ func FindLibInMaps(pid uint32, brk_lib string) (LibInfo, error) {
     return info, err
 }
 
+// 库在内存中的完整范围 包含全部段
+func FindLibRange(pid uint32, lib string) (uint64, uint64, error) {
+    var start, end uint64
+    pid_maps, err := maps_helper.FindLib(pid)
+    if err != nil {
+        return start, end, err
+    }
+    for _, lib_infos := range pid_maps {
+        for _, lib_info := range lib_infos {
+            if lib != lib_info.LibPath && lib != lib_info.LibName {
+                continue
+            }
+            if start == 0 || lib_info.BaseAddr < start {
+                start = lib_info.BaseAddr
+            }
+            if lib_info.EndAddr > end {
+                end = lib_info.EndAddr
+            }
+        }
+    }
+    if end == 0 {
+        return start, end, errors.New(fmt.Sprintf("cannot find %s in maps of pid %d", lib, pid))
+    }
+    return start, end, nil
+}
+
 func CacheMaps(pid uint32) {
     maps_lock.Lock()
     defer maps_lock.Unlock()
@@ -524,3 +548,51 @@ func CacheMaps(pid uint32) {
 //     fmt.Println(ddd)
 //     os.Exit(1)
 // }
+
+// 产生过事件的进程 内核中回溯时需要为它们加载规则 unwind_procs 按宿主机上的 pid 索引
+func GetHostPidList() []uint32 {
+    maps_lock.Lock()
+    defer maps_lock.Unlock()
+    host_pids := make([]uint32, 0, len(pid_set))
+    for _, host_pid := range pid_set {
+        host_pids = append(host_pids, host_pid)
+    }
+    return host_pids
+}
+
+// 进程退出后从 pid_set 中移除 避免 pid_set 只增不减
+func RemoveHostPid(host_pid uint32) {
+    maps_lock.Lock()
+    defer maps_lock.Unlock()
+    for pid, value := range pid_set {
+        if value == host_pid {
+            delete(pid_set, pid)
+        }
+    }
+}
+
+// 按地址聚合输出时使用 格式为 lib+0xoff 中间不带空格
+func GetAddrOffset(pid uint32, addr uint64) string {
+    return strings.ReplaceAll(maps_helper.GetOffset(pid, addr), " + ", "+")
+}
+
+// 返回地址所在库的文件名和文件偏移 用于按偏移反查符号
+func GetAddrLibOffset(pid uint32, addr uint64) (string, uint64, bool) {
+    maps_lock.Lock()
+    defer maps_lock.Unlock()
+    pid_maps, ok := maps_helper.pid_maps[pid]
+    if !ok {
+        if maps_helper.ParseMaps(pid, false) != nil {
+            return "", 0, false
+        }
+        pid_maps, ok = maps_helper.pid_maps[pid]
+        if !ok {
+            return "", 0, false
+        }
+    }
+    region := maps_helper.GetRegion(pid_maps, addr)
+    if region.LibName == "" {
+        return "", 0, false
+    }
+    return region.LibName, region.Off + (addr - region.BaseAddr), true
+}
@@ -20,6 +20,17 @@ type SyscallEvent struct {
     pc           config.Arg_reg
     ret          uint64
     arg_str      string
+    repeat       SyscallRepeat
+}
+
+// 被合并的连续重复 syscall 的汇总 与 repeat_info_t 一致
+type SyscallRepeat struct {
+    Index   uint8
+    Count   uint32
+    Padding uint32
+    FirstTs uint64
+    LastTs  uint64
+    Bytes   int64
 }
 
 func (this *SyscallEvent) ParseEvent() (IEventStruct, error) {
@@ -58,6 +69,13 @@ func (this *SyscallEvent) ParseContext() (err error) {
         this.arg_str = this.nr_point.ParseEnterPoint(this.buf)
     } else if this.EventId == SYSCALL_EXIT {
         this.arg_str = this.nr_point.ParseExitPoint(this.buf)
+    } else if this.EventId == SYSCALL_REPEAT {
+        if err = binary.Read(this.buf, binary.LittleEndian, &this.lr); err != nil {
+            panic(err)
+        }
+        if err = binary.Read(this.buf, binary.LittleEndian, &this.repeat); err != nil {
+            panic(err)
+        }
     } else {
         panic(fmt.Sprintf("SyscallEvent.ParseContext() failed, EventId:%d", this.EventId))
     }
@@ -66,6 +84,9 @@ func (this *SyscallEvent) ParseContext() (err error) {
     if err != nil {
         panic(fmt.Sprintf("ParseContextStack err:%v", err))
     }
+    if this.EventId == SYSCALL_ENTER {
+        this.TakeSnapshot(fmt.Sprintf("%s%s LR:0x%x PC:0x%x SP:0x%x", this.nr_point.Name, this.arg_str, this.lr.Address, this.pc.Address, this.sp.Address))
+    }
     return nil
 }
 
@@ -125,7 +146,18 @@ func (this *SyscallEvent) JsonString(stack_str string) string {
     }
 }
 
+func (this *SyscallEvent) RepeatString() string {
+    s := fmt.Sprintf("[%s] %s repeat:%d span:%dms LR:0x%x", this.GetUUID(), this.nr_point.Name, this.repeat.Count, (this.repeat.LastTs-this.repeat.FirstTs)/1000000, this.lr.Address)
+    if this.repeat.Bytes > 0 {
+        s = fmt.Sprintf("%s bytes:%d", s, this.repeat.Bytes)
+    }
+    return s
+}
+
 func (this *SyscallEvent) String() string {
+    if this.EventId == SYSCALL_REPEAT {
+        return this.RepeatString()
+    }
     stack_str := ""
     if this.EventId == SYSCALL_ENTER {
         stack_str = this.GetStackTrace(stack_str)
@@ -0,0 +1,96 @@
+package event
+
+import (
+    "errors"
+    "fmt"
+    "stackplz/user/config"
+    "sync"
+)
+
+// 每个会话缓存的事件数量 客户端读得慢时丢弃 不阻塞其他会话和 perf 读取
+const SESSION_QUEUE_LEN = 4096
+
+type ISessionEvent interface {
+    GetSessionMask() uint8
+}
+
+func (this *ContextEvent) GetSessionMask() uint8 {
+    return this.Session
+}
+
+type Session struct {
+    Slot       uint32
+    Generation uint32
+    Events     chan string
+    Dropped    uint64
+}
+
+func (this *Session) GetDropped() uint64 {
+    session_lock.Lock()
+    defer session_lock.Unlock()
+    return this.Dropped
+}
+
+// 守护进程模式下 一个 reader 读到的事件按位图分发给各个会话
+var session_lock sync.Mutex
+var sessions [config.MAX_SESSIONS]*Session
+
+// 每次打开会话时递增 关闭时核对 重复关闭或者槽位已经被新会话使用时不做处理
+var session_generations [config.MAX_SESSIONS]uint32
+var session_updater func(slot uint32, filter *config.SessionFilter) error
+
+// 由加载了 eBPF 程序的模块设置 会话变化时同步到 session_filters
+func SetSessionUpdater(updater func(slot uint32, filter *config.SessionFilter) error) {
+    session_lock.Lock()
+    defer session_lock.Unlock()
+    session_updater = updater
+}
+
+func OpenSession(filter *config.SessionFilter) (*Session, error) {
+    session_lock.Lock()
+    defer session_lock.Unlock()
+    if session_updater == nil {
+        return nil, errors.New("daemon is not ready")
+    }
+    for i := range sessions {
+        if sessions[i] != nil {
+            continue
+        }
+        session_generations[i]++
+        session := &Session{Slot: uint32(i), Generation: session_generations[i], Events: make(chan string, SESSION_QUEUE_LEN)}
+        // 先放入再开启过滤 避免最早的事件找不到会话
+        sessions[i] = session
+        if err := session_updater(session.Slot, filter); err != nil {
+            sessions[i] = nil
+            return nil, err
+        }
+        return session, nil
+    }
+    return nil, errors.New(fmt.Sprintf("too many sessions, max %d", config.MAX_SESSIONS))
+}
+
+func CloseSession(session *Session) error {
+    session_lock.Lock()
+    defer session_lock.Unlock()
+    if session.Slot >= config.MAX_SESSIONS || sessions[session.Slot] != session || session_generations[session.Slot] != session.Generation {
+        return errors.New(fmt.Sprintf("session %d generation %d is already closed", session.Slot, session.Generation))
+    }
+    sessions[session.Slot] = nil
+    // 关闭之后内核中还可能有已经打上该位的事件 分发时找不到会话会直接丢弃
+    return session_updater(session.Slot, &config.SessionFilter{})
+}
+
+func DispatchSession(mask uint8, s string) {
+    session_lock.Lock()
+    defer session_lock.Unlock()
+    for i, session := range sessions {
+        if session == nil || mask&(1<<i) == 0 {
+            continue
+        }
+        select {
+        case session.Events <- s:
+        default:
+            session.Dropped++
+        }
+    }
+}
@@ -0,0 +1,527 @@
+package event
+
+import (
+    "archive/tar"
+    "bufio"
+    "compress/gzip"
+    "errors"
+    "fmt"
+    "log"
+    "os"
+    "path/filepath"
+    "strconv"
+    "strings"
+    "sync"
+    "syscall"
+    "time"
+    "unsafe"
+
+    "golang.org/x/sys/unix"
+)
+
+// 开启 --snapshot 时 命中 hook 点后在内核中发送 SIGSTOP 停住进程 SIGSTOP 停住的是整个进程 不只是触发的线程
+// 用户态收到事件后交给单独的协程 用 process_vm_readv 批量读取指定的内存区域 写入 tar.gz 然后发送 SIGCONT 恢复
+// 读取期间不会阻塞事件的解析和输出
+
+const (
+    // 单次 process_vm_readv 最多读取的大小和 iovec 数量
+    SNAPSHOT_BATCH_SIZE = 1 << 20
+    SNAPSHOT_IOV_MAX    = 1024
+    // 超过这个大小的区域跳过 比如预留的 java 堆
+    SNAPSHOT_MAX_REGION = 256 << 20
+    // 等待进程停住的时间 超时后照常读取
+    SNAPSHOT_STOP_WAIT = 100 * time.Millisecond
+    SNAPSHOT_PAGE_SIZE = 4096
+    // 等待快照的命中 超出时直接恢复进程
+    SNAPSHOT_QUEUE_LEN = 64
+    // 内核记录停住之后超过这个时间 用户态还没有处理的进程直接恢复
+    // 需要大于调用点去重模式下事件等待栈的时间
+    SNAPSHOT_STOP_TIMEOUT   = 2 * time.Second
+    SNAPSHOT_SWEEP_INTERVAL = 500 * time.Millisecond
+)
+
+type snapshotRegion struct {
+    start uint64
+    end   uint64
+    name  string
+}
+
+type snapshotSegment struct {
+    region int
+    addr   uint64
+    size   uint64
+}
+
+type snapshotRequest struct {
+    pid  uint32
+    tid  uint32
+    ts   uint64
+    info string
+}
+
+type Snapshotter struct {
+    sync.Mutex
+    logger *log.Logger
+    anon   bool
+    ranges []snapshotRegion
+    dir    string
+    limit  uint32
+    count  uint32
+    queue  chan snapshotRequest
+    done   chan struct{}
+    closed bool
+    // 用户态正在处理的命中 进程 => 还没有恢复的次数
+    stops map[uint32]uint32
+}
+
+var snapshotter *Snapshotter
+
+// 由加载了 eBPF 程序的模块设置 达到 --snapshot-max 后清除 common_filter 中的 signal
+var snapshot_signal_clear func()
+
+func SetSnapshotSignalClear(clear func()) {
+    if snapshotter == nil {
+        return
+    }
+    snapshotter.Lock()
+    defer snapshotter.Unlock()
+    snapshot_signal_clear = clear
+}
+
+// 由加载了 eBPF 程序的模块设置 读取和删除内核中记录的 进程 => 停住时事件的时间戳
+var snapshot_stops_list func() map[uint32]uint64
+var snapshot_stops_remove func(pid uint32, ts uint64)
+
+func SetSnapshotStops(list func() map[uint32]uint64, remove func(pid uint32, ts uint64)) {
+    if snapshotter == nil {
+        return
+    }
+    snapshotter.Lock()
+    defer snapshotter.Unlock()
+    snapshot_stops_list = list
+    snapshot_stops_remove = remove
+}
+
+// spec 为 anon 或者 start-end 多个用 , 隔开 两者可以同时使用
+func SetupSnapshot(logger *log.Logger, spec, dir string, limit uint32) error {
+    s := &Snapshotter{logger: logger, dir: dir, limit: limit, stops: make(map[uint32]uint32)}
+    for _, item := range strings.Split(spec, ",") {
+        item = strings.TrimSpace(item)
+        if item == "" {
+            continue
+        }
+        if item == "anon" {
+            s.anon = true
+            continue
+        }
+        parts := strings.SplitN(item, "-", 2)
+        if len(parts) != 2 {
+            return errors.New(fmt.Sprintf("snapshot region %s invaild, e.g. 0x7b00000000-0x7b00100000", item))
+        }
+        start, err := strconv.ParseUint(parts[0], 0, 64)
+        if err != nil {
+            return errors.New(fmt.Sprintf("snapshot region %s invaild, err:%v", item, err))
+        }
+        end, err := strconv.ParseUint(parts[1], 0, 64)
+        if err != nil || end <= start {
+            return errors.New(fmt.Sprintf("snapshot region %s invaild", item))
+        }
+        s.ranges = append(s.ranges, snapshotRegion{start: start, end: end, name: "range"})
+    }
+    if !s.anon && len(s.ranges) == 0 {
+        return errors.New("--snapshot need anon or start-end regions")
+    }
+    if err := os.MkdirAll(dir, 0755); err != nil {
+        return err
+    }
+    s.queue = make(chan snapshotRequest, SNAPSHOT_QUEUE_LEN)
+    s.done = make(chan struct{})
+    go s.worker()
+    go s.sweepLoop()
+    snapshotter = s
+    return nil
+}
+
+// 可读写的匿名区域 包括 [heap] [stack] [anon:xxx]
+func snapshotAnonRegions(pid uint32) ([]snapshotRegion, error) {
+    file, err := os.Open(fmt.Sprintf("/proc/%d/maps", pid))
+    if err != nil {
+        return nil, err
+    }
+    defer file.Close()
+    var regions []snapshotRegion
+    scanner := bufio.NewScanner(file)
+    for scanner.Scan() {
+        fields := strings.Fields(scanner.Text())
+        if len(fields) < 5 || !strings.HasPrefix(fields[1], "rw") {
+            continue
+        }
+        name := ""
+        if len(fields) > 5 {
+            name = strings.Join(fields[5:], " ")
+        }
+        if name != "" && !strings.HasPrefix(name, "[") {
+            continue
+        }
+        var start, end uint64
+        if _, err := fmt.Sscanf(fields[0], "%x-%x", &start, &end); err != nil {
+            continue
+        }
+        regions = append(regions, snapshotRegion{start: start, end: end, name: name})
+    }
+    return regions, scanner.Err()
+}
+
+// 等待触发线程进入停止状态 这样读取期间内存不会变化
+func snapshotWaitStop(pid, tid uint32) bool {
+    deadline := time.Now().Add(SNAPSHOT_STOP_WAIT)
+    for time.Now().Before(deadline) {
+        stat, err := os.ReadFile(fmt.Sprintf("/proc/%d/task/%d/stat", pid, tid))
+        if err != nil {
+            return false
+        }
+        // comm 中可能有空格 状态在最后一个 ) 之后
+        if i := strings.LastIndexByte(string(stat), ')'); i > 0 && i+2 < len(stat) && (stat[i+2] == 'T' || stat[i+2] == 't') {
+            return true
+        }
+        time.Sleep(time.Millisecond)
+    }
+    return false
+}
+
+func snapshotSegments(regions []snapshotRegion) []snapshotSegment {
+    var segments []snapshotSegment
+    for i, region := range regions {
+        for addr := region.start; addr < region.end; addr += SNAPSHOT_BATCH_SIZE {
+            size := region.end - addr
+            if size > SNAPSHOT_BATCH_SIZE {
+                size = SNAPSHOT_BATCH_SIZE
+            }
+            segments = append(segments, snapshotSegment{i, addr, size})
+        }
+    }
+    return segments
+}
+
+type snapshotWriter struct {
+    tw      *tar.Writer
+    regions []snapshotRegion
+    current int
+    mtime   time.Time
+}
+
+func (this *snapshotWriter) write(region int, data []byte) error {
+    if region != this.current {
+        r := this.regions[region]
+        name := fmt.Sprintf("mem/%x-%x", r.start, r.end)
+        if r.name != "" {
+            name += "_" + strings.Trim(strings.ReplaceAll(r.name, "/", "_"), "[]")
+        }
+        hdr := &tar.Header{Name: name, Mode: 0644, Size: int64(r.end - r.start), ModTime: this.mtime}
+        if err := this.tw.WriteHeader(hdr); err != nil {
+            return err
+        }
+        this.current = region
+    }
+    _, err := this.tw.Write(data)
+    return err
+}
+
+// 多个区域合并到一次 process_vm_readv 中 遇到不可读的页时该调用在此处截断
+// 剩余部分放回队列 不可读的页填 0 保证每个区域在文件中的大小与地址范围一致
+func snapshotRead(pid uint32, regions []snapshotRegion, w *snapshotWriter) (uint64, error) {
+    var total uint64 = 0
+    buf := make([]byte, SNAPSHOT_BATCH_SIZE)
+    zero := make([]byte, SNAPSHOT_PAGE_SIZE)
+    queue := snapshotSegments(regions)
+    for len(queue) > 0 {
+        var remote []unix.RemoteIovec
+        var size uint64 = 0
+        for _, seg := range queue {
+            if len(remote) >= SNAPSHOT_IOV_MAX || size+seg.size > SNAPSHOT_BATCH_SIZE {
+                break
+            }
+            remote = append(remote, unix.RemoteIovec{Base: uintptr(seg.addr), Len: int(seg.size)})
+            size += seg.size
+        }
+        local := []unix.Iovec{{Base: (*byte)(unsafe.Pointer(&buf[0]))}}
+        local[0].SetLen(int(size))
+        n, err := unix.ProcessVMReadv(int(pid), local, remote, 0)
+        if err != nil && err != unix.EFAULT {
+            return total, err
+        }
+        if n < 0 {
+            n = 0
+        }
+        got := uint64(n)
+        total += got
+        var off uint64 = 0
+        done := 0
+        for done < len(remote) && off < got {
+            seg := &queue[done]
+            count := seg.size
+            if got-off < count {
+                count = got - off
+            }
+            if err := w.write(seg.region, buf[off:off+count]); err != nil {
+                return total, err
+            }
+            off += count
+            if count < seg.size {
+                seg.addr += count
+                seg.size -= count
+                break
+            }
+            done++
+        }
+        queue = queue[done:]
+        if got == size || len(queue) == 0 {
+            continue
+        }
+        // 队首是读取失败的位置 先按页拆开重试 只有单独一页也读不了时才填 0
+        seg := queue[0]
+        if seg.size > SNAPSHOT_PAGE_SIZE-seg.addr%SNAPSHOT_PAGE_SIZE {
+            var pages []snapshotSegment
+            for addr := seg.addr; addr < seg.addr+seg.size; {
+                size := SNAPSHOT_PAGE_SIZE - addr%SNAPSHOT_PAGE_SIZE
+                if addr+size > seg.addr+seg.size {
+                    size = seg.addr + seg.size - addr
+                }
+                pages = append(pages, snapshotSegment{seg.region, addr, size})
+                addr += size
+            }
+            queue = append(pages, queue[1:]...)
+            continue
+        }
+        if err := w.write(seg.region, zero[:seg.size]); err != nil {
+            return total, err
+        }
+        queue = queue[1:]
+    }
+    return total, nil
+}
+
+func (this *Snapshotter) take(pid, tid uint32, info string) (string, error) {
+    if !snapshotWaitStop(pid, tid) {
+        this.logger.Printf("[snapshot] pid:%d tid:%d not stopped, read anyway", pid, tid)
+    }
+    regions := append([]snapshotRegion{}, this.ranges...)
+    if this.anon {
+        anon, err := snapshotAnonRegions(pid)
+        if err != nil {
+            return "", err
+        }
+        regions = append(regions, anon...)
+    }
+    var kept []snapshotRegion
+    for _, region := range regions {
+        if region.end-region.start > SNAPSHOT_MAX_REGION {
+            this.logger.Printf("[snapshot] skip 0x%x-0x%x %s, size:%d", region.start, region.end, region.name, region.end-region.start)
+            continue
+        }
+        kept = append(kept, region)
+    }
+
+    now := time.Now()
+    path := filepath.Join(this.dir, fmt.Sprintf("snapshot_%d_%d_%d.tar.gz", pid, tid, now.UnixNano()))
+    file, err := os.Create(path)
+    if err != nil {
+        return "", err
+    }
+    defer file.Close()
+    gw, err := gzip.NewWriterLevel(file, gzip.BestSpeed)
+    if err != nil {
+        return "", err
+    }
+    tw := tar.NewWriter(gw)
+    w := &snapshotWriter{tw: tw, regions: kept, current: -1, mtime: now}
+
+    // 事件信息和 maps 放在最前面 方便对照地址
+    maps, _ := os.ReadFile(fmt.Sprintf("/proc/%d/maps", pid))
+    names := []string{"info.txt", "maps"}
+    for i, content := range [][]byte{[]byte(info + "\n"), maps} {
+        if err := tw.WriteHeader(&tar.Header{Name: names[i], Mode: 0644, Size: int64(len(content)), ModTime: now}); err != nil {
+            return "", err
+        }
+        if _, err := tw.Write(content); err != nil {
+            return "", err
+        }
+    }
+    total, err := snapshotRead(pid, kept, w)
+    if err != nil {
+        return "", err
+    }
+    if err := tw.Close(); err != nil {
+        return "", err
+    }
+    if err := gw.Close(); err != nil {
+        return "", err
+    }
+    this.logger.Printf("[snapshot] %s regions:%d read:%d cost:%v", path, len(kept), total, time.Since(now))
+    return path, nil
+}
+
+// 恢复进程 同时删除内核中的记录 counted 表示这次命中计入了 stops
+func (this *Snapshotter) resume(req snapshotRequest, counted bool) {
+    syscall.Kill(int(req.pid), syscall.SIGCONT)
+    this.Lock()
+    if counted && this.stops[req.pid] > 0 {
+        this.stops[req.pid] -= 1
+        if this.stops[req.pid] == 0 {
+            delete(this.stops, req.pid)
+        }
+    }
+    remove := snapshot_stops_remove
+    this.Unlock()
+    if remove != nil {
+        remove(req.pid, req.ts)
+    }
+}
+
+// bpf_ktime_get_ns 使用的时钟
+func snapshotKtime() uint64 {
+    var ts unix.Timespec
+    if err := unix.ClockGettime(unix.CLOCK_MONOTONIC, &ts); err != nil {
+        return 0
+    }
+    return uint64(ts.Nano())
+}
+
+// 恢复内核中记录停住超过 age 用户态又没有在处理的进程
+func (this *Snapshotter) sweep(age time.Duration) {
+    this.Lock()
+    list, remove := snapshot_stops_list, snapshot_stops_remove
+    this.Unlock()
+    if list == nil {
+        return
+    }
+    now := snapshotKtime()
+    for pid, ts := range list() {
+        if now < ts+uint64(age) {
+            continue
+        }
+        this.Lock()
+        busy := this.stops[pid] > 0
+        this.Unlock()
+        if busy {
+            continue
+        }
+        syscall.Kill(int(pid), syscall.SIGCONT)
+        remove(pid, ts)
+        this.logger.Printf("[snapshot] pid:%d still stopped without event, resume", pid)
+    }
+}
+
+func (this *Snapshotter) sweepLoop() {
+    ticker := time.NewTicker(SNAPSHOT_SWEEP_INTERVAL)
+    defer ticker.Stop()
+    for {
+        select {
+        case <-this.done:
+            return
+        case <-ticker.C:
+            this.sweep(SNAPSHOT_STOP_TIMEOUT)
+        }
+    }
+}
+
+// 事件丢失后 不知道哪些进程的事件丢了 恢复所有用户态没有在处理的进程
+func ResumeLostStops() {
+    if snapshotter == nil {
+        return
+    }
+    snapshotter.sweep(0)
+}
+
+func (this *Snapshotter) worker() {
+    defer close(this.done)
+    for req := range this.queue {
+        this.Lock()
+        take := !this.closed && (this.limit == 0 || this.count < this.limit)
+        if take {
+            this.count += 1
+        }
+        var clear_signal func()
+        if take && this.limit > 0 && this.count == this.limit {
+            clear_signal = snapshot_signal_clear
+        }
+        this.Unlock()
+        if clear_signal != nil {
+            // 之后的命中不再停住进程 已经在路上的事件照常恢复
+            clear_signal()
+            this.logger.Printf("[snapshot] reach --snapshot-max %d, stop sending SIGSTOP", this.limit)
+        }
+        if take {
+            if _, err := this.take(req.pid, req.tid, req.info); err != nil {
+                this.logger.Printf("[snapshot] pid:%d tid:%d failed, err:%v", req.pid, req.tid, err)
+            }
+        }
+        this.resume(req, true)
+    }
+}
+
+// 每次命中都会停住进程 超出数量限制后只恢复 不再读取
+func (this *ContextEvent) TakeSnapshot(info string) {
+    if snapshotter == nil {
+        return
+    }
+    info = fmt.Sprintf("[%d|%d|%s] %s", this.HostPid, this.HostTid, strings.TrimRight(string(this.Comm[:]), "\x00"), info)
+    snapshotter.submit(snapshotRequest{this.HostPid, this.HostTid, this.Ts, info})
+}
+
+func (this *Snapshotter) submit(req snapshotRequest) {
+    this.Lock()
+    if this.closed {
+        this.Unlock()
+        this.resume(req, false)
+        return
+    }
+    this.stops[req.pid] += 1
+    select {
+    case this.queue <- req:
+        this.Unlock()
+    default:
+        this.Unlock()
+        this.resume(req, true)
+        this.logger.Printf("[snapshot] pid:%d tid:%d queue full, resume without snapshot", req.pid, req.tid)
+    }
+}
+
+// 退出时不再读取 等待正在进行的快照完成 然后内核中不再发送 SIGSTOP
+// 恢复还有记录的进程 包括还在 perf 缓冲区中没有读到的事件停住的进程
+func CloseSnapshot() {
+    if snapshotter == nil {
+        return
+    }
+    snapshotter.Lock()
+    if snapshotter.closed {
+        snapshotter.Unlock()
+        return
+    }
+    snapshotter.closed = true
+    close(snapshotter.queue)
+    snapshotter.Unlock()
+    <-snapshotter.done
+
+    snapshotter.Lock()
+    clear_signal, list := snapshot_signal_clear, snapshot_stops_list
+    pids := make(map[uint32]bool)
+    for pid, count := range snapshotter.stops {
+        if count > 0 {
+            pids[pid] = true
+        }
+    }
+    snapshotter.Unlock()
+    if clear_signal != nil {
+        clear_signal()
+    }
+    if list != nil {
+        for pid := range list() {
+            pids[pid] = true
+        }
+    }
+    for pid := range pids {
+        syscall.Kill(int(pid), syscall.SIGCONT)
+        snapshotter.logger.Printf("[snapshot] pid:%d resumed on exit", pid)
+    }
+}
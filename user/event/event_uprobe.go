@@ -75,6 +75,7 @@ func (this *UprobeEvent) ParseContext() (err error) {
     if err != nil {
         panic(fmt.Sprintf("ParseContextStack err:%v", err))
     }
+    this.TakeSnapshot(fmt.Sprintf("%s%s LR:0x%x PC:0x%x SP:0x%x", this.uprobe_point.Name, this.arg_str, this.lr.Address, this.pc.Address, this.sp.Address))
     return nil
 }
 
@@ -20,6 +20,8 @@ const (
     SYSCALL_EXIT
     UPROBE_ENTER
     HW_BREAKPOINT
+    SYSCALL_REPEAT
+    IO_URING_COMPLETE
 )
 
 type IEventStruct interface {
@@ -78,7 +78,21 @@ func (this *eventWorker) parserEvent(e event.IEventStruct) {
 		}
 	default:
 		{
-			logger.Println(e.String())
+			// --fold 模式下 事件在格式化之前就计入栈统计
+			if fe, ok := e.(event.IFoldEvent); ok && fe.FoldStack() {
+				break
+			}
+			// 聚合输出模式下 事件只计数 String 返回空
+			s := e.String()
+			if s == "" {
+				break
+			}
+			// 守护进程模式下 事件只发给关心它的会话
+			if se, ok := e.(event.ISessionEvent); ok && se.GetSessionMask() != 0 {
+				event.DispatchSession(se.GetSessionMask(), s)
+				break
+			}
+			logger.Println(s)
 		}
 	}
 
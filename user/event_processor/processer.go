@@ -4,6 +4,7 @@ import (
 	"fmt"
 	"log"
 	"stackplz/user/event"
+	"stackplz/user/util"
 	"sync"
 	"time"
 )
@@ -11,6 +12,8 @@ import (
 const (
 	MAX_INCOMING_CHAN_LEN = 1024
 	MAX_PARSER_QUEUE_LEN  = 1024
+	// 检查调用点去重模式下等待栈超时的事件
+	CALLSITE_EXPIRE_INTERVAL = 100 * time.Millisecond
 )
 
 type EventProcessor struct {
@@ -21,6 +24,9 @@ type EventProcessor struct {
 	// key为 PID+UID+COMMON等确定唯一的信息
 	workerQueue map[string]IWorker
 
+	// 只在事件来自多个 perf map 时使用 见 reorder.go
+	reorder *reorderBuffer
+
 	logger *log.Logger
 }
 
@@ -33,12 +39,32 @@ func (this *EventProcessor) init() {
 	this.workerQueue = make(map[string]IWorker, MAX_PARSER_QUEUE_LEN)
 }
 
+// 按事件发生的时间排序后再输出 需要在 Serve 之前设置
+func (this *EventProcessor) SetReorder(window time.Duration) {
+	this.reorder = newReorderBuffer(window)
+}
+
 // Write event 处理器读取事件
 func (this *EventProcessor) Serve() {
+	ticker := time.NewTicker(CALLSITE_EXPIRE_INTERVAL)
+	defer ticker.Stop()
+	// 没有开启排序时为 nil 不会触发
+	var flush <-chan time.Time
+	if this.reorder != nil {
+		flush_ticker := time.NewTicker(REORDER_INTERVAL)
+		defer flush_ticker.Stop()
+		flush = flush_ticker.C
+	}
 	for {
 		select {
 		case e := <-this.incoming:
 			this.dispatch(e)
+		case <-ticker.C:
+			for _, e := range event.ExpireCallsites() {
+				this.output(e)
+			}
+		case <-flush:
+			this.flushReorder()
 		}
 	}
 }
@@ -59,6 +85,37 @@ func (this *EventProcessor) dispatch(map_e event.IEventStruct) {
 		// 比如是自己的 mmap2 事件 直接忽略调
 		return
 	}
+	// 调用点去重模式下 栈还没到的事件会先暂存 栈到达时一起放出
+	for _, e := range event.ResolveCallsite(data_e) {
+		this.output(e)
+	}
+}
+
+// 开启排序时先放入排序缓冲 没有时间信息的事件直接输出
+func (this *EventProcessor) output(e event.IEventStruct) {
+	if this.reorder == nil {
+		this.deliver(e)
+		return
+	}
+	ts, ok := event.EventTs(e)
+	if !ok {
+		this.deliver(e)
+		return
+	}
+	now := time.Now()
+	this.reorder.push(e, ts, now)
+	for _, e := range this.reorder.pop(now) {
+		this.deliver(e)
+	}
+}
+
+func (this *EventProcessor) flushReorder() {
+	for _, e := range this.reorder.pop(time.Now()) {
+		this.deliver(e)
+	}
+}
+
+func (this *EventProcessor) deliver(data_e event.IEventStruct) {
 	// 单就输出日志来说 下面这样做反而给人一种输出有延迟的感觉 如果没有必要就去掉这部分吧
 	var uuid string = data_e.GetUUID()
 	found, eWorker := this.getWorkerByUUID(uuid)
@@ -67,9 +124,10 @@ func (this *EventProcessor) dispatch(map_e event.IEventStruct) {
 		eWorker = NewEventWorker(data_e.GetUUID(), this)
 		this.addWorkerByUUID(eWorker)
 	}
-	err = eWorker.Write(data_e)
+	err := eWorker.Write(data_e)
 	if err != nil {
 		//...
+		util.RestoreBpfStats()
 		this.GetLogger().Fatalf("write event failed , error:%v", err)
 	}
 }
@@ -113,6 +171,10 @@ func (this *EventProcessor) Write(e event.IEventStruct) {
 }
 
 func (this *EventProcessor) Close() error {
+	if this.reorder != nil {
+		// 等排序缓冲中的事件放出
+		time.Sleep(2 * REORDER_WINDOW)
+	}
 	// 关闭模块的时候 变更 tickerCount 大小 让它自己退出
 	for _, worker := range this.workerQueue {
 		worker.(*eventWorker).tickerCount = MAX_TICKER_COUNT + 1
@@ -0,0 +1,71 @@
+package event_processor
+
+import (
+	"container/heap"
+	"stackplz/user/event"
+	"time"
+)
+
+// 调用点去重 自适应栈和开销控制模式下 同一个线程的事件分散在多个 perf map 中
+// 每个 map 有自己的读取者 到达的顺序与发生的顺序不一致
+// 这里按内核记录的时间暂存一小段时间再放出 晚于窗口到达的事件仍然会乱序
+const (
+	REORDER_WINDOW   = 50 * time.Millisecond
+	REORDER_INTERVAL = 10 * time.Millisecond
+)
+
+type reorderItem struct {
+	ts      uint64
+	seq     uint64
+	arrived time.Time
+	e       event.IEventStruct
+}
+
+type reorderHeap []*reorderItem
+
+func (h reorderHeap) Len() int { return len(h) }
+func (h reorderHeap) Less(i, j int) bool {
+	if h[i].ts != h[j].ts {
+		return h[i].ts < h[j].ts
+	}
+	return h[i].seq < h[j].seq
+}
+func (h reorderHeap) Swap(i, j int) { h[i], h[j] = h[j], h[i] }
+
+func (h *reorderHeap) Push(x interface{}) {
+	*h = append(*h, x.(*reorderItem))
+}
+
+func (h *reorderHeap) Pop() interface{} {
+	old := *h
+	n := len(old)
+	item := old[n-1]
+	old[n-1] = nil
+	*h = old[:n-1]
+	return item
+}
+
+type reorderBuffer struct {
+	window time.Duration
+	items  reorderHeap
+	seq    uint64
+}
+
+func newReorderBuffer(window time.Duration) *reorderBuffer {
+	return &reorderBuffer{window: window}
+}
+
+func (this *reorderBuffer) push(e event.IEventStruct, ts uint64, now time.Time) {
+	this.seq += 1
+	heap.Push(&this.items, &reorderItem{ts: ts, seq: this.seq, arrived: now, e: e})
+}
+
+// 按时间顺序放出已经等满窗口的事件
+// 时间最早的事件还没等满时 后面的也一起等 保证放出的顺序
+func (this *reorderBuffer) pop(now time.Time) []event.IEventStruct {
+	var ready []event.IEventStruct
+	for this.items.Len() > 0 && now.Sub(this.items[0].arrived) >= this.window {
+		ready = append(ready, heap.Pop(&this.items).(*reorderItem).e)
+	}
+	return ready
+}
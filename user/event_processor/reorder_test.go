@@ -0,0 +1,44 @@
+package event_processor
+
+import (
+	"stackplz/user/event"
+	"testing"
+	"time"
+)
+
+type fakeEvent struct {
+	event.IEventStruct
+	ts uint64
+}
+
+func TestReorderBuffer(t *testing.T) {
+	b := newReorderBuffer(50 * time.Millisecond)
+	now := time.Now()
+	// 带栈的事件晚到 时间更早
+	for _, ts := range []uint64{30, 10, 20, 10} {
+		b.push(&fakeEvent{ts: ts}, ts, now)
+	}
+	if ready := b.pop(now.Add(10 * time.Millisecond)); len(ready) != 0 {
+		t.Fatalf("released %d events before the window", len(ready))
+	}
+	b.push(&fakeEvent{ts: 5}, 5, now.Add(40*time.Millisecond))
+	ready := b.pop(now.Add(60 * time.Millisecond))
+	// ts 5 还没等满窗口 后面的都要等它
+	if len(ready) != 0 {
+		t.Fatalf("released %d events before the earliest one", len(ready))
+	}
+	ready = b.pop(now.Add(90 * time.Millisecond))
+	var got []uint64
+	for _, e := range ready {
+		got = append(got, e.(*fakeEvent).ts)
+	}
+	want := []uint64{5, 10, 10, 20, 30}
+	if len(got) != len(want) {
+		t.Fatalf("got %v, want %v", got, want)
+	}
+	for i := range want {
+		if got[i] != want[i] {
+			t.Fatalf("got %v, want %v", got, want)
+		}
+	}
+}
@@ -0,0 +1,54 @@
+package module
+
+import (
+    "fmt"
+    "stackplz/user/event"
+    "strings"
+    "time"
+
+    "github.com/cilium/ebpf"
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// heap/lock/count/offcpu/profile/io_uring 只加载各自的 .o 并复用 MSyscall 的过滤设定
+// 统计都在内核中完成 用户态定期读取输出
+
+// 与各个 .c 中 BPF_MAP_TYPE_STACK_TRACE 的深度一致
+const STACK_TRACE_DEPTH = 127
+
+// 加载 -> 挂载 -> 同步基础的过滤设定
+func (this *MSyscall) startAggregate(probes []*manager.Probe, map_names ...string) error {
+    return this.startObject(probes, this.updateBaseFilter, map_names...)
+}
+
+// 每 seconds 秒调用一次 dump 直到退出
+func (this *Module) dumpLoop(seconds uint32, name string, dump func() error) {
+    ticker := time.NewTicker(time.Duration(seconds) * time.Second)
+    defer ticker.Stop()
+    for {
+        select {
+        case <-this.ctx.Done():
+            return
+        case <-ticker.C:
+        }
+        if err := dump(); err != nil {
+            this.logger.Printf("%s failed, err:%v", name, err)
+        }
+    }
+}
+
+// 按 stack id 从 STACK_TRACE 类型的 map 中取出用户栈 每帧一行 超过 max_frames 的省略
+func writeStackId(b *strings.Builder, stacks_map *ebpf.Map, tgid uint32, stack_id int32, max_frames int) {
+    var ips [STACK_TRACE_DEPTH]uint64
+    if stack_id < 0 || stacks_map.Lookup(&stack_id, &ips) != nil {
+        b.WriteString("    [unknown]\n")
+        return
+    }
+    for depth := 0; depth < STACK_TRACE_DEPTH && ips[depth] != 0; depth++ {
+        if depth >= max_frames {
+            b.WriteString("    ...\n")
+            break
+        }
+        b.WriteString(fmt.Sprintf("    #%02d 0x%x %s\n", depth, ips[depth], event.GetAddrOffset(tgid, ips[depth])))
+    }
+}
@@ -0,0 +1,43 @@
+package module
+
+import (
+    "fmt"
+    "stackplz/user/util"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// arm 点 进入函数时线程开始被追踪 函数返回时停止
+// 同一个 eBPF 程序挂到多个位置 通过 UID 区分
+func (this *Module) armProbes() []*manager.Probe {
+    probes := []*manager.Probe{}
+    for i, arm_point := range this.mconf.ArmPoints {
+        arm_probe := &manager.Probe{
+            UID:          fmt.Sprintf("arm_%d", i),
+            Section:      "uprobe/arm",
+            EbpfFuncName: "probe_arm",
+            BinaryPath:   arm_point.LibPath,
+        }
+        disarm_probe := &manager.Probe{
+            UID:          fmt.Sprintf("disarm_%d", i),
+            Section:      "uretprobe/disarm",
+            EbpfFuncName: "probe_disarm",
+            BinaryPath:   arm_point.LibPath,
+        }
+        if arm_point.Symbol == "" {
+            sym := util.RandStringBytes(8)
+            arm_probe.AttachToFuncName = sym
+            arm_probe.UAddress = arm_point.Offset
+            disarm_probe.AttachToFuncName = sym
+            disarm_probe.UAddress = arm_point.Offset
+        } else {
+            arm_probe.AttachToFuncName = arm_point.Symbol
+            disarm_probe.AttachToFuncName = arm_point.Symbol
+        }
+        if this.mconf.Debug {
+            this.logger.Printf("arm_index:%d hook %s", i, arm_point.String())
+        }
+        probes = append(probes, arm_probe, disarm_probe)
+    }
+    return probes
+}
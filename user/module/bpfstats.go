@@ -0,0 +1,141 @@
+package module
+
+import (
+    "fmt"
+    "runtime"
+    "sort"
+    "stackplz/user/util"
+    "strings"
+    "time"
+
+    "github.com/cilium/ebpf"
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// 加载了 eBPF 程序的模块提供各自的 manager 用于统计
+type IBpfManager interface {
+    BpfManager() *manager.Manager
+}
+
+// 在加载程序之前开启 统计从第一次运行开始 --max-overhead 同样依赖这里的统计
+func (this *Module) enableBpfStats() {
+    if this.mconf.BpfStats == 0 && this.mconf.MaxOverhead == 0 {
+        return
+    }
+    if err := util.EnableBpfStats(); err != nil {
+        this.logger.Printf("enable bpf stats failed, err:%v", err)
+    }
+}
+
+func (this *Module) startBpfStats() {
+    if this.mconf.BpfStats == 0 {
+        return
+    }
+    child, ok := this.child.(IBpfManager)
+    if !ok {
+        return
+    }
+    go this.bpfStatsLoop(child.BpfManager(), this.statsProgs...)
+}
+
+type bpfProgStat struct {
+    RunCnt    uint64
+    RunTimeNs uint64
+}
+
+type bpfProgRow struct {
+    name string
+    stat bpfProgStat
+}
+
+// 同一个程序可能挂到多个点上 比如 kprobe 方式的 sys_enter 按函数名合并统计
+// extra 是不通过 Probes 挂载的程序 比如 perf_event 上的 profile_handler
+func (this *Module) bpfStatsProgs(m *manager.Manager, extra []string) (map[string][]*ebpf.Program, error) {
+    names := append([]string{}, extra...)
+    for _, probe := range m.Probes {
+        names = append(names, probe.EbpfFuncName)
+    }
+    progs := make(map[string][]*ebpf.Program)
+    for _, name := range names {
+        if _, ok := progs[name]; ok {
+            continue
+        }
+        items, found, err := m.GetProgram(manager.ProbeIdentificationPair{EbpfFuncName: name})
+        if err != nil {
+            return nil, err
+        }
+        if !found || len(items) == 0 {
+            continue
+        }
+        progs[name] = items
+    }
+    return progs, nil
+}
+
+// 内核中的统计是累计值 每个周期输出与上一次的差值
+// CPU% 为程序运行时间占全部 cpu 时间的比例
+func (this *Module) bpfStatsLoop(m *manager.Manager, extra ...string) {
+    progs, err := this.bpfStatsProgs(m, extra)
+    if err != nil {
+        this.logger.Printf("bpf stats failed, err:%v", err)
+        return
+    }
+    if len(progs) == 0 {
+        return
+    }
+    interval := time.Duration(this.mconf.BpfStats) * time.Second
+    ticker := time.NewTicker(interval)
+    defer ticker.Stop()
+    last := make(map[string]bpfProgStat)
+    last_time := time.Now()
+    for {
+        select {
+        case <-this.ctx.Done():
+            return
+        case <-ticker.C:
+        }
+        now := time.Now()
+        elapsed := now.Sub(last_time)
+        last_time = now
+        var rows []bpfProgRow
+        sum := bpfProgStat{}
+        for name, items := range progs {
+            stat := bpfProgStat{}
+            for _, prog := range items {
+                run_cnt, run_time_ns, err := util.ReadBpfProgStats(prog.FD())
+                if err != nil {
+                    this.logger.Printf("bpf stats failed, err:%v", err)
+                    return
+                }
+                stat.RunCnt += run_cnt
+                stat.RunTimeNs += run_time_ns
+            }
+            prev := last[name]
+            last[name] = stat
+            delta := bpfProgStat{stat.RunCnt - prev.RunCnt, stat.RunTimeNs - prev.RunTimeNs}
+            sum.RunCnt += delta.RunCnt
+            sum.RunTimeNs += delta.RunTimeNs
+            if delta.RunCnt == 0 {
+                continue
+            }
+            rows = append(rows, bpfProgRow{name, delta})
+        }
+        sort.Slice(rows, func(i, j int) bool {
+            return rows[i].stat.RunTimeNs > rows[j].stat.RunTimeNs
+        })
+        cpu_ns := float64(elapsed.Nanoseconds()) * float64(runtime.NumCPU())
+        var b strings.Builder
+        b.WriteString(fmt.Sprintf("[bpf-stats] %s %s\n", this.child.Name(), now.Format("15:04:05")))
+        b.WriteString(fmt.Sprintf("%-40s %12s %10s %12s %8s\n", "PROG", "RUN_CNT", "AVG_NS", "TIME_MS", "CPU%"))
+        row_fmt := "%-40s %12d %10d %12.3f %8.3f\n"
+        for _, row := range rows {
+            b.WriteString(fmt.Sprintf(row_fmt, row.name, row.stat.RunCnt, row.stat.RunTimeNs/row.stat.RunCnt, float64(row.stat.RunTimeNs)/1e6, float64(row.stat.RunTimeNs)*100/cpu_ns))
+        }
+        var avg_ns uint64 = 0
+        if sum.RunCnt > 0 {
+            avg_ns = sum.RunTimeNs / sum.RunCnt
+        }
+        b.WriteString(fmt.Sprintf(row_fmt, "TOTAL", sum.RunCnt, avg_ns, float64(sum.RunTimeNs)/1e6, float64(sum.RunTimeNs)*100/cpu_ns))
+        this.logger.Print(b.String())
+    }
+}
@@ -7,10 +7,17 @@ import (
 	"fmt"
 	"log"
 	"math"
+	"os"
+	"os/signal"
 	"path/filepath"
+	"runtime"
+	"sort"
 	"stackplz/assets"
 	"stackplz/user/config"
 	"stackplz/user/event"
+	"strconv"
+	"syscall"
+	"unsafe"
 
 	"github.com/cilium/ebpf"
 	"github.com/cilium/ebpf/btf"
@@ -25,6 +32,7 @@ type PerfBRK struct {
 	eventFuncMaps     map[*ebpf.Map]event.IEventStruct
 	eventMaps         []*ebpf.Map
 	hookBpfFile       string
+	brkFds            []int
 }
 
 func (this *PerfBRK) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
@@ -33,6 +41,8 @@ func (this *PerfBRK) Init(ctx context.Context, logger *log.Logger, conf config.I
 	this.eventMaps = make([]*ebpf.Map, 0, 2)
 	this.eventFuncMaps = make(map[*ebpf.Map]event.IEventStruct)
 	this.hookBpfFile = "perf_mmap.o"
+	// 断点上的 perf_event 程序不通过 Probes 挂载
+	this.statsProgs = []string{"perf_event_handler"}
 	return nil
 }
 func (this *PerfBRK) setupManager() error {
@@ -44,11 +54,8 @@ func (this *PerfBRK) setupManager() error {
 	}
 	maps = append(maps, events_map)
 
-	// perf_probe := &manager.Probe{
-	// 	Section:      "perf_event",
-	// 	EbpfFuncName: "perf_event_handler",
-	// }
-	// probes = append(probes, perf_probe)
+	// 多断点模式下 perf_event 程序不通过 manager 挂载
+	// 而是在 openBrkPoints 中逐个断点设置
 
 	this.bpfManager = &manager.Manager{
 		Probes: probes,
@@ -61,7 +68,7 @@ func (this *PerfBRK) setupManagerOptions() {
 	if this.mconf.ExternalBTF != "" {
 		byteBuf, err := assets.Asset("user/assets/" + this.mconf.ExternalBTF)
 		if err != nil {
-			this.logger.Fatalf("[setupManagerOptions] failed, err:%v", err)
+			this.fatalf("[setupManagerOptions] failed, err:%v", err)
 			return
 		}
 		spec, err := btf.LoadSpecFromReader((bytes.NewReader(byteBuf)))
@@ -135,9 +142,255 @@ func (this *PerfBRK) start() error {
 	if err != nil {
 		return err
 	}
+	if len(this.mconf.BrkPoints) > 0 {
+		err = this.updateBrkConfig(0)
+		if err != nil {
+			return err
+		}
+		err = this.updateBrkConds()
+		if err != nil {
+			return err
+		}
+		err = this.openBrkPoints()
+		if err != nil {
+			return err
+		}
+		go this.waitSampleRequest()
+	}
+	return nil
+}
+
+func (this *PerfBRK) BpfManager() *manager.Manager {
+	return this.bpfManager
+}
+
+func (this *PerfBRK) FindMap(map_name string) (*ebpf.Map, error) {
+	em, found, err := this.bpfManager.GetMap(map_name)
+	if err != nil {
+		return em, err
+	}
+	if !found {
+		return em, errors.New(fmt.Sprintf("cannot find map:%s", map_name))
+	}
+	return em, err
+}
+
+func (this *PerfBRK) updateBrkConfig(extra_samples int64) error {
+	map_name := "brk_config"
+	bpf_map, err := this.FindMap(map_name)
+	if err != nil {
+		return err
+	}
+	var filter_key uint32 = 0
+	filter_value := this.mconf.GetBrkConfigMap(extra_samples)
+	err = bpf_map.Update(unsafe.Pointer(&filter_key), unsafe.Pointer(&filter_value), ebpf.UpdateAny)
+	if err != nil {
+		return fmt.Errorf("update [%s] failed, err:%v", map_name, err)
+	}
+	return nil
+}
+
+// 断点条件在 eBPF 程序中按断点地址查找
+func (this *PerfBRK) updateBrkConds() error {
+	map_name := "brk_conds"
+	bpf_map, err := this.FindMap(map_name)
+	if err != nil {
+		return err
+	}
+	for _, point := range this.mconf.BrkPoints {
+		if point.Cond == nil {
+			continue
+		}
+		filter_key := point.Addr
+		err = bpf_map.Update(unsafe.Pointer(&filter_key), unsafe.Pointer(point.Cond), ebpf.UpdateAny)
+		if err != nil {
+			return fmt.Errorf("update [%s] failed, err:%v", map_name, err)
+		}
+	}
+	return nil
+}
+
+// 收到 SIGUSR1 时 再输出 N 次完整事件
+func (this *PerfBRK) waitSampleRequest() {
+	ch := make(chan os.Signal, 1)
+	signal.Notify(ch, syscall.SIGUSR1)
+	defer signal.Stop(ch)
+	for {
+		select {
+		case <-this.ctx.Done():
+			return
+		case <-ch:
+			err := this.updateBrkConfig(int64(this.mconf.BrkLimit))
+			if err != nil {
+				this.logger.Printf("request samples failed, err:%v", err)
+				continue
+			}
+			this.logger.Printf("request %d more samples", this.mconf.BrkLimit)
+		}
+	}
+}
+
+func (this *PerfBRK) brkTargets(point *config.BrkPoint) (pids []int, cpus []int, err error) {
+	// 内核地址的断点需要在每个 cpu 上设置
+	if point.IsKernel() {
+		for cpu := 0; cpu < runtime.NumCPU(); cpu++ {
+			pids = append(pids, -1)
+			cpus = append(cpus, cpu)
+		}
+		return pids, cpus, nil
+	}
+	if this.mconf.BrkPid <= 0 {
+		return nil, nil, errors.New("must set --brk-pid for user space breakpoint")
+	}
+	// 按线程设置 之后创建的线程通过 inherit 继承
+	entries, err := os.ReadDir(fmt.Sprintf("/proc/%d/task", this.mconf.BrkPid))
+	if err != nil {
+		return nil, nil, err
+	}
+	for _, entry := range entries {
+		tid, err := strconv.Atoi(entry.Name())
+		if err != nil {
+			continue
+		}
+		pids = append(pids, tid)
+		cpus = append(cpus, -1)
+	}
+	return pids, cpus, nil
+}
+
+// 每个地址一个硬件断点 都挂上同一个 perf_event 程序
+// 断点槽位用完时 perf_event_open 返回 ENOSPC 剩下的地址不再设置
+func (this *PerfBRK) closeBrkFds(fds []int) {
+	for _, fd := range fds {
+		unix.Close(fd)
+	}
+}
+
+// 出错时已经打开的 perf_event 全部关闭 不能只关当前断点的
+func (this *PerfBRK) openBrkPoints() (err error) {
+	defer func() {
+		if err != nil {
+			this.closeBrkFds(this.brkFds)
+			this.brkFds = nil
+		}
+	}()
+	progs, found, err := this.bpfManager.GetProgram(manager.ProbeIdentificationPair{EbpfFuncName: "perf_event_handler"})
+	if err != nil {
+		return err
+	}
+	if !found || len(progs) == 0 {
+		return errors.New("cannot find program:perf_event_handler")
+	}
+	prog_fd := progs[0].FD()
+	for i, point := range this.mconf.BrkPoints {
+		pids, cpus, err := this.brkTargets(point)
+		if err != nil {
+			return err
+		}
+		attr := unix.PerfEventAttr{
+			Type:    unix.PERF_TYPE_BREAKPOINT,
+			Sample:  1,
+			Bp_type: point.Type,
+			Ext1:    point.Addr,
+			Ext2:    point.Len,
+			Bits:    unix.PerfBitDisabled,
+		}
+		attr.Size = uint32(unsafe.Sizeof(attr))
+		if !point.IsKernel() {
+			attr.Bits |= unix.PerfBitInherit | unix.PerfBitExcludeKernel | unix.PerfBitExcludeHv
+		}
+		var fds []int
+		for j := range pids {
+			fd, err := unix.PerfEventOpen(&attr, pids[j], cpus[j], -1, unix.PERF_FLAG_FD_CLOEXEC)
+			if err == nil {
+				fds = append(fds, fd)
+				continue
+			}
+			if errors.Is(err, unix.ESRCH) {
+				// 线程已经退出
+				continue
+			}
+			this.closeBrkFds(fds)
+			if errors.Is(err, unix.ENOSPC) {
+				// 之前的断点已经生效 保留
+				this.logger.Printf("no free hardware breakpoint slot, set %d/%d breakpoints", i, len(this.mconf.BrkPoints))
+				return nil
+			}
+			return fmt.Errorf("set breakpoint %s failed, err:%v", point.String(), err)
+		}
+		for _, fd := range fds {
+			if err := unix.IoctlSetInt(fd, unix.PERF_EVENT_IOC_SET_BPF, prog_fd); err != nil {
+				this.closeBrkFds(fds)
+				return fmt.Errorf("attach breakpoint %s failed, err:%v", point.String(), err)
+			}
+			if err := unix.IoctlSetInt(fd, unix.PERF_EVENT_IOC_ENABLE, 0); err != nil {
+				this.closeBrkFds(fds)
+				return fmt.Errorf("enable breakpoint %s failed, err:%v", point.String(), err)
+			}
+		}
+		this.brkFds = append(this.brkFds, fds...)
+		if this.mconf.Debug {
+			this.logger.Printf("set breakpoint %s, perf_event count:%d", point.String(), len(fds))
+		}
+	}
 	return nil
 }
 
+type brkHitKey struct {
+	Addr uint64
+	Pc   uint64
+}
+
+type brkHit struct {
+	Pc    uint64
+	Count uint64
+}
+
+// 输出每个断点的命中次数 以及命中次数最多的调用位置
+func (this *PerfBRK) dumpBrkHits() {
+	addr_map, err := this.FindMap("brk_addr_hits")
+	if err != nil {
+		this.logger.Printf("dump breakpoint hits failed, err:%v", err)
+		return
+	}
+	hits_map, err := this.FindMap("brk_hits")
+	if err != nil {
+		this.logger.Printf("dump breakpoint hits failed, err:%v", err)
+		return
+	}
+	pc_hits := make(map[uint64][]brkHit)
+	var key brkHitKey
+	var count uint64
+	iter := hits_map.Iterate()
+	for iter.Next(&key, &count) {
+		pc_hits[key.Addr] = append(pc_hits[key.Addr], brkHit{key.Pc, count})
+	}
+	for _, point := range this.mconf.BrkPoints {
+		var total uint64 = 0
+		addr_map.Lookup(&point.Addr, &total)
+		this.logger.Printf("breakpoint %s hit_count:%d", point.String(), total)
+		hits := pc_hits[point.Addr]
+		sort.Slice(hits, func(i, j int) bool {
+			return hits[i].Count > hits[j].Count
+		})
+		for i, hit := range hits {
+			if i >= 10 {
+				this.logger.Printf("\t... %d more pc", len(hits)-i)
+				break
+			}
+			this.logger.Printf("\tpc:0x%x count:%d", hit.Pc, hit.Count)
+		}
+	}
+}
+
+func (this *PerfBRK) Close() error {
+	if len(this.mconf.BrkPoints) > 0 {
+		this.dumpBrkHits()
+		this.closeBrkFds(this.brkFds)
+	}
+	return this.Module.Close()
+}
+
 func (this *PerfBRK) initDecodeFun() (err error) {
 	map_name := "brk_events"
 	BrkEventsMap, found, err := this.bpfManager.GetMap(map_name)
@@ -149,9 +402,16 @@ func (this *PerfBRK) initDecodeFun() (err error) {
 	}
 
 	this.eventMaps = append(this.eventMaps, BrkEventsMap)
-	brkEvent := &event.BrkEvent{}
-	brkEvent.SetConf(this.mconf)
-	this.eventFuncMaps[BrkEventsMap] = brkEvent
+	if len(this.mconf.BrkPoints) > 0 {
+		// 多断点模式下的事件由 eBPF 程序输出
+		brkHitEvent := &event.BrkHitEvent{}
+		brkHitEvent.SetConf(this.mconf)
+		this.eventFuncMaps[BrkEventsMap] = brkHitEvent
+	} else {
+		brkEvent := &event.BrkEvent{}
+		brkEvent.SetConf(this.mconf)
+		this.eventFuncMaps[BrkEventsMap] = brkEvent
+	}
 
 	return nil
 }
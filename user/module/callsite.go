@@ -0,0 +1,58 @@
+package module
+
+import (
+    "errors"
+    "stackplz/user/event"
+
+    "github.com/cilium/ebpf"
+)
+
+// 与 callsite_key_t 一致
+type callsiteKey struct {
+    Pc      uint64
+    Lr      uint64
+    Tgid    uint32
+    EventId uint32
+    Point   uint32
+    Padding uint32
+}
+
+// 与 callsite_t 一致
+type callsiteValue struct {
+    Id   uint32
+    Hits uint32
+}
+
+// 带栈的事件丢失后 删除内核中对应的调用点
+// 下次命中时内核会分配新的 id 并重新取栈 之后的事件不会一直没有栈
+func (this *Module) setupCallsiteLost(find func(string) (*ebpf.Map, error)) error {
+    bpf_map, err := find("callsite_map")
+    if err != nil {
+        return err
+    }
+    event.SetCallsiteLostReporter(func(ids []uint32) {
+        lost := make(map[uint32]bool, len(ids))
+        for _, id := range ids {
+            lost[id] = true
+        }
+        var drop []callsiteKey
+        var key callsiteKey
+        var value callsiteValue
+        iter := bpf_map.Iterate()
+        for iter.Next(&key, &value) {
+            if lost[value.Id] {
+                drop = append(drop, key)
+            }
+        }
+        if err := iter.Err(); err != nil {
+            this.logger.Printf("callsite iterate failed, err:%v", err)
+        }
+        // 遍历过程中删除会让遍历从头开始 所以放到遍历之后
+        for i := range drop {
+            if err := bpf_map.Delete(&drop[i]); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+                this.logger.Printf("callsite delete failed, err:%v", err)
+            }
+        }
+    })
+    return nil
+}
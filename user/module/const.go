@@ -9,10 +9,17 @@ const (
 )
 
 const (
-    MODULE_NAME_PERF    = "PerfMod"
-    MODULE_NAME_BRK     = "BrkMod"
-    MODULE_NAME_STACK   = "StackMod"
-    MODULE_NAME_SYSCALL = "SyscallMod"
+    MODULE_NAME_PERF     = "PerfMod"
+    MODULE_NAME_BRK      = "BrkMod"
+    MODULE_NAME_STACK    = "StackMod"
+    MODULE_NAME_SYSCALL  = "SyscallMod"
+    MODULE_NAME_UNIFIED  = "UnifiedMod"
+    MODULE_NAME_PROFILE  = "ProfileMod"
+    MODULE_NAME_HEAP     = "HeapMod"
+    MODULE_NAME_LOCK     = "LockMod"
+    MODULE_NAME_COUNT    = "CountMod"
+    MODULE_NAME_OFFCPU   = "OffcpuMod"
+    MODULE_NAME_IO_URING = "IoUringMod"
 )
 
 const (
@@ -20,6 +27,9 @@ const (
     THREAD_NAME_BLACKLIST uint32 = 2
 )
 
+// 内核中 KRETPROBE_MAXACTIVE_MAX 的值 更大的 maxactive 会被拒绝
+const KRETPROBE_MAXACTIVE = 4096
+
 // http://aospxref.com/android-11.0.0_r21/xref/bionic/libc/kernel/uapi/asm-arm/asm/perf_regs.h
 const (
     PERF_REG_ARM_R0 uint32 = iota
@@ -0,0 +1,172 @@
+package module
+
+import (
+    "context"
+    "fmt"
+    "log"
+    "path/filepath"
+    "sort"
+    "stackplz/user/config"
+    "stackplz/user/event"
+    "strings"
+    "time"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+const COUNT_MAX_ROWS = 30
+
+// 与 count_key_t 一致
+type countKey struct {
+    Pc      uint64
+    Lr      uint64
+    Tgid    uint32
+    Padding uint32
+}
+
+type countSym struct {
+    lib string
+    off uint64
+}
+
+type countRow struct {
+    key   countKey
+    total uint64
+    delta uint64
+}
+
+// 对大量符号只在内核中计数 定期输出命中最多的函数
+// 复用 MSyscall 的过滤设定 只加载 count.o
+type MCount struct {
+    MSyscall
+    symbols map[countSym]string
+    // 上一次输出时的累计值
+    last map[countKey]uint64
+}
+
+func (this *MCount) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "count.o"
+    // 按 (库名, 文件偏移) 反查符号 与 maps 中的信息对应
+    this.symbols = make(map[countSym]string)
+    this.last = make(map[countKey]uint64)
+    for _, point := range this.mconf.CountPoints {
+        this.symbols[countSym{filepath.Base(point.LibPath), point.FileOff}] = point.Symbol
+    }
+    return nil
+}
+
+// 所有符号共用同一个程序 通过 UID 区分
+// 直接给出地址 挂载时不用每次重新解析库的符号表
+func (this *MCount) countProbes() []*manager.Probe {
+    probes := []*manager.Probe{}
+    for i, point := range this.mconf.CountPoints {
+        count_probe := &manager.Probe{
+            UID:              fmt.Sprintf("count_%d", i),
+            Section:          "uprobe/count",
+            EbpfFuncName:     "probe_count",
+            AttachToFuncName: point.Symbol,
+            BinaryPath:       point.LibPath,
+            UAddress:         point.Offset,
+        }
+        if this.mconf.Debug {
+            this.logger.Printf("count_index:%d hook %s", i, point.String())
+        }
+        probes = append(probes, count_probe)
+    }
+    return probes
+}
+
+func (this *MCount) Start() error {
+    return this.start()
+}
+
+func (this *MCount) Clone() IModule {
+    mod := new(MCount)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+func (this *MCount) start() error {
+    err := this.startAggregate(this.countProbes())
+    if err != nil {
+        return err
+    }
+    go this.dumpLoop(this.mconf.Count, "count", this.dumpCount)
+    return nil
+}
+
+func (this *MCount) symbolize(pid uint32, addr uint64) string {
+    lib, off, ok := event.GetAddrLibOffset(pid, addr)
+    if ok {
+        if sym, found := this.symbols[countSym{lib, off}]; found {
+            return fmt.Sprintf("%s!%s", lib, sym)
+        }
+    }
+    return event.GetAddrOffset(pid, addr)
+}
+
+// 内核中的计数是累计值 每个周期按与上一次的差值排序输出
+func (this *MCount) dumpCount() error {
+    bpf_map, err := this.FindMap("count_hits")
+    if err != nil {
+        return err
+    }
+    var rows []countRow
+    var total_delta uint64
+    var key countKey
+    var percpu_counts []uint64
+    iter := bpf_map.Iterate()
+    for iter.Next(&key, &percpu_counts) {
+        var total uint64
+        for _, v := range percpu_counts {
+            total += v
+        }
+        delta := total - this.last[key]
+        this.last[key] = total
+        if delta == 0 {
+            continue
+        }
+        total_delta += delta
+        rows = append(rows, countRow{key, total, delta})
+    }
+    if err := iter.Err(); err != nil {
+        return err
+    }
+    sort.Slice(rows, func(i, j int) bool {
+        return rows[i].delta > rows[j].delta
+    })
+    var b strings.Builder
+    b.WriteString(fmt.Sprintf("[count] %s hits:%d functions:%d\n", time.Now().Format("15:04:05"), total_delta, len(rows)))
+    b.WriteString(fmt.Sprintf("%10s %12s %8s  %s\n", "HITS", "TOTAL", "PID", "SYMBOL"))
+    for i, row := range rows {
+        if i >= COUNT_MAX_ROWS {
+            break
+        }
+        b.WriteString(fmt.Sprintf("%10d %12d %8d  %s", row.delta, row.total, row.key.Tgid, this.symbolize(row.key.Tgid, row.key.Pc)))
+        if this.mconf.CountCaller {
+            b.WriteString(fmt.Sprintf(" <- %s", event.GetAddrOffset(row.key.Tgid, row.key.Lr)))
+        }
+        b.WriteString("\n")
+    }
+    this.logger.Print(b.String())
+    return nil
+}
+
+// 退出前再输出一次 最后一个周期内的计数不会丢失
+func (this *MCount) Close() error {
+    err := this.dumpCount()
+    if err != nil {
+        this.logger.Printf("dump count failed, err:%v", err)
+    }
+    return this.Module.Close()
+}
+
+func init() {
+    mod := &MCount{}
+    mod.name = MODULE_NAME_COUNT
+    mod.mType = PROBE_TYPE_UPROBE
+    Register(mod)
+}
@@ -0,0 +1,180 @@
+package module
+
+import (
+    "bytes"
+    "encoding/binary"
+    "fmt"
+    "net"
+    "sort"
+    "strings"
+    "syscall"
+    "time"
+    "unsafe"
+)
+
+// 与 flow_stat_t 一致 key 仍然是 io_key_t
+type flowStat struct {
+    TxBytes uint64
+    TxPkts  uint64
+    RxBytes uint64
+    RxPkts  uint64
+    FirstTs uint64
+    LastTs  uint64
+    Closed  uint32
+    PeerLen uint32
+    Peer    [128]byte
+}
+
+type flowRow struct {
+    key   ioKey
+    stat  flowStat
+    delta flowStat
+}
+
+const FLOW_MAX_ROWS = 20
+
+func formatPeer(peer []byte) string {
+    if len(peer) < 2 {
+        return "?"
+    }
+    family := binary.LittleEndian.Uint16(peer[0:2])
+    switch family {
+    case syscall.AF_INET:
+        if len(peer) < 8 {
+            return "?"
+        }
+        port := binary.BigEndian.Uint16(peer[2:4])
+        return fmt.Sprintf("%s:%d", net.IP(peer[4:8]).String(), port)
+    case syscall.AF_INET6:
+        if len(peer) < 24 {
+            return "?"
+        }
+        port := binary.BigEndian.Uint16(peer[2:4])
+        return fmt.Sprintf("[%s]:%d", net.IP(peer[8:24]).String(), port)
+    case syscall.AF_UNIX:
+        path := peer[2:]
+        abstract := len(path) > 0 && path[0] == 0
+        if abstract {
+            path = path[1:]
+        }
+        if i := bytes.IndexByte(path, 0); i >= 0 {
+            path = path[:i]
+        }
+        if abstract {
+            return "@" + string(path)
+        }
+        return string(path)
+    default:
+        return fmt.Sprintf("family=%d", family)
+    }
+}
+
+// 与 flow_closed_key_t 一致
+type flowClosedKey struct {
+    Tgid    uint32
+    Fd      uint32
+    FirstTs uint64
+}
+
+func flowDelta(stat, prev *flowStat) flowStat {
+    delta := *stat
+    // fd 复用后是新的连接
+    if prev.FirstTs != stat.FirstTs {
+        return delta
+    }
+    delta.TxBytes -= prev.TxBytes
+    delta.TxPkts -= prev.TxPkts
+    delta.RxBytes -= prev.RxBytes
+    delta.RxPkts -= prev.RxPkts
+    return delta
+}
+
+// 内核中的计数是累计值 每个周期输出与上一次的差值
+// 连接关闭时内核把记录移到 flow_closed 其 key 带有 first_ts
+// 输出最后一次之后按这个 key 删除 不会误删同一个 fd 上新建立的连接
+func (this *MSyscall) flowLoop() {
+    bpf_map, err := this.FindMap("flow_stats")
+    if err != nil {
+        this.logger.Printf("flow failed, err:%v", err)
+        return
+    }
+    closed_map, err := this.FindMap("flow_closed")
+    if err != nil {
+        this.logger.Printf("flow failed, err:%v", err)
+        return
+    }
+    interval := time.Duration(this.mconf.Flow) * time.Second
+    ticker := time.NewTicker(interval)
+    defer ticker.Stop()
+    last := make(map[ioKey]flowStat)
+    for {
+        select {
+        case <-this.ctx.Done():
+            return
+        case <-ticker.C:
+        }
+        // 先处理已关闭的连接 这时 last 中还是它的上一次统计
+        var rows []flowRow
+        var key ioKey
+        var stat flowStat
+        var closed []flowClosedKey
+        var closed_key flowClosedKey
+        iter := closed_map.Iterate()
+        for iter.Next(&closed_key, &stat) {
+            key = ioKey{closed_key.Tgid, closed_key.Fd}
+            prev := last[key]
+            delta := flowDelta(&stat, &prev)
+            if prev.FirstTs == stat.FirstTs {
+                delete(last, key)
+            }
+            closed = append(closed, closed_key)
+            rows = append(rows, flowRow{key, stat, delta})
+        }
+        if err := iter.Err(); err != nil {
+            this.logger.Printf("flow iterate failed, err:%v", err)
+            continue
+        }
+        for i := range closed {
+            closed_map.Delete(unsafe.Pointer(&closed[i]))
+        }
+        iter = bpf_map.Iterate()
+        for iter.Next(&key, &stat) {
+            prev := last[key]
+            delta := flowDelta(&stat, &prev)
+            last[key] = stat
+            if delta.TxPkts+delta.RxPkts == 0 {
+                continue
+            }
+            rows = append(rows, flowRow{key, stat, delta})
+        }
+        if err := iter.Err(); err != nil {
+            this.logger.Printf("flow iterate failed, err:%v", err)
+            continue
+        }
+        sort.Slice(rows, func(i, j int) bool {
+            return rows[i].delta.TxBytes+rows[i].delta.RxBytes > rows[j].delta.TxBytes+rows[j].delta.RxBytes
+        })
+        var b strings.Builder
+        b.WriteString(fmt.Sprintf("[flow] %s\n", time.Now().Format("15:04:05")))
+        b.WriteString(fmt.Sprintf("%8s %5s %8s %12s %8s %12s %12s %12s %6s  %s\n", "PID", "FD", "TX_PKTS", "TX_BYTES", "RX_PKTS", "RX_BYTES", "TX_TOTAL", "RX_TOTAL", "STATE", "PEER"))
+        for i, row := range rows {
+            if i >= FLOW_MAX_ROWS {
+                break
+            }
+            state := "open"
+            if row.stat.Closed == 1 {
+                state = "closed"
+            }
+            peer_len := row.stat.PeerLen
+            if peer_len > uint32(len(row.stat.Peer)) {
+                peer_len = uint32(len(row.stat.Peer))
+            }
+            peer := "?"
+            if peer_len > 0 {
+                peer = formatPeer(row.stat.Peer[:peer_len])
+            }
+            b.WriteString(fmt.Sprintf("%8d %5d %8d %12d %8d %12d %12d %12d %6s  %s\n", row.key.Tgid, row.key.Fd, row.delta.TxPkts, row.delta.TxBytes, row.delta.RxPkts, row.delta.RxBytes, row.stat.TxBytes, row.stat.RxBytes, state, peer))
+        }
+        this.logger.Print(b.String())
+    }
+}
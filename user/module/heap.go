@@ -0,0 +1,162 @@
+package module
+
+import (
+    "context"
+    "fmt"
+    "log"
+    "sort"
+    "stackplz/user/config"
+    "strings"
+    "time"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+const HEAP_MAX_ROWS = 20
+
+// 每个栈最多输出的帧数 更深的省略
+const HEAP_MAX_FRAMES = 16
+
+// 与 heap_key_t 一致
+type heapKey struct {
+    Tgid        uint32
+    UserStackId int32
+}
+
+// 与 heap_stat_t 一致
+type heapStat struct {
+    Bytes uint64
+    Count uint64
+}
+
+type heapRow struct {
+    key  heapKey
+    stat heapStat
+}
+
+// 在内核中记录 malloc/calloc/realloc/free 只定期输出按栈聚合的未释放内存
+// 复用 MSyscall 的过滤设定 只加载 heap.o
+type MHeap struct {
+    MSyscall
+}
+
+func (this *MHeap) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "heap.o"
+    return nil
+}
+
+func (this *MHeap) heapProbes() []*manager.Probe {
+    probes := []*manager.Probe{}
+    lib_path := this.mconf.LibcPath
+    for _, sym := range []string{"malloc", "calloc", "realloc"} {
+        enter_probe := &manager.Probe{
+            UID:              fmt.Sprintf("heap_%s", sym),
+            Section:          fmt.Sprintf("uprobe/heap_%s", sym),
+            EbpfFuncName:     fmt.Sprintf("probe_heap_%s", sym),
+            AttachToFuncName: sym,
+            BinaryPath:       lib_path,
+        }
+        // 同一个返回点程序挂到多个函数 通过 UID 区分
+        ret_probe := &manager.Probe{
+            UID:              fmt.Sprintf("heap_%s_ret", sym),
+            Section:          "uretprobe/heap_ret",
+            EbpfFuncName:     "probe_heap_ret",
+            AttachToFuncName: sym,
+            BinaryPath:       lib_path,
+        }
+        probes = append(probes, enter_probe, ret_probe)
+    }
+    free_probe := &manager.Probe{
+        UID:              "heap_free",
+        Section:          "uprobe/heap_free",
+        EbpfFuncName:     "probe_heap_free",
+        AttachToFuncName: "free",
+        BinaryPath:       lib_path,
+    }
+    probes = append(probes, free_probe)
+    if this.mconf.Debug {
+        this.logger.Printf("heap hook malloc/calloc/realloc/free in %s", lib_path)
+    }
+    return probes
+}
+
+func (this *MHeap) Start() error {
+    return this.start()
+}
+
+func (this *MHeap) Clone() IModule {
+    mod := new(MHeap)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+func (this *MHeap) start() error {
+    err := this.startAggregate(this.heapProbes())
+    if err != nil {
+        return err
+    }
+    go this.dumpLoop(this.mconf.Heap, "heap", this.dumpOutstanding)
+    return nil
+}
+
+// 按栈输出未释放的字节数 从大到小 只输出前 HEAP_MAX_ROWS 个栈
+// 聚合在内核中完成 这里只读取不修改
+func (this *MHeap) dumpOutstanding() error {
+    outstanding_map, err := this.FindMap("heap_outstanding")
+    if err != nil {
+        return err
+    }
+    stacks_map, err := this.FindMap("heap_stacks")
+    if err != nil {
+        return err
+    }
+    var rows []heapRow
+    var total heapStat
+    var key heapKey
+    var stat heapStat
+    iter := outstanding_map.Iterate()
+    for iter.Next(&key, &stat) {
+        // 已经全部释放的栈不输出
+        if stat.Count == 0 || int64(stat.Bytes) <= 0 {
+            continue
+        }
+        total.Bytes += stat.Bytes
+        total.Count += stat.Count
+        rows = append(rows, heapRow{key, stat})
+    }
+    if err := iter.Err(); err != nil {
+        return err
+    }
+    sort.Slice(rows, func(i, j int) bool {
+        return rows[i].stat.Bytes > rows[j].stat.Bytes
+    })
+    var b strings.Builder
+    b.WriteString(fmt.Sprintf("[heap] %s outstanding %d bytes in %d allocations, %d stacks\n", time.Now().Format("15:04:05"), total.Bytes, total.Count, len(rows)))
+    for i, row := range rows {
+        if i >= HEAP_MAX_ROWS {
+            break
+        }
+        b.WriteString(fmt.Sprintf("%12d bytes %8d allocs  pid:%d\n", row.stat.Bytes, row.stat.Count, row.key.Tgid))
+        writeStackId(&b, stacks_map, row.key.Tgid, row.key.UserStackId, HEAP_MAX_FRAMES)
+    }
+    this.logger.Print(b.String())
+    return nil
+}
+
+func (this *MHeap) Close() error {
+    err := this.dumpOutstanding()
+    if err != nil {
+        this.logger.Printf("dump heap failed, err:%v", err)
+    }
+    return this.Module.Close()
+}
+
+func init() {
+    mod := &MHeap{}
+    mod.name = MODULE_NAME_HEAP
+    mod.mType = PROBE_TYPE_UPROBE
+    Register(mod)
+}
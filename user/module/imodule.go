@@ -10,6 +10,7 @@ import (
     "stackplz/user/config"
     "stackplz/user/event"
     "stackplz/user/event_processor"
+    "stackplz/user/util"
 
     "github.com/cilium/ebpf"
     "github.com/cilium/ebpf/perf"
@@ -66,6 +67,9 @@ type Module struct {
     processor *event_processor.EventProcessor
 
     TotalLost uint64
+
+    // 不通过 Probes 挂载的程序 比如 perf_event 上的 profile_handler bpf 统计时额外读取
+    statsProgs []string
 }
 
 // Init 对象初始化
@@ -79,7 +83,10 @@ func (this *Module) Init(ctx context.Context, logger *log.Logger, conf config.IC
         this.mconf = p
     }
     this.processor = event_processor.NewEventProcessor(logger)
-
+    // 同一个线程的事件分散在多个 perf map 中时 按时间排序后输出
+    if len(this.mconf.StackEventMaps()) > 0 {
+        this.processor.SetReorder(event_processor.REORDER_WINDOW)
+    }
 }
 
 func (this *Module) Clone() IModule {
@@ -113,10 +120,12 @@ func (this *Module) Name() string {
 func (this *Module) Run() error {
     // this.logger.Printf("%s\tModule.Run()", this.Name())
     //  加载全部eBPF程序
+    this.enableBpfStats()
     err := this.child.Start()
     if err != nil {
         return err
     }
+    this.startBpfStats()
 
     // 不断检查是否有外部导致的终止，有则停止加载的模块并退出
     go func() {
@@ -147,13 +156,19 @@ func (this *Module) run() {
         case _ = <-this.ctx.Done():
             err := this.child.Stop()
             if err != nil {
-                this.logger.Fatalf("%s\t stop Module error:%v.", this.child.Name(), err)
+                this.fatalf("%s\t stop Module error:%v.", this.child.Name(), err)
             }
             return
         }
     }
 }
 
+// 退出之前恢复 bpf_stats_enabled
+func (this *Module) fatalf(format string, v ...interface{}) {
+    util.RestoreBpfStats()
+    this.logger.Fatalf(format, v...)
+}
+
 func (this *Module) readEvents() error {
     var errChan = make(chan error, 8)
     // 随时记录读取事件过程中的异常情况
@@ -183,6 +198,7 @@ func (this *Module) getExtraOptions(em *ebpf.Map) perf.ExtraPerfOptions {
     map_value := reflect.ValueOf(em)
     map_name := map_value.Elem().FieldByName("name")
     IsMmapEvent := map_name.String() == "fake_events"
+    UnwindStack, StackSize := this.mconf.GetStackSample(map_name.String())
 
     // http://aospxref.com/android-11.0.0_r21/xref/system/extras/simpleperf/perf_regs.cpp#82
     var RegMask uint64
@@ -204,7 +220,7 @@ func (this *Module) getExtraOptions(em *ebpf.Map) perf.ExtraPerfOptions {
         BrkPid = -1
     }
     return perf.ExtraPerfOptions{
-        UnwindStack:       this.mconf.UnwindStack,
+        UnwindStack:       UnwindStack,
         ShowRegs:          ShowRegs,
         PerfMmap:          IsMmapEvent,
         BrkPid:            BrkPid,
@@ -212,7 +228,7 @@ func (this *Module) getExtraOptions(em *ebpf.Map) perf.ExtraPerfOptions {
         BrkLen:            this.mconf.BrkLen,
         BrkType:           this.mconf.BrkType,
         Sample_regs_user:  RegMask,
-        Sample_stack_user: this.mconf.StackSize,
+        Sample_stack_user: StackSize,
     }
 }
 
@@ -260,6 +276,8 @@ func (this *Module) perfEventReader(errChan chan error, em *ebpf.Map) {
             if record.LostSamples != 0 {
                 this.TotalLost += record.LostSamples
                 this.logger.Printf("%s\tperf event ring buffer full, dropped %d samples, record_type:%d", this.child.Name(), record.LostSamples, record.RecordType)
+                // 丢失的事件可能停住了进程 不会再有对应的恢复
+                event.ResumeLostStops()
                 continue
             }
 
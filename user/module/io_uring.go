@@ -0,0 +1,96 @@
+package module
+
+import (
+    "context"
+    "log"
+    "stackplz/user/config"
+    "stackplz/user/event"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// 挂载 io_uring 的提交和完成 在内核中配对 输出每个请求的参数 结果和耗时
+// 复用 MSyscall 的过滤设定 只加载 io_uring.o 可以和 syscall 追踪同时运行
+type MIoUring struct {
+    MSyscall
+}
+
+func (this *MIoUring) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "io_uring.o"
+    return nil
+}
+
+func (this *MIoUring) ioUringProbes() []*manager.Probe {
+    submit_probe := &manager.Probe{
+        Section:      "raw_tracepoint/io_uring_submit_sqe",
+        EbpfFuncName: "tracepoint__io_uring__io_uring_submit_sqe",
+    }
+    complete_probe := &manager.Probe{
+        Section:      "raw_tracepoint/io_uring_complete",
+        EbpfFuncName: "tracepoint__io_uring__io_uring_complete",
+    }
+    return []*manager.Probe{submit_probe, complete_probe}
+}
+
+func (this *MIoUring) Start() error {
+    return this.start()
+}
+
+func (this *MIoUring) Clone() IModule {
+    mod := new(MIoUring)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+func (this *MIoUring) start() error {
+    err := this.startAggregate(this.ioUringProbes(), "io_uring_events")
+    if err != nil {
+        return err
+    }
+    return this.initDecodeFun()
+}
+
+// 相同 (ring, user_data) 的请求在完成之前再次提交的次数 前一个请求不会输出
+func (this *MIoUring) ioUringCollisions() uint64 {
+    collisions_map, err := this.FindMap("io_uring_collisions")
+    if err != nil {
+        return 0
+    }
+    var zero uint32 = 0
+    var percpu_collisions []uint64
+    if err := collisions_map.Lookup(&zero, &percpu_collisions); err != nil {
+        return 0
+    }
+    var total uint64
+    for _, v := range percpu_collisions {
+        total += v
+    }
+    return total
+}
+
+func (this *MIoUring) Close() error {
+    if collisions := this.ioUringCollisions(); collisions > 0 {
+        this.logger.Printf("io_uring user_data collisions:%d, the earlier requests were not reported", collisions)
+    }
+    return this.Module.Close()
+}
+
+func (this *MIoUring) initDecodeFun() error {
+    EventsMap, err := this.FindMap("io_uring_events")
+    if err != nil {
+        return err
+    }
+    this.eventMaps = append(this.eventMaps, EventsMap)
+    this.eventFuncMaps[EventsMap] = &event.IoUringEvent{}
+    return nil
+}
+
+func init() {
+    mod := &MIoUring{}
+    mod.name = MODULE_NAME_IO_URING
+    mod.mType = PROBE_TYPE_TRACEPOINT
+    Register(mod)
+}
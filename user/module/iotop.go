@@ -0,0 +1,139 @@
+package module
+
+import (
+    "errors"
+    "fmt"
+    "os"
+    "sort"
+    "strings"
+    "time"
+
+    "github.com/cilium/ebpf"
+)
+
+// 与 io_key_t io_stat_t 一致
+type ioKey struct {
+    Tgid uint32
+    Fd   uint32
+}
+
+type ioStat struct {
+    RdOps     uint64
+    RdBytes   uint64
+    WrOps     uint64
+    WrBytes   uint64
+    Errors    uint64
+    LatencyNs uint64
+}
+
+func (this *ioStat) add(other *ioStat) {
+    this.RdOps += other.RdOps
+    this.RdBytes += other.RdBytes
+    this.WrOps += other.WrOps
+    this.WrBytes += other.WrBytes
+    this.Errors += other.Errors
+    this.LatencyNs += other.LatencyNs
+}
+
+func (this *ioStat) sub(other *ioStat) {
+    this.RdOps -= other.RdOps
+    this.RdBytes -= other.RdBytes
+    this.WrOps -= other.WrOps
+    this.WrBytes -= other.WrBytes
+    this.Errors -= other.Errors
+    this.LatencyNs -= other.LatencyNs
+}
+
+type ioRow struct {
+    key  ioKey
+    stat ioStat
+}
+
+const IOTOP_MAX_ROWS = 20
+
+// fd 对应的路径只在第一次出现时读取
+// 一个周期内没有读写的 fd 会连同路径一起删除 之后复用时重新读取
+func (this *MSyscall) ioPath(key ioKey, paths map[ioKey]string) string {
+    path, ok := paths[key]
+    if ok {
+        return path
+    }
+    path, err := os.Readlink(fmt.Sprintf("/proc/%d/fd/%d", key.Tgid, key.Fd))
+    if err != nil {
+        path = "?"
+    }
+    paths[key] = path
+    return path
+}
+
+// 内核中的计数是累计值 每个周期输出与上一次的差值
+// 整个周期都没有变化的 (进程, fd) 从 io_stats 中删除 否则关闭过的 fd 会一直占用直到 map 被占满
+func (this *MSyscall) iotopLoop() {
+    bpf_map, err := this.FindMap("io_stats")
+    if err != nil {
+        this.logger.Printf("iotop failed, err:%v", err)
+        return
+    }
+    interval := time.Duration(this.mconf.IoTop) * time.Second
+    ticker := time.NewTicker(interval)
+    defer ticker.Stop()
+    last := make(map[ioKey]ioStat)
+    paths := make(map[ioKey]string)
+    for {
+        select {
+        case <-this.ctx.Done():
+            return
+        case <-ticker.C:
+        }
+        var rows []ioRow
+        var idle []ioKey
+        var key ioKey
+        var percpu_stats []ioStat
+        iter := bpf_map.Iterate()
+        for iter.Next(&key, &percpu_stats) {
+            total := ioStat{}
+            for i := range percpu_stats {
+                total.add(&percpu_stats[i])
+            }
+            delta := total
+            prev := last[key]
+            delta.sub(&prev)
+            last[key] = total
+            if delta.RdOps+delta.WrOps+delta.Errors == 0 {
+                idle = append(idle, key)
+                continue
+            }
+            rows = append(rows, ioRow{key, delta})
+        }
+        if err := iter.Err(); err != nil {
+            this.logger.Printf("iotop iterate failed, err:%v", err)
+            continue
+        }
+        // 遍历过程中删除会让遍历从头开始 所以放到遍历之后
+        for i := range idle {
+            if err := bpf_map.Delete(&idle[i]); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+                this.logger.Printf("iotop delete failed, err:%v", err)
+            }
+            delete(last, idle[i])
+            delete(paths, idle[i])
+        }
+        sort.Slice(rows, func(i, j int) bool {
+            return rows[i].stat.RdBytes+rows[i].stat.WrBytes > rows[j].stat.RdBytes+rows[j].stat.WrBytes
+        })
+        var b strings.Builder
+        b.WriteString(fmt.Sprintf("[iotop] %s\n", time.Now().Format("15:04:05")))
+        b.WriteString(fmt.Sprintf("%8s %5s %8s %12s %8s %12s %6s %10s  %s\n", "PID", "FD", "R_OPS", "R_BYTES", "W_OPS", "W_BYTES", "ERR", "AVG_US", "PATH"))
+        for i, row := range rows {
+            if i >= IOTOP_MAX_ROWS {
+                break
+            }
+            var avg_us uint64 = 0
+            ops := row.stat.RdOps + row.stat.WrOps + row.stat.Errors
+            if ops > 0 {
+                avg_us = row.stat.LatencyNs / ops / 1000
+            }
+            b.WriteString(fmt.Sprintf("%8d %5d %8d %12d %8d %12d %6d %10d  %s\n", row.key.Tgid, row.key.Fd, row.stat.RdOps, row.stat.RdBytes, row.stat.WrOps, row.stat.WrBytes, row.stat.Errors, avg_us, this.ioPath(row.key, paths)))
+        }
+        this.logger.Print(b.String())
+    }
+}
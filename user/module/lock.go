@@ -0,0 +1,240 @@
+package module
+
+import (
+    "context"
+    "fmt"
+    "log"
+    "sort"
+    "stackplz/user/config"
+    "stackplz/user/event"
+    "strings"
+    "time"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// 与 lock.c 中的定义一致
+const (
+    LOCK_HIST_SLOTS = 32
+)
+
+const (
+    LOCK_MUTEX uint32 = 1
+    LOCK_FUTEX uint32 = 2
+)
+
+const LOCK_MAX_ROWS = 10
+
+const LOCK_MAX_FRAMES = 8
+
+// 与 lock_key_t 一致
+type lockKey struct {
+    Addr uint64
+    Lr   uint64
+    Tgid uint32
+    Kind uint32
+}
+
+// 与 lock_stat_t 一致
+type lockStat struct {
+    Count       uint64
+    WaitNs      uint64
+    MaxNs       uint64
+    HoldCount   uint64
+    HoldNs      uint64
+    UserStackId int32
+    Padding     uint32
+    Hist        [LOCK_HIST_SLOTS]uint64
+}
+
+type lockRow struct {
+    key  lockKey
+    stat lockStat
+}
+
+// 在内核中统计 pthread_mutex_lock 和 futex 的等待时间 只定期输出竞争最多的锁
+// 复用 MSyscall 的过滤设定 只加载 lock.o
+type MLock struct {
+    MSyscall
+}
+
+func (this *MLock) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "lock.o"
+    return nil
+}
+
+func (this *MLock) lockProbes() []*manager.Probe {
+    lib_path := this.mconf.LibcPath
+    probes := []*manager.Probe{
+        {
+            UID:              "lock_mutex",
+            Section:          "uprobe/lock_mutex",
+            EbpfFuncName:     "probe_mutex_lock",
+            AttachToFuncName: "pthread_mutex_lock",
+            BinaryPath:       lib_path,
+        },
+        {
+            UID:              "lock_mutex_ret",
+            Section:          "uretprobe/lock_mutex_ret",
+            EbpfFuncName:     "probe_mutex_lock_ret",
+            AttachToFuncName: "pthread_mutex_lock",
+            BinaryPath:       lib_path,
+        },
+        {
+            UID:              "lock_mutex_unlock",
+            Section:          "uprobe/lock_mutex_unlock",
+            EbpfFuncName:     "probe_mutex_unlock",
+            AttachToFuncName: "pthread_mutex_unlock",
+            BinaryPath:       lib_path,
+        },
+        // futex 只挂这一个 syscall 其他 syscall 不会进入 eBPF 程序
+        {
+            UID:              "lock_futex",
+            Section:          "kprobe/lock_futex",
+            EbpfFuncName:     "kprobe_futex",
+            AttachToFuncName: "__arm64_sys_futex",
+        },
+        {
+            UID:              "lock_futex_ret",
+            Section:          "kretprobe/lock_futex",
+            EbpfFuncName:     "kretprobe_futex",
+            AttachToFuncName: "__arm64_sys_futex",
+            KProbeMaxActive:  KRETPROBE_MAXACTIVE,
+        },
+    }
+    if this.mconf.Debug {
+        this.logger.Printf("lock hook pthread_mutex_lock/unlock in %s and futex", lib_path)
+    }
+    return probes
+}
+
+func (this *MLock) Start() error {
+    return this.start()
+}
+
+func (this *MLock) Clone() IModule {
+    mod := new(MLock)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+func (this *MLock) start() error {
+    err := this.startAggregate(this.lockProbes())
+    if err != nil {
+        return err
+    }
+    go this.dumpLoop(this.mconf.Lock, "lock", this.dumpContention)
+    return nil
+}
+
+func formatNs(ns uint64) string {
+    switch {
+    case ns >= 1000000000:
+        return fmt.Sprintf("%.2fs", float64(ns)/1e9)
+    case ns >= 1000000:
+        return fmt.Sprintf("%.2fms", float64(ns)/1e6)
+    case ns >= 1000:
+        return fmt.Sprintf("%.2fus", float64(ns)/1e3)
+    default:
+        return fmt.Sprintf("%dns", ns)
+    }
+}
+
+// 与 bcc 的 print_log2_hist 类似 只输出有值的区间
+func formatLog2Hist(hist *[LOCK_HIST_SLOTS]uint64) string {
+    var max_count uint64
+    first, last := -1, -1
+    for i, count := range hist {
+        if count == 0 {
+            continue
+        }
+        if first < 0 {
+            first = i
+        }
+        last = i
+        if count > max_count {
+            max_count = count
+        }
+    }
+    if first < 0 {
+        return ""
+    }
+    const width = 40
+    var b strings.Builder
+    for i := first; i <= last; i++ {
+        low := uint64(1) << i
+        if i == 0 {
+            low = 0
+        }
+        high := (uint64(1) << (i + 1)) - 1
+        stars := int(hist[i] * width / max_count)
+        b.WriteString(fmt.Sprintf("    %10s -> %-10s : %-8d |%-40s|\n", formatNs(low), formatNs(high), hist[i], strings.Repeat("*", stars)))
+    }
+    return b.String()
+}
+
+// 统计是累计值 按总等待时间从大到小输出前 LOCK_MAX_ROWS 个
+func (this *MLock) dumpContention() error {
+    stats_map, err := this.FindMap("lock_stats")
+    if err != nil {
+        return err
+    }
+    stacks_map, err := this.FindMap("lock_stacks")
+    if err != nil {
+        return err
+    }
+    var rows []lockRow
+    var key lockKey
+    var stat lockStat
+    iter := stats_map.Iterate()
+    for iter.Next(&key, &stat) {
+        if stat.Count == 0 {
+            continue
+        }
+        rows = append(rows, lockRow{key, stat})
+    }
+    if err := iter.Err(); err != nil {
+        return err
+    }
+    sort.Slice(rows, func(i, j int) bool {
+        return rows[i].stat.WaitNs > rows[j].stat.WaitNs
+    })
+    var b strings.Builder
+    b.WriteString(fmt.Sprintf("[lock] %s %d locks\n", time.Now().Format("15:04:05"), len(rows)))
+    for i, row := range rows {
+        if i >= LOCK_MAX_ROWS {
+            break
+        }
+        kind := "mutex"
+        if row.key.Kind == LOCK_FUTEX {
+            kind = "futex"
+        }
+        b.WriteString(fmt.Sprintf("%s 0x%x pid:%d lr:%s count:%d wait:%s avg:%s max:%s", kind, row.key.Addr, row.key.Tgid, event.GetAddrOffset(row.key.Tgid, row.key.Lr), row.stat.Count, formatNs(row.stat.WaitNs), formatNs(row.stat.WaitNs/row.stat.Count), formatNs(row.stat.MaxNs)))
+        if row.stat.HoldCount > 0 {
+            b.WriteString(fmt.Sprintf(" hold_avg:%s", formatNs(row.stat.HoldNs/row.stat.HoldCount)))
+        }
+        b.WriteString("\n")
+        b.WriteString(formatLog2Hist(&row.stat.Hist))
+        writeStackId(&b, stacks_map, row.key.Tgid, row.stat.UserStackId, LOCK_MAX_FRAMES)
+    }
+    this.logger.Print(b.String())
+    return nil
+}
+
+func (this *MLock) Close() error {
+    err := this.dumpContention()
+    if err != nil {
+        this.logger.Printf("dump lock failed, err:%v", err)
+    }
+    return this.Module.Close()
+}
+
+func init() {
+    mod := &MLock{}
+    mod.name = MODULE_NAME_LOCK
+    mod.mType = PROBE_TYPE_UPROBE
+    Register(mod)
+}
@@ -0,0 +1,116 @@
+package module
+
+import (
+    "stackplz/user/common"
+    "stackplz/user/config"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// 各功能 map 开启时的大小
+const (
+    ARMED_THREADS_SIZE = 1024
+    DEDUP_MAP_SIZE     = 10240
+    IO_STATS_SIZE      = 10240
+    FLOW_STATS_SIZE    = 10240
+    FLOW_CLOSED_SIZE   = 1024
+    FD_PATH_CACHE_SIZE = 1024
+    CALLSITE_MAP_SIZE  = 10240
+    STACK_LEARNED_SIZE = 10240
+    UNWIND_PROCS_SIZE  = 256
+    STR_DICT_SIZE      = 10240
+    STOPPED_PROCS_SIZE = 1024
+)
+
+// 只在某个选项开启时才会用到的 map 在 eBPF 程序中都只声明一项
+// 这里按开启的选项调整为实际需要的大小 没有开启的功能不会占用内存
+func (this *Module) featureMapEditors() map[string]manager.MapSpecEditor {
+    sizes := map[string]uint32{}
+    if len(this.mconf.ArmPoints) > 0 || len(this.mconf.ArmSyscalls) > 0 {
+        sizes["armed_threads"] = ARMED_THREADS_SIZE
+    }
+    if this.mconf.Dedup {
+        sizes["dedup_map"] = DEDUP_MAP_SIZE
+    }
+    if this.mconf.IoTop > 0 {
+        sizes["io_stats"] = IO_STATS_SIZE
+    }
+    if this.mconf.Flow > 0 {
+        sizes["flow_stats"] = FLOW_STATS_SIZE
+        sizes["flow_closed"] = FLOW_CLOSED_SIZE
+    }
+    if this.useFdPath() {
+        sizes["fd_path_cache"] = FD_PATH_CACHE_SIZE
+    }
+    if this.mconf.StackDedup > 0 {
+        sizes["callsite_map"] = CALLSITE_MAP_SIZE
+    }
+    if this.mconf.StackAdapt {
+        sizes["stack_learned"] = STACK_LEARNED_SIZE
+    }
+    if this.mconf.BpfUnwind {
+        sizes["unwind_rows"] = UNWIND_MAX_ROWS
+        sizes["unwind_procs"] = UNWIND_PROCS_SIZE
+    }
+    if this.mconf.Daemon {
+        sizes["session_filters"] = config.MAX_SESSIONS
+    }
+    if this.mconf.MaxOverhead > 0 {
+        sizes["sample_ratio"] = SAMPLE_MAX_HOOKS
+        sizes["sample_hits"] = SAMPLE_MAX_HOOKS
+    }
+    if this.mconf.StrDict {
+        sizes["str_dict"] = STR_DICT_SIZE
+        sizes["str_dict_values"] = STR_DICT_SIZE
+    }
+    if this.recordStops() {
+        sizes["stopped_procs"] = STOPPED_PROCS_SIZE
+    }
+    editors := make(map[string]manager.MapSpecEditor)
+    for name, size := range sizes {
+        editors[name] = manager.MapSpecEditor{
+            MaxEntries: size,
+            EditorFlag: manager.EditMaxEntries,
+        }
+    }
+    return editors
+}
+
+// 开启 fdpath 时 在 close 和 dup3 上删除 fd_path_cache 中的旧路径
+func (this *Module) fdPathProbes() []*manager.Probe {
+    if !this.useFdPath() {
+        return nil
+    }
+    return []*manager.Probe{
+        {
+            UID:              "fd_path_close",
+            Section:          "kprobe/fd_path_close",
+            EbpfFuncName:     "kprobe_fd_path_close",
+            AttachToFuncName: "__arm64_sys_close",
+        },
+        {
+            UID:              "fd_path_dup3",
+            Section:          "kprobe/fd_path_dup3",
+            EbpfFuncName:     "kprobe_fd_path_dup3",
+            AttachToFuncName: "__arm64_sys_dup3",
+        },
+    }
+}
+
+// --fdpath 或者 uprobe 参数中使用了 fd 类型
+func (this *Module) useFdPath() bool {
+    if this.mconf.FdPath {
+        return true
+    }
+    if this.mconf.StackUprobeConf == nil {
+        return false
+    }
+    for _, point := range this.mconf.StackUprobeConf.Points {
+        for _, point_arg := range point.PointArgs {
+            if point_arg.TypeIndex == common.FDPATH {
+                return true
+            }
+        }
+    }
+    return false
+}
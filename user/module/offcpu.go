@@ -0,0 +1,172 @@
+package module
+
+import (
+    "context"
+    "fmt"
+    "log"
+    "os"
+    "sort"
+    "stackplz/user/config"
+    "strings"
+    "time"
+
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// 与 offcpu.c 中的定义一致
+const (
+    OFFCPU_HIST_SLOTS = LOCK_HIST_SLOTS
+    OFFCPU_NO_SYSCALL = -1
+)
+
+const OFFCPU_MAX_ROWS = 10
+
+const OFFCPU_MAX_FRAMES = 8
+
+// 与 offcpu_key_t 一致
+type offcpuKey struct {
+    Tgid        uint32
+    Tid         uint32
+    Sysno       int32
+    UserStackId int32
+}
+
+// 与 offcpu_stat_t 一致
+type offcpuStat struct {
+    Count        uint64
+    TotalNs      uint64
+    MaxNs        uint64
+    RunqNs       uint64
+    PreemptCount uint64
+    Hist         [OFFCPU_HIST_SLOTS]uint64
+}
+
+type offcpuRow struct {
+    key  offcpuKey
+    stat offcpuStat
+}
+
+// 在内核中统计被追踪线程的 off-cpu 时间 按 (线程, syscall, 用户栈) 定期输出最多的几项
+// 复用 MSyscall 的过滤设定 只加载 offcpu.o 可以和 syscall 追踪同时运行
+type MOffcpu struct {
+    MSyscall
+}
+
+func (this *MOffcpu) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "offcpu.o"
+    return nil
+}
+
+func (this *MOffcpu) offcpuProbes() []*manager.Probe {
+    switch_probe := &manager.Probe{
+        Section:      "raw_tracepoint/sched_switch",
+        EbpfFuncName: "tracepoint__sched__sched_switch",
+    }
+    wakeup_probe := &manager.Probe{
+        Section:      "raw_tracepoint/sched_wakeup",
+        EbpfFuncName: "tracepoint__sched__sched_wakeup",
+    }
+    // 用来确定内核栈大小 见 offcpu.c
+    size_probe := &manager.Probe{
+        Section:      "raw_tracepoint/sys_enter",
+        EbpfFuncName: "raw_syscalls_sys_enter",
+    }
+    return []*manager.Probe{switch_probe, wakeup_probe, size_probe}
+}
+
+func (this *MOffcpu) Start() error {
+    return this.start()
+}
+
+func (this *MOffcpu) Clone() IModule {
+    mod := new(MOffcpu)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+func (this *MOffcpu) start() error {
+    err := this.startAggregate(this.offcpuProbes())
+    if err != nil {
+        return err
+    }
+    go this.dumpLoop(this.mconf.Offcpu, "offcpu", this.dumpOffcpu)
+    return nil
+}
+
+func offcpuSyscallName(sysno int32) string {
+    if sysno == OFFCPU_NO_SYSCALL {
+        return "-"
+    }
+    for _, point := range config.GetAllPoints() {
+        if point.Nr == uint32(sysno) {
+            return point.Name
+        }
+    }
+    return fmt.Sprintf("syscall_%d", sysno)
+}
+
+func offcpuThreadName(tgid, tid uint32) string {
+    comm, err := os.ReadFile(fmt.Sprintf("/proc/%d/task/%d/comm", tgid, tid))
+    if err != nil {
+        return "?"
+    }
+    return strings.TrimSpace(string(comm))
+}
+
+// 统计是累计值 按总 off-cpu 时间从大到小输出前 OFFCPU_MAX_ROWS 个
+func (this *MOffcpu) dumpOffcpu() error {
+    stats_map, err := this.FindMap("offcpu_stats")
+    if err != nil {
+        return err
+    }
+    stacks_map, err := this.FindMap("offcpu_stacks")
+    if err != nil {
+        return err
+    }
+    var rows []offcpuRow
+    var key offcpuKey
+    var stat offcpuStat
+    iter := stats_map.Iterate()
+    for iter.Next(&key, &stat) {
+        if stat.Count == 0 {
+            continue
+        }
+        rows = append(rows, offcpuRow{key, stat})
+    }
+    if err := iter.Err(); err != nil {
+        return err
+    }
+    sort.Slice(rows, func(i, j int) bool {
+        return rows[i].stat.TotalNs > rows[j].stat.TotalNs
+    })
+    var b strings.Builder
+    b.WriteString(fmt.Sprintf("[offcpu] %s %d stacks\n", time.Now().Format("15:04:05"), len(rows)))
+    for i, row := range rows {
+        if i >= OFFCPU_MAX_ROWS {
+            break
+        }
+        b.WriteString(fmt.Sprintf("pid:%d tid:%d(%s) syscall:%s count:%d total:%s avg:%s max:%s runq:%s preempt:%d\n", row.key.Tgid, row.key.Tid, offcpuThreadName(row.key.Tgid, row.key.Tid), offcpuSyscallName(row.key.Sysno), row.stat.Count, formatNs(row.stat.TotalNs), formatNs(row.stat.TotalNs/row.stat.Count), formatNs(row.stat.MaxNs), formatNs(row.stat.RunqNs), row.stat.PreemptCount))
+        b.WriteString(formatLog2Hist(&row.stat.Hist))
+        writeStackId(&b, stacks_map, row.key.Tgid, row.key.UserStackId, OFFCPU_MAX_FRAMES)
+    }
+    this.logger.Print(b.String())
+    return nil
+}
+
+func (this *MOffcpu) Close() error {
+    err := this.dumpOffcpu()
+    if err != nil {
+        this.logger.Printf("dump offcpu failed, err:%v", err)
+    }
+    return this.Module.Close()
+}
+
+func init() {
+    mod := &MOffcpu{}
+    mod.name = MODULE_NAME_OFFCPU
+    mod.mType = PROBE_TYPE_TRACEPOINT
+    Register(mod)
+}
@@ -0,0 +1,287 @@
+package module
+
+import (
+    "fmt"
+    "log"
+    "runtime"
+    "sort"
+    "stackplz/user/config"
+    "stackplz/user/util"
+    "syscall"
+    "time"
+    "unsafe"
+
+    "github.com/cilium/ebpf"
+    manager "github.com/ehids/ebpfmanager"
+)
+
+// 与 consts.h 中的定义一致
+const (
+    SAMPLE_MAX_HOOKS    = 1024
+    SAMPLE_UPROBE_START = 512
+)
+
+const (
+    OVERHEAD_INTERVAL = 2 * time.Second
+    SAMPLE_MAX_RATIO  = 4096
+    // 开销低于预算的这个比例才开始恢复 避免来回调整
+    OVERHEAD_RECOVER = 0.5
+)
+
+// 与 overhead_ctl_t 一致
+type overheadCtl struct {
+    StackOff uint32
+    Padding  uint32
+}
+
+type sampleHook struct {
+    key   uint32
+    hits  uint64
+    ratio uint32
+}
+
+type overheadController struct {
+    logger    *log.Logger
+    ratio_map *ebpf.Map
+    hits_map  *ebpf.Map
+    ctl_map   *ebpf.Map
+    can_stack bool
+    stack_off bool
+    ratios    map[uint32]uint32
+    last_hits map[uint32]uint64
+    hook_name func(uint32) string
+}
+
+func (this *Module) sampleHookName(key uint32) string {
+    if key >= SAMPLE_UPROBE_START {
+        point_key := key - SAMPLE_UPROBE_START
+        if this.mconf.StackUprobeConf != nil {
+            for _, point := range this.mconf.StackUprobeConf.Points {
+                if point.Index == point_key {
+                    return point.Name
+                }
+            }
+        }
+        return fmt.Sprintf("uprobe_%d", point_key)
+    }
+    for _, point := range config.GetAllPoints() {
+        if point.Nr == key {
+            return point.Name
+        }
+    }
+    return fmt.Sprintf("syscall_%d", key)
+}
+
+// 采样之前的命中次数 按每个周期的增量返回
+func (this *overheadController) readHits() ([]sampleHook, error) {
+    var hooks []sampleHook
+    var key uint32
+    var percpu_hits []uint64
+    iter := this.hits_map.Iterate()
+    for iter.Next(&key, &percpu_hits) {
+        var total uint64 = 0
+        for _, hits := range percpu_hits {
+            total += hits
+        }
+        delta := total - this.last_hits[key]
+        this.last_hits[key] = total
+        if delta == 0 {
+            continue
+        }
+        ratio, ok := this.ratios[key]
+        if !ok {
+            ratio = 1
+        }
+        hooks = append(hooks, sampleHook{key, delta, ratio})
+    }
+    return hooks, iter.Err()
+}
+
+func (this *overheadController) setRatio(hook *sampleHook, ratio uint32, reason string) error {
+    if err := this.ratio_map.Update(unsafe.Pointer(&hook.key), unsafe.Pointer(&ratio), ebpf.UpdateAny); err != nil {
+        return fmt.Errorf("update sample_ratio failed, err:%v", err)
+    }
+    this.logger.Printf("[overhead] %s, sample %s 1/%d -> 1/%d", reason, this.hook_name(hook.key), hook.ratio, ratio)
+    this.ratios[hook.key] = ratio
+    hook.ratio = ratio
+    return nil
+}
+
+func (this *overheadController) setStackOff(off bool, reason string) error {
+    ctl := overheadCtl{}
+    if off {
+        ctl.StackOff = 1
+    }
+    var zero uint32 = 0
+    if err := this.ctl_map.Update(unsafe.Pointer(&zero), unsafe.Pointer(&ctl), ebpf.UpdateAny); err != nil {
+        return fmt.Errorf("update overhead_ctl failed, err:%v", err)
+    }
+    if off {
+        this.logger.Printf("[overhead] %s, stack capture off", reason)
+    } else {
+        this.logger.Printf("[overhead] %s, stack capture on", reason)
+    }
+    this.stack_off = off
+    return nil
+}
+
+// 超出预算时先关闭取栈 再把输出最多 合计占一半以上的 hook 点采样比例翻倍
+func (this *overheadController) reduce(hooks []sampleHook, reason string) error {
+    if this.can_stack && !this.stack_off {
+        return this.setStackOff(true, reason)
+    }
+    // 按实际输出的事件数排序
+    sort.Slice(hooks, func(i, j int) bool {
+        return hooks[i].hits/uint64(hooks[i].ratio) > hooks[j].hits/uint64(hooks[j].ratio)
+    })
+    var total uint64 = 0
+    for _, hook := range hooks {
+        total += hook.hits / uint64(hook.ratio)
+    }
+    var sum uint64 = 0
+    for i := range hooks {
+        if sum*2 >= total {
+            break
+        }
+        hook := &hooks[i]
+        sum += hook.hits / uint64(hook.ratio)
+        if hook.ratio >= SAMPLE_MAX_RATIO {
+            continue
+        }
+        if err := this.setRatio(hook, hook.ratio*2, reason); err != nil {
+            return err
+        }
+    }
+    return nil
+}
+
+// 开销足够低时按相反的顺序恢复 先降低采样比例 全部恢复后再打开取栈
+func (this *overheadController) relax(reason string) error {
+    keys := make([]uint32, 0, len(this.ratios))
+    for key := range this.ratios {
+        keys = append(keys, key)
+    }
+    sort.Slice(keys, func(i, j int) bool { return keys[i] < keys[j] })
+    changed := false
+    for _, key := range keys {
+        ratio := this.ratios[key]
+        if ratio <= 1 {
+            continue
+        }
+        hook := &sampleHook{key: key, ratio: ratio}
+        if err := this.setRatio(hook, ratio/2, reason); err != nil {
+            return err
+        }
+        changed = true
+    }
+    if !changed && this.stack_off {
+        return this.setStackOff(false, reason)
+    }
+    return nil
+}
+
+func selfCpuTime() time.Duration {
+    var usage syscall.Rusage
+    if err := syscall.Getrusage(syscall.RUSAGE_SELF, &usage); err != nil {
+        return 0
+    }
+    return time.Duration(usage.Utime.Nano() + usage.Stime.Nano())
+}
+
+// 开销为 eBPF 程序运行时间加上 stackplz 自身读取和处理事件的 cpu 时间 占全部 cpu 时间的比例
+// 每个周期与预算比较 调整采样比例或者开关取栈
+func (this *Module) overheadLoop(m *manager.Manager, find_map func(string) (*ebpf.Map, error), extra ...string) {
+    ratio_map, err := find_map("sample_ratio")
+    if err != nil {
+        this.logger.Printf("overhead control failed, err:%v", err)
+        return
+    }
+    hits_map, err := find_map("sample_hits")
+    if err != nil {
+        this.logger.Printf("overhead control failed, err:%v", err)
+        return
+    }
+    ctl_map, err := find_map("overhead_ctl")
+    if err != nil {
+        this.logger.Printf("overhead control failed, err:%v", err)
+        return
+    }
+    ctrl := &overheadController{
+        logger:    this.logger,
+        ratio_map: ratio_map,
+        hits_map:  hits_map,
+        ctl_map:   ctl_map,
+        can_stack: this.mconf.UnwindStack,
+        ratios:    make(map[uint32]uint32),
+        last_hits: make(map[uint32]uint64),
+        hook_name: this.sampleHookName,
+    }
+    progs, err := this.bpfStatsProgs(m, extra)
+    if err != nil {
+        this.logger.Printf("overhead control failed, err:%v", err)
+        return
+    }
+    budget := this.mconf.MaxOverhead
+    this.logger.Printf("[overhead] budget %.2f%% of all cpus", budget)
+
+    ticker := time.NewTicker(OVERHEAD_INTERVAL)
+    defer ticker.Stop()
+    bpf_ok := true
+    var last_bpf_ns uint64 = 0
+    last_cpu := selfCpuTime()
+    last_time := time.Now()
+    for {
+        select {
+        case <-this.ctx.Done():
+            return
+        case <-ticker.C:
+        }
+        now := time.Now()
+        elapsed := now.Sub(last_time)
+        last_time = now
+
+        var bpf_ns uint64 = 0
+        for _, items := range progs {
+            if !bpf_ok {
+                break
+            }
+            for _, prog := range items {
+                _, run_time_ns, err := util.ReadBpfProgStats(prog.FD())
+                if err != nil {
+                    // 没有 eBPF 运行时间时只按自身的 cpu 时间计算
+                    this.logger.Printf("[overhead] read bpf stats failed, only count stackplz cpu time, err:%v", err)
+                    bpf_ok = false
+                    break
+                }
+                bpf_ns += run_time_ns
+            }
+        }
+        bpf_delta := bpf_ns - last_bpf_ns
+        last_bpf_ns = bpf_ns
+        if !bpf_ok {
+            bpf_delta = 0
+        }
+        cpu := selfCpuTime()
+        cpu_delta := cpu - last_cpu
+        last_cpu = cpu
+
+        cost := (float64(bpf_delta) + float64(cpu_delta.Nanoseconds())) * 100 / (float64(elapsed.Nanoseconds()) * float64(runtime.NumCPU()))
+        hooks, err := ctrl.readHits()
+        if err != nil {
+            this.logger.Printf("[overhead] read sample_hits failed, err:%v", err)
+            continue
+        }
+        if this.mconf.Debug {
+            this.logger.Printf("[overhead] %.3f%% bpf:%dus stackplz:%dus hooks:%d", cost, bpf_delta/1000, cpu_delta.Microseconds(), len(hooks))
+        }
+        reason := fmt.Sprintf("overhead %.2f%% budget %.2f%%", cost, budget)
+        if cost > budget {
+            err = ctrl.reduce(hooks, reason)
+        } else if cost < budget*OVERHEAD_RECOVER {
+            err = ctrl.relax(reason)
+        }
+        if err != nil {
+            this.logger.Printf("[overhead] adjust failed, err:%v", err)
+        }
+    }
+}
@@ -0,0 +1,211 @@
+package module
+
+import (
+    "context"
+    "errors"
+    "fmt"
+    "log"
+    "os"
+    "runtime"
+    "sort"
+    "stackplz/user/config"
+    "stackplz/user/event"
+    "strings"
+    "time"
+    "unsafe"
+
+    manager "github.com/ehids/ebpfmanager"
+    "golang.org/x/sys/unix"
+)
+
+// 与 profile_key_t 一致
+type profileKey struct {
+    Tgid        uint32
+    UserStackId int32
+}
+
+// 按固定频率采样 栈和计数都在内核中完成 不输出事件
+// 复用 MSyscall 的过滤设定 只加载 profile.o
+type MProfile struct {
+    MSyscall
+    profileFds   []int
+    profileStart time.Time
+}
+
+func (this *MProfile) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "profile.o"
+    this.statsProgs = []string{"profile_handler"}
+    return nil
+}
+
+func (this *MProfile) Start() error {
+    return this.start()
+}
+
+func (this *MProfile) Clone() IModule {
+    mod := new(MProfile)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+// perf_event 程序在 openProfileEvents 中逐个 cpu 挂载
+func (this *MProfile) start() error {
+    err := this.startAggregate(nil)
+    if err != nil {
+        return err
+    }
+    return this.openProfileEvents()
+}
+
+// 每个 cpu 打开一个 cpu-clock 采样事件 进程过滤交给 eBPF 程序
+func (this *MProfile) openProfileEvents() error {
+    progs, found, err := this.bpfManager.GetProgram(manager.ProbeIdentificationPair{EbpfFuncName: "profile_handler"})
+    if err != nil {
+        return err
+    }
+    if !found || len(progs) == 0 {
+        return errors.New("cannot find program:profile_handler")
+    }
+    prog_fd := progs[0].FD()
+    attr := unix.PerfEventAttr{
+        Type:   unix.PERF_TYPE_SOFTWARE,
+        Config: unix.PERF_COUNT_SW_CPU_CLOCK,
+        Sample: uint64(this.mconf.Profile),
+        Bits:   unix.PerfBitDisabled | unix.PerfBitFreq,
+    }
+    attr.Size = uint32(unsafe.Sizeof(attr))
+    for cpu := 0; cpu < runtime.NumCPU(); cpu++ {
+        fd, err := unix.PerfEventOpen(&attr, -1, cpu, -1, unix.PERF_FLAG_FD_CLOEXEC)
+        if err != nil {
+            if errors.Is(err, unix.ENODEV) {
+                // cpu 不在线
+                continue
+            }
+            return fmt.Errorf("open cpu-clock event on cpu %d failed, err:%v", cpu, err)
+        }
+        this.profileFds = append(this.profileFds, fd)
+        if err := unix.IoctlSetInt(fd, unix.PERF_EVENT_IOC_SET_BPF, prog_fd); err != nil {
+            return fmt.Errorf("attach profile_handler on cpu %d failed, err:%v", cpu, err)
+        }
+        if err := unix.IoctlSetInt(fd, unix.PERF_EVENT_IOC_ENABLE, 0); err != nil {
+            return fmt.Errorf("enable cpu-clock event on cpu %d failed, err:%v", cpu, err)
+        }
+    }
+    this.profileStart = time.Now()
+    this.logger.Printf("profile at %dHz on %d cpus", this.mconf.Profile, len(this.profileFds))
+    return nil
+}
+
+func profileComm(tgid uint32, comms map[uint32]string) string {
+    comm, ok := comms[tgid]
+    if ok {
+        return comm
+    }
+    content, err := os.ReadFile(fmt.Sprintf("/proc/%d/comm", tgid))
+    if err != nil {
+        comm = fmt.Sprintf("%d", tgid)
+    } else {
+        comm = strings.TrimSpace(string(content))
+    }
+    comms[tgid] = comm
+    return comm
+}
+
+// profile_counts 满了之后新的栈无法计数 只在 profile_drops 中累计
+func (this *MProfile) profileDrops() uint64 {
+    drops_map, err := this.FindMap("profile_drops")
+    if err != nil {
+        return 0
+    }
+    var zero uint32 = 0
+    var percpu_drops []uint64
+    if err := drops_map.Lookup(&zero, &percpu_drops); err != nil {
+        return 0
+    }
+    var total uint64
+    for _, v := range percpu_drops {
+        total += v
+    }
+    return total
+}
+
+// 读取内核中的计数 默认按 folded 格式写入文件 可以直接交给 flamegraph.pl
+// 以 .pb.gz 结尾时输出 pprof 格式
+// 栈 id 不同但符号化结果相同的会合并到一起
+func (this *MProfile) dumpProfile() error {
+    counts_map, err := this.FindMap("profile_counts")
+    if err != nil {
+        return err
+    }
+    stacks_map, err := this.FindMap("profile_stacks")
+    if err != nil {
+        return err
+    }
+    folded := make(map[string]uint64)
+    comms := make(map[uint32]string)
+    var total uint64
+    var key profileKey
+    var count uint64
+    iter := counts_map.Iterate()
+    for iter.Next(&key, &count) {
+        total += count
+        frames := []string{profileComm(key.Tgid, comms)}
+        var ips [STACK_TRACE_DEPTH]uint64
+        if key.UserStackId < 0 || stacks_map.Lookup(&key.UserStackId, &ips) != nil {
+            frames = append(frames, "[unknown]")
+        } else {
+            // 栈中最内层的在最前面 folded 格式要求从外到内
+            depth := 0
+            for depth < STACK_TRACE_DEPTH && ips[depth] != 0 {
+                depth++
+            }
+            for i := depth - 1; i >= 0; i-- {
+                frames = append(frames, event.GetAddrOffset(key.Tgid, ips[i]))
+            }
+        }
+        folded[strings.Join(frames, ";")] += count
+    }
+    if err := iter.Err(); err != nil {
+        return err
+    }
+    drops := this.profileDrops()
+    if drops > 0 {
+        this.logger.Printf("profile_counts full, dropped %d samples", drops)
+    }
+    if strings.HasSuffix(this.mconf.ProfileOut, PPROF_SUFFIX) {
+        err = writePprof(this.mconf.ProfileOut, folded, this.mconf.Profile, this.profileStart)
+    } else {
+        lines := make([]string, 0, len(folded))
+        for stack, count := range folded {
+            lines = append(lines, fmt.Sprintf("%s %d", stack, count))
+        }
+        sort.Strings(lines)
+        err = os.WriteFile(this.mconf.ProfileOut, []byte(strings.Join(lines, "\n")+"\n"), 0644)
+    }
+    if err != nil {
+        return err
+    }
+    this.logger.Printf("profile samples:%d stacks:%d dropped:%d, save to %s", total, len(folded), drops, this.mconf.ProfileOut)
+    return nil
+}
+
+func (this *MProfile) Close() error {
+    for _, fd := range this.profileFds {
+        unix.Close(fd)
+    }
+    err := this.dumpProfile()
+    if err != nil {
+        this.logger.Printf("dump profile failed, err:%v", err)
+    }
+    return this.Module.Close()
+}
+
+func init() {
+    mod := &MProfile{}
+    mod.name = MODULE_NAME_PROFILE
+    mod.mType = PROBE_TYPE_PERF
+    Register(mod)
+}
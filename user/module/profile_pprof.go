@@ -0,0 +1,144 @@
+package module
+
+import (
+    "bytes"
+    "compress/gzip"
+    "os"
+    "strings"
+    "time"
+)
+
+// --profile-out 以 .pb.gz 结尾时按 pprof 的 profile.proto 输出 可以直接交给 go tool pprof
+// 只用到其中很少的字段 这里手动编码 避免引入 protobuf 依赖
+// 每个不同的栈帧字符串对应一个 function 和一个 location 进程名作为最外层的帧
+
+const PPROF_SUFFIX = ".pb.gz"
+
+type pprofBuffer struct {
+    bytes.Buffer
+}
+
+func (this *pprofBuffer) varint(v uint64) {
+    for v >= 0x80 {
+        this.WriteByte(byte(v) | 0x80)
+        v >>= 7
+    }
+    this.WriteByte(byte(v))
+}
+
+func (this *pprofBuffer) uint64Field(field int, v uint64) {
+    if v == 0 {
+        return
+    }
+    this.varint(uint64(field) << 3)
+    this.varint(v)
+}
+
+func (this *pprofBuffer) bytesField(field int, data []byte) {
+    this.varint(uint64(field)<<3 | 2)
+    this.varint(uint64(len(data)))
+    this.Write(data)
+}
+
+func (this *pprofBuffer) packedField(field int, values []uint64) {
+    var packed pprofBuffer
+    for _, v := range values {
+        packed.varint(v)
+    }
+    this.bytesField(field, packed.Bytes())
+}
+
+type pprofBuilder struct {
+    out     pprofBuffer
+    strings map[string]uint64
+    table   []string
+    frames  map[string]uint64
+}
+
+func newPprofBuilder() *pprofBuilder {
+    b := &pprofBuilder{strings: make(map[string]uint64), frames: make(map[string]uint64)}
+    b.str("")
+    return b
+}
+
+func (this *pprofBuilder) str(s string) uint64 {
+    if id, ok := this.strings[s]; ok {
+        return id
+    }
+    id := uint64(len(this.table))
+    this.strings[s] = id
+    this.table = append(this.table, s)
+    return id
+}
+
+func (this *pprofBuilder) valueType(field int, typ, unit string) {
+    var vt pprofBuffer
+    vt.uint64Field(1, this.str(typ))
+    vt.uint64Field(2, this.str(unit))
+    this.out.bytesField(field, vt.Bytes())
+}
+
+// function 和 location 使用同一个 id
+func (this *pprofBuilder) frame(name string) uint64 {
+    if id, ok := this.frames[name]; ok {
+        return id
+    }
+    id := uint64(len(this.frames) + 1)
+    this.frames[name] = id
+    filename := name
+    if i := strings.LastIndex(name, "+0x"); i > 0 {
+        filename = name[:i]
+    }
+    var fn pprofBuffer
+    fn.uint64Field(1, id)
+    fn.uint64Field(2, this.str(name))
+    fn.uint64Field(3, this.str(name))
+    fn.uint64Field(4, this.str(filename))
+    this.out.bytesField(5, fn.Bytes())
+
+    var line pprofBuffer
+    line.uint64Field(1, id)
+    var loc pprofBuffer
+    loc.uint64Field(1, id)
+    loc.bytesField(4, line.Bytes())
+    this.out.bytesField(4, loc.Bytes())
+    return id
+}
+
+// stacks 中的栈帧从外到内 pprof 要求 location 从内到外
+func writePprof(path string, stacks map[string]uint64, hz uint32, start time.Time) error {
+    b := newPprofBuilder()
+    period := uint64(time.Second) / uint64(hz)
+    b.valueType(1, "samples", "count")
+    b.valueType(1, "cpu", "nanoseconds")
+    for stack, count := range stacks {
+        frames := strings.Split(stack, ";")
+        ids := make([]uint64, 0, len(frames))
+        for i := len(frames) - 1; i >= 0; i-- {
+            ids = append(ids, b.frame(frames[i]))
+        }
+        var sample pprofBuffer
+        sample.packedField(1, ids)
+        sample.packedField(2, []uint64{count, count * period})
+        b.out.bytesField(2, sample.Bytes())
+    }
+    b.out.uint64Field(9, uint64(start.UnixNano()))
+    b.out.uint64Field(10, uint64(time.Since(start)))
+    b.valueType(11, "cpu", "nanoseconds")
+    b.out.uint64Field(12, period)
+    // string_table 放在最后 前面的字段已经确定了所有字符串
+    for _, s := range b.table {
+        b.out.bytesField(6, []byte(s))
+    }
+
+    file, err := os.Create(path)
+    if err != nil {
+        return err
+    }
+    defer file.Close()
+    gw := gzip.NewWriter(file)
+    if _, err := gw.Write(b.out.Bytes()); err != nil {
+        return err
+    }
+    return gw.Close()
+}
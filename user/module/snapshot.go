@@ -0,0 +1,47 @@
+package module
+
+import (
+    "errors"
+    "stackplz/user/event"
+    "syscall"
+
+    "github.com/cilium/ebpf"
+)
+
+// --snapshot 时内核发送 SIGSTOP 并在 stopped_procs 中记录 进程 => 事件的时间戳
+func (this *Module) recordStops() bool {
+    return this.mconf.UprobeSignal == uint32(syscall.SIGSTOP)
+}
+
+// 用户态据此恢复事件丢失或者一直没有处理的进程
+func (this *Module) setupSnapshotStops(find func(string) (*ebpf.Map, error)) error {
+    bpf_map, err := find("stopped_procs")
+    if err != nil {
+        return err
+    }
+    list := func() map[uint32]uint64 {
+        stops := make(map[uint32]uint64)
+        var pid uint32
+        var ts uint64
+        iter := bpf_map.Iterate()
+        for iter.Next(&pid, &ts) {
+            stops[pid] = ts
+        }
+        if err := iter.Err(); err != nil {
+            this.logger.Printf("stopped_procs iterate failed, err:%v", err)
+        }
+        return stops
+    }
+    // 进程之后又被停住时时间戳会更新 这时不能删除
+    remove := func(pid uint32, ts uint64) {
+        var value uint64
+        if err := bpf_map.Lookup(&pid, &value); err != nil || value > ts {
+            return
+        }
+        if err := bpf_map.Delete(&pid); err != nil && !errors.Is(err, ebpf.ErrKeyNotExist) {
+            this.logger.Printf("stopped_procs delete failed, err:%v", err)
+        }
+    }
+    event.SetSnapshotStops(list, remove)
+    return nil
+}
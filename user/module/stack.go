@@ -59,6 +59,20 @@ func (this *MStack) setupManager() error {
     }
     probes = append(probes, fork_probe)
 
+    probes = append(probes, this.uprobeProbes()...)
+    probes = append(probes, this.armProbes()...)
+    probes = append(probes, this.fdPathProbes()...)
+
+    this.bpfManager = &manager.Manager{
+        Probes: probes,
+        Maps:   maps,
+    }
+    return nil
+}
+
+// uprobe hook 配置 合并追踪时也会用到
+func (this *Module) uprobeProbes() []*manager.Probe {
+    probes := []*manager.Probe{}
     for i, uprobe_point := range this.mconf.StackUprobeConf.Points {
         // stack hook 配置
         sym := uprobe_point.Symbol
@@ -88,12 +102,7 @@ func (this *MStack) setupManager() error {
         }
         probes = append(probes, stack_probe)
     }
-
-    this.bpfManager = &manager.Manager{
-        Probes: probes,
-        Maps:   maps,
-    }
-    return nil
+    return probes
 }
 
 func (this *MStack) setupManagerOptions() {
@@ -101,7 +110,7 @@ func (this *MStack) setupManagerOptions() {
     if this.mconf.ExternalBTF != "" {
         byteBuf, err := assets.Asset("user/assets/" + this.mconf.ExternalBTF)
         if err != nil {
-            this.logger.Fatalf("[setupManagerOptions] failed, err:%v", err)
+            this.fatalf("[setupManagerOptions] failed, err:%v", err)
             return
         }
         spec, err := btf.LoadSpecFromReader((bytes.NewReader(byteBuf)))
@@ -133,6 +142,7 @@ func (this *MStack) setupManagerOptions() {
             },
         }
     }
+    this.bpfManagerOptions.MapSpecEditors = this.featureMapEditors()
 }
 
 func (this *MStack) Start() error {
@@ -184,6 +194,29 @@ func (this *MStack) start() error {
         return err
     }
 
+    if this.mconf.BpfUnwind {
+        go this.unwindLoop(this.FindMap)
+    }
+    if this.mconf.MaxOverhead > 0 {
+        go this.overheadLoop(this.bpfManager, this.FindMap)
+    }
+    if this.mconf.StrDict {
+        if err := this.setupStrDict(this.FindMap); err != nil {
+            return err
+        }
+    }
+    if this.mconf.StackDedup > 0 {
+        if err := this.setupCallsiteLost(this.FindMap); err != nil {
+            return err
+        }
+    }
+    event.SetSnapshotSignalClear(this.clear_signal)
+    if this.recordStops() {
+        if err := this.setupSnapshotStops(this.FindMap); err != nil {
+            return err
+        }
+    }
+
     return nil
 }
 
@@ -255,6 +288,13 @@ func (this *MStack) update_common_filter() {
     this.update_map(map_name, filter_key, unsafe.Pointer(&filter_value))
 }
 
+// --snapshot 达到数量上限后 内核中不再发送 SIGSTOP
+func (this *MStack) clear_signal() {
+    this.mconf.UprobeSignal = 0
+    filter_value := this.mconf.GetCommonFilter()
+    this.update_map("common_filter", 0, unsafe.Pointer(&filter_value))
+}
+
 func (this *MStack) update_child_parent() {
     // 这个可以合并到 common_list 后面改进
     map_name := "child_parent_map"
@@ -408,9 +448,22 @@ func (this *MStack) initDecodeFun() error {
     // 根据设置添加 map 不然即使不使用的map也会创建缓冲区
     uprobestackEvent := &event.UprobeEvent{}
     this.eventFuncMaps[EventsMap] = uprobestackEvent
+    // 带栈数据的事件在单独的 map 中 解析方式相同
+    for _, map_name := range this.mconf.StackEventMaps() {
+        StackEventsMap, err := this.FindMap(map_name)
+        if err != nil {
+            return err
+        }
+        this.eventMaps = append(this.eventMaps, StackEventsMap)
+        this.eventFuncMaps[StackEventsMap] = uprobestackEvent
+    }
     return nil
 }
 
+func (this *MStack) BpfManager() *manager.Manager {
+    return this.bpfManager
+}
+
 func (this *MStack) FindMap(map_name string) (*ebpf.Map, error) {
     em, found, err := this.bpfManager.GetMap(map_name)
     if err != nil {
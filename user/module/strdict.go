@@ -0,0 +1,32 @@
+package module
+
+import (
+    "bytes"
+    "stackplz/user/argtype"
+    "unsafe"
+
+    "github.com/cilium/ebpf"
+)
+
+// 与 consts.h 中的定义一致
+const STR_DICT_MAX_LEN = argtype.STR_DICT_MAX_LEN
+
+// 引用先于定义到达时 从 str_dict_values 中取回字符串
+func (this *Module) setupStrDict(find_map func(string) (*ebpf.Map, error)) error {
+    values_map, err := find_map("str_dict_values")
+    if err != nil {
+        return err
+    }
+    argtype.SetStrDictLookup(func(id uint32) (string, bool) {
+        var value [STR_DICT_MAX_LEN]byte
+        if err := values_map.Lookup(unsafe.Pointer(&id), unsafe.Pointer(&value)); err != nil {
+            return "", false
+        }
+        // 取的是整段 STR_DICT_MAX_LEN 字节 结尾的 0 之后是无关数据
+        if end := bytes.IndexByte(value[:], 0); end >= 0 {
+            return string(value[:end]), true
+        }
+        return string(value[:]), true
+    })
+    return nil
+}
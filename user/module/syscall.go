@@ -45,38 +45,100 @@ func (this *MSyscall) GetConf() config.IConfig {
     return this.mconf
 }
 
-func (this *MSyscall) setupManager() error {
+// fork 和 arm 的挂载点每个模块都需要 这里统一加上
+func (this *MSyscall) setupManager(probes []*manager.Probe, map_names ...string) {
     maps := []*manager.Map{}
-    probes := []*manager.Probe{}
-
-    events_map := &manager.Map{
-        Name: "events",
+    for _, map_name := range map_names {
+        maps = append(maps, &manager.Map{Name: map_name})
     }
-    maps = append(maps, events_map)
-
     fork_probe := &manager.Probe{
         Section:      "raw_tracepoint/sched_process_fork",
         EbpfFuncName: "tracepoint__sched__sched_process_fork",
     }
-    probes = append(probes, fork_probe)
+    all_probes := []*manager.Probe{fork_probe}
+    all_probes = append(all_probes, probes...)
+    all_probes = append(all_probes, this.armProbes()...)
 
-    // syscall hook 配置
-    sys_enter_probe := &manager.Probe{
-        Section:      "raw_tracepoint/sys_enter",
-        EbpfFuncName: "raw_syscalls_sys_enter",
+    this.bpfManager = &manager.Manager{
+        Probes: all_probes,
+        Maps:   maps,
+    }
+}
+
+// 内核自带 BTF 时使用 tp_btf 版本 可以直接访问 pt_regs
+// 需要额外 btf 文件的设备 只能使用 bpf_probe_read 的版本
+func (this *MSyscall) useBtf() bool {
+    return this.mconf.ExternalBTF == ""
+}
+
+func (this *MSyscall) useKprobe() bool {
+    // 通过 syscall 触发追踪时 需要在全部 syscall 入口检查
+    if len(this.mconf.ArmSyscalls) > 0 {
+        return false
+    }
+    use_kprobe, err := this.mconf.SysCallConf.UseKprobe()
+    if err != nil {
+        this.logger.Printf("check kallsyms failed, fallback to raw_tracepoint, err:%v", err)
+        return false
+    }
+    if len(this.mconf.SysCallConf.KprobeMissing) > 0 {
+        this.logger.Printf("missing [%s], fallback to raw_tracepoint", strings.Join(this.mconf.SysCallConf.KprobeMissing, ","))
+        return false
     }
-    sys_exit_probe := &manager.Probe{
-        Section:      "raw_tracepoint/sys_exit",
-        EbpfFuncName: "raw_syscalls_sys_exit",
+    if use_kprobe && this.mconf.Debug {
+        this.logger.Printf("hook syscall by kprobe, count:%d", len(this.mconf.SysCallConf.PointArgs))
     }
-    probes = append(probes, sys_enter_probe)
-    probes = append(probes, sys_exit_probe)
+    return use_kprobe
+}
 
-    this.bpfManager = &manager.Manager{
-        Probes: probes,
-        Maps:   maps,
+// syscall hook 配置
+func (this *MSyscall) syscallProbes(use_btf bool) []*manager.Probe {
+    probes := []*manager.Probe{}
+    if this.useKprobe() {
+        // 同一个 eBPF 程序挂到多个 syscall 函数上 通过 UID 区分
+        for _, point := range this.mconf.SysCallConf.PointArgs {
+            sys_enter_probe := &manager.Probe{
+                UID:              "enter_" + point.Name,
+                Section:          "kprobe/sys_enter",
+                EbpfFuncName:     "kprobe_sys_enter",
+                AttachToFuncName: point.KernelSymbol(),
+            }
+            // 阻塞的 syscall 会长时间占用 kretprobe 实例 实例用完后返回会被漏掉
+            // 所以显式设置为内核允许的最大值 而不是依赖默认的 2*ncpu
+            sys_exit_probe := &manager.Probe{
+                UID:              "exit_" + point.Name,
+                Section:          "kretprobe/sys_exit",
+                EbpfFuncName:     "kretprobe_sys_exit",
+                AttachToFuncName: point.KernelSymbol(),
+                KProbeMaxActive:  KRETPROBE_MAXACTIVE,
+            }
+            probes = append(probes, sys_enter_probe)
+            probes = append(probes, sys_exit_probe)
+        }
+    } else if use_btf {
+        sys_enter_probe := &manager.Probe{
+            Section:      "tp_btf/sys_enter",
+            EbpfFuncName: "btf_raw_syscalls_sys_enter",
+        }
+        sys_exit_probe := &manager.Probe{
+            Section:      "tp_btf/sys_exit",
+            EbpfFuncName: "btf_raw_syscalls_sys_exit",
+        }
+        probes = append(probes, sys_enter_probe)
+        probes = append(probes, sys_exit_probe)
+    } else {
+        sys_enter_probe := &manager.Probe{
+            Section:      "raw_tracepoint/sys_enter",
+            EbpfFuncName: "raw_syscalls_sys_enter",
+        }
+        sys_exit_probe := &manager.Probe{
+            Section:      "raw_tracepoint/sys_exit",
+            EbpfFuncName: "raw_syscalls_sys_exit",
+        }
+        probes = append(probes, sys_enter_probe)
+        probes = append(probes, sys_exit_probe)
     }
-    return nil
+    return probes
 }
 
 func (this *MSyscall) setupManagerOptions() {
@@ -84,7 +146,7 @@ func (this *MSyscall) setupManagerOptions() {
     if this.mconf.ExternalBTF != "" {
         byteBuf, err := assets.Asset("user/assets/" + this.mconf.ExternalBTF)
         if err != nil {
-            this.logger.Fatalf("[setupManagerOptions] failed, err:%v", err)
+            this.fatalf("[setupManagerOptions] failed, err:%v", err)
             return
         }
         spec, err := btf.LoadSpecFromReader((bytes.NewReader(byteBuf)))
@@ -116,6 +178,7 @@ func (this *MSyscall) setupManagerOptions() {
             },
         }
     }
+    this.bpfManagerOptions.MapSpecEditors = this.featureMapEditors()
 }
 
 func (this *MSyscall) Start() error {
@@ -129,12 +192,34 @@ func (this *MSyscall) Clone() IModule {
     return mod
 }
 
+// 开启 tp_btf 时 对应的程序在单独编译的 xxx_btf.o 中
+func (this *MSyscall) btfBpfFile() string {
+    if this.useBtf() && !strings.HasSuffix(this.hookBpfFile, "_btf.o") {
+        return strings.TrimSuffix(this.hookBpfFile, ".o") + "_btf.o"
+    }
+    return this.hookBpfFile
+}
+
 func (this *MSyscall) start() error {
-    // 初始化相关设置
-    err := this.setupManager()
+    this.hookBpfFile = this.btfBpfFile()
+    probes := append(this.syscallProbes(this.useBtf()), this.fdPathProbes()...)
+    err := this.startObject(probes, this.updateFilter, "events")
+    if err != nil {
+        return err
+    }
+    // 加载map信息，设置eventFuncMaps，给不同的事件指定处理事件数据的函数
+    err = this.initDecodeFun()
     if err != nil {
         return err
     }
+    return this.startSyscallLoops()
+}
+
+// 复用 MSyscall 过滤设定的模块 只有加载的 .o 挂载点和过滤同步方式不同
+// 这里统一完成 加载 -> 挂载 -> 同步过滤设定
+func (this *MSyscall) startObject(probes []*manager.Probe, update func() error, map_names ...string) error {
+    // 初始化相关设置
+    this.setupManager(probes, map_names...)
     this.setupManagerOptions()
 
     // 从assets中获取eBPF程序的二进制数据
@@ -156,17 +241,42 @@ func (this *MSyscall) start() error {
     }
 
     // 通过更新 BPF_MAP_TYPE_HASH 类型的 map 实现过滤设定的同步
-    err = this.updateFilter()
-    if err != nil {
-        return err
-    }
+    return update()
+}
 
-    // 加载map信息，设置eventFuncMaps，给不同的事件指定处理事件数据的函数
-    err = this.initDecodeFun()
-    if err != nil {
-        return err
+// syscall.o 和 unified.o 共有的功能
+func (this *MSyscall) startSyscallLoops() error {
+    if this.mconf.IoTop > 0 {
+        go this.iotopLoop()
+    }
+    if this.mconf.Flow > 0 {
+        go this.flowLoop()
+    }
+    if this.mconf.BpfUnwind {
+        go this.unwindLoop(this.FindMap)
+    }
+    if this.mconf.MaxOverhead > 0 {
+        go this.overheadLoop(this.bpfManager, this.FindMap)
+    }
+    if this.mconf.StrDict {
+        if err := this.setupStrDict(this.FindMap); err != nil {
+            return err
+        }
+    }
+    if this.mconf.StackDedup > 0 {
+        if err := this.setupCallsiteLost(this.FindMap); err != nil {
+            return err
+        }
+    }
+    if this.mconf.Daemon {
+        event.SetSessionUpdater(this.update_session)
+    }
+    event.SetSnapshotSignalClear(this.clear_signal)
+    if this.recordStops() {
+        if err := this.setupSnapshotStops(this.FindMap); err != nil {
+            return err
+        }
     }
-
     return nil
 }
 
@@ -214,6 +324,25 @@ func (this *MSyscall) update_common_list(items []uint32, offset uint32) {
     }
 }
 
+// 与 update_common_list 相同 只是 value 不再是 key 本身
+func (this *MSyscall) update_common_kind(items map[uint32]uint32, offset uint32) {
+    map_name := "common_list"
+    bpf_map, err := this.FindMap(map_name)
+    if err != nil {
+        panic(fmt.Sprintf("find [%s] failed, err:%v", map_name, err))
+    }
+    for k, v := range items {
+        k += offset
+        err := bpf_map.Update(unsafe.Pointer(&k), unsafe.Pointer(&v), ebpf.UpdateAny)
+        if err != nil {
+            panic(fmt.Sprintf("update [%s] failed, err:%v", map_name, err))
+        }
+    }
+    if this.mconf.Debug {
+        this.logger.Printf("update %s success, count:%d offset:%s", map_name, len(items), util.START_OFFSETS[offset])
+    }
+}
+
 func (this *MSyscall) list2string(items []uint32) string {
     var results []string
     for _, v := range items {
@@ -229,6 +358,7 @@ func (this *MSyscall) update_common_filter() {
     this.update_common_list(this.mconf.PidBlacklist, util.PID_BLACKLIST_START)
     this.update_common_list(this.mconf.TidWhitelist, util.TID_WHITELIST_START)
     this.update_common_list(this.mconf.TidBlacklist, util.TID_BLACKLIST_START)
+    this.update_common_list(this.mconf.ArmSyscalls, util.ARM_SYSCALL_START)
     this.logger.Printf("uid => whitelist:[%s];blacklist:[%s]", this.list2string(this.mconf.UidWhitelist), this.list2string(this.mconf.UidBlacklist))
     this.logger.Printf("pid => whitelist:[%s];blacklist:[%s]", this.list2string(this.mconf.PidWhitelist), this.list2string(this.mconf.PidBlacklist))
     this.logger.Printf("tid => whitelist:[%s];blacklist:[%s]", this.list2string(this.mconf.TidWhitelist), this.list2string(this.mconf.TidBlacklist))
@@ -238,6 +368,21 @@ func (this *MSyscall) update_common_filter() {
     this.update_map(map_name, filter_key, unsafe.Pointer(&filter_value))
 }
 
+// --snapshot 达到数量上限后 内核中不再发送 SIGSTOP
+func (this *MSyscall) clear_signal() {
+    this.mconf.UprobeSignal = 0
+    filter_value := this.mconf.GetCommonFilter()
+    this.update_map("common_filter", 0, unsafe.Pointer(&filter_value))
+}
+
+func (this *MSyscall) update_session(slot uint32, filter *config.SessionFilter) error {
+    bpf_map, err := this.FindMap("session_filters")
+    if err != nil {
+        return err
+    }
+    return bpf_map.Update(unsafe.Pointer(&slot), unsafe.Pointer(filter), ebpf.UpdateAny)
+}
+
 func (this *MSyscall) update_child_parent() {
     // 这个可以合并到 common_list 后面改进
     map_name := "child_parent_map"
@@ -401,17 +546,32 @@ func (this *MSyscall) update_op_list() {
     }
 }
 
-func (this *MSyscall) updateFilter() (err error) {
+// 所有复用 MSyscall 过滤设定的模块都需要的部分
+func (this *MSyscall) updateBaseFilter() error {
     this.update_base_config()
     this.update_common_filter()
     this.update_child_parent()
     this.update_thread_filter()
+    return nil
+}
+
+func (this *MSyscall) updateFilter() (err error) {
+    this.updateBaseFilter()
     this.update_arg_filter()
     this.update_sysenter_point_args()
     this.update_sysexit_point_args()
     this.update_op_list()
     this.update_common_list(this.mconf.SysCallConf.SysWhitelist, util.SYS_WHITELIST_START)
     this.update_common_list(this.mconf.SysCallConf.SysBlacklist, util.SYS_BLACKLIST_START)
+    if this.mconf.Dedup {
+        this.update_common_list(this.mconf.SysCallConf.CoalesceSyscalls(), util.SYS_COALESCE_START)
+    }
+    if this.mconf.IoTop > 0 {
+        this.update_common_kind(this.mconf.SysCallConf.IoSyscalls(), util.SYS_IO_START)
+    }
+    if this.mconf.Flow > 0 {
+        this.update_common_kind(this.mconf.SysCallConf.FlowSyscalls(), util.SYS_FLOW_START)
+    }
     if this.mconf.Debug {
         this.logger.Printf("SysCallConf:%s", this.mconf.SysCallConf.Info())
     }
@@ -430,9 +590,23 @@ func (this *MSyscall) initDecodeFun() error {
     syscallEvent := &event.SyscallEvent{}
     this.eventFuncMaps[EventsMap] = syscallEvent
 
+    // 带栈数据的事件在单独的 map 中 解析方式相同
+    for _, map_name := range this.mconf.StackEventMaps() {
+        StackEventsMap, err := this.FindMap(map_name)
+        if err != nil {
+            return err
+        }
+        this.eventMaps = append(this.eventMaps, StackEventsMap)
+        this.eventFuncMaps[StackEventsMap] = syscallEvent
+    }
+
     return nil
 }
 
+func (this *MSyscall) BpfManager() *manager.Manager {
+    return this.bpfManager
+}
+
 func (this *MSyscall) FindMap(map_name string) (*ebpf.Map, error) {
     em, found, err := this.bpfManager.GetMap(map_name)
     if err != nil {
@@ -444,6 +618,48 @@ func (this *MSyscall) FindMap(map_name string) (*ebpf.Map, error) {
     return em, err
 }
 
+// 与 dedup_state_t 一致
+type dedupState struct {
+    Sysno   uint32
+    Count   uint32
+    Lr      uint64
+    Args    [4]uint64
+    FirstTs uint64
+    LastTs  uint64
+    Bytes   int64
+}
+
+// 线程最后一段重复 syscall 只有在下一次不同的 syscall 时才会输出
+// 退出前把还没有输出的汇总打印出来
+func (this *MSyscall) dumpPendingRepeats() {
+    bpf_map, err := this.FindMap("dedup_map")
+    if err != nil {
+        this.logger.Printf("dump pending repeats failed, err:%v", err)
+        return
+    }
+    var tid uint32
+    var state dedupState
+    iter := bpf_map.Iterate()
+    for iter.Next(&tid, &state) {
+        if state.Count == 0 {
+            continue
+        }
+        point := config.GetSyscallPointByNR(state.Sysno)
+        s := fmt.Sprintf("[%d] %s repeat:%d span:%dms LR:0x%x", tid, point.Name, state.Count, (state.LastTs-state.FirstTs)/1000000, state.Lr)
+        if state.Bytes > 0 {
+            s = fmt.Sprintf("%s bytes:%d", s, state.Bytes)
+        }
+        this.logger.Printf("%s (pending)", s)
+    }
+}
+
+func (this *MSyscall) Close() error {
+    if this.mconf.Dedup {
+        this.dumpPendingRepeats()
+    }
+    return this.Module.Close()
+}
+
 func (this *MSyscall) Events() []*ebpf.Map {
     return this.eventMaps
 }
@@ -0,0 +1,119 @@
+package module
+
+import (
+    "context"
+    "fmt"
+    "log"
+    "stackplz/user/config"
+    "stackplz/user/event"
+    "unsafe"
+
+    "github.com/cilium/ebpf"
+)
+
+// 同时追踪 syscall 和 uprobe
+// 只加载一个 unified.o 过滤相关的 map 和 events 输出都只有一份
+type MUnified struct {
+    MSyscall
+}
+
+func (this *MUnified) Init(ctx context.Context, logger *log.Logger, conf config.IConfig) error {
+    this.MSyscall.Init(ctx, logger, conf)
+    this.Module.SetChild(this)
+    this.hookBpfFile = "unified.o"
+    return nil
+}
+
+func (this *MUnified) Start() error {
+    return this.start()
+}
+
+func (this *MUnified) Clone() IModule {
+    mod := new(MUnified)
+    mod.name = this.name
+    mod.mType = this.mType
+    return mod
+}
+
+// 与 MSyscall 的启动流程相同 只是多了 uprobe 的挂载点 过滤设定和解析方式不同
+func (this *MUnified) start() error {
+    this.hookBpfFile = this.btfBpfFile()
+    probes := this.syscallProbes(this.useBtf())
+    probes = append(probes, this.uprobeProbes()...)
+    probes = append(probes, this.fdPathProbes()...)
+    err := this.startObject(probes, this.updateFilter, "events")
+    if err != nil {
+        return err
+    }
+    err = this.initDecodeFun()
+    if err != nil {
+        return err
+    }
+    return this.startSyscallLoops()
+}
+
+func (this *MUnified) update_uprobe_point_args() {
+    map_name := "uprobe_point_args"
+    bpf_map, err := this.FindMap(map_name)
+    if err != nil {
+        panic(fmt.Sprintf("find [%s] failed, err:%v", map_name, err))
+    }
+    for _, uprobe_point := range this.mconf.StackUprobeConf.Points {
+        var filter_key uint32 = uprobe_point.Index
+        filter_value := uprobe_point.GetUnifiedConfig()
+        err := bpf_map.Update(unsafe.Pointer(&filter_key), unsafe.Pointer(&filter_value), ebpf.UpdateAny)
+        if err != nil {
+            panic(fmt.Sprintf("update [%s] failed, filter_key:%d, err:%v", map_name, filter_key, err))
+        }
+    }
+    if this.mconf.Debug {
+        this.logger.Printf("update %s success", map_name)
+    }
+}
+
+func (this *MUnified) updateFilter() (err error) {
+    err = this.MSyscall.updateFilter()
+    if err != nil {
+        return err
+    }
+    this.update_uprobe_point_args()
+    return nil
+}
+
+func (this *MUnified) initDecodeFun() error {
+    EventsMap, err := this.FindMap("events")
+    if err != nil {
+        return err
+    }
+    this.eventMaps = append(this.eventMaps, EventsMap)
+
+    // syscall 和 uprobe 事件在同一个 map 中 按 EventId 分别解析
+    mixedEvent := &event.MixedEvent{}
+    this.eventFuncMaps[EventsMap] = mixedEvent
+    // 带栈数据的事件在单独的 map 中 解析方式相同
+    for _, map_name := range this.mconf.StackEventMaps() {
+        StackEventsMap, err := this.FindMap(map_name)
+        if err != nil {
+            return err
+        }
+        this.eventMaps = append(this.eventMaps, StackEventsMap)
+        this.eventFuncMaps[StackEventsMap] = mixedEvent
+    }
+    return nil
+}
+
+func (this *MUnified) Events() []*ebpf.Map {
+    return this.eventMaps
+}
+
+func (this *MUnified) DecodeFun(em *ebpf.Map) (event.IEventStruct, bool) {
+    fun, found := this.eventFuncMaps[em]
+    return fun, found
+}
+
+func init() {
+    mod := &MUnified{}
+    mod.name = MODULE_NAME_UNIFIED
+    mod.mType = PROBE_TYPE_TRACEPOINT
+    Register(mod)
+}
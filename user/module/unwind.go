@@ -0,0 +1,247 @@
+package module
+
+import (
+    "debug/elf"
+    "fmt"
+    "sort"
+    "stackplz/user/event"
+    "stackplz/user/util"
+    "strconv"
+    "strings"
+    "time"
+    "unsafe"
+
+    "github.com/cilium/ebpf"
+)
+
+// 与 consts.h 中的定义一致
+const (
+    UNWIND_MAX_MAPPINGS = 256
+    // 所有库的规则总数 每条 16 字节
+    UNWIND_MAX_ROWS = 1 << 20
+    // 单个映射上的规则数 对应 UNWIND_ROW_SEARCH 次二分查找 规则更多的库拆成多个映射
+    UNWIND_CHUNK_ROWS = 1<<16 - 1
+)
+
+const UNWIND_REFRESH_INTERVAL = 2 * time.Second
+
+// 与 unwind_mapping_t 一致
+type unwindMapping struct {
+    Start    uint64
+    End      uint64
+    Bias     uint64
+    RowStart uint32
+    RowCount uint32
+}
+
+// 与 unwind_proc_t 一致
+type unwindProc struct {
+    Count   uint32
+    Padding uint32
+    Maps    [UNWIND_MAX_MAPPINGS]unwindMapping
+}
+
+// 每个库只解析一次 规则在 unwind_rows 中的位置对所有进程都一样
+type unwindLib struct {
+    rowStart uint32
+    rowCount uint32
+    // 每 UNWIND_CHUNK_ROWS 条规则一段 除第一段外各段起始的虚拟地址
+    chunkPcs []uint64
+    progs    []elf.ProgHeader
+}
+
+type unwindLoader struct {
+    rows_map  *ebpf.Map
+    procs_map *ebpf.Map
+    libs      map[string]*unwindLib
+    next_row  uint32
+    // 进程 => 上一次加载时的可执行映射 没有变化就不用重新写入
+    procs map[uint32]string
+    full  bool
+}
+
+func (this *unwindLoader) loadLib(path string) *unwindLib {
+    lib, ok := this.libs[path]
+    if ok {
+        return lib
+    }
+    lib = &unwindLib{}
+    this.libs[path] = lib
+    f, err := elf.Open(path)
+    if err != nil {
+        return lib
+    }
+    defer f.Close()
+    for _, prog := range f.Progs {
+        if prog.Type == elf.PT_LOAD && prog.Flags&elf.PF_X != 0 {
+            lib.progs = append(lib.progs, prog.ProgHeader)
+        }
+    }
+    rows, err := util.ParseEhFrame(f)
+    if err != nil || len(rows) == 0 {
+        return lib
+    }
+    if this.next_row+uint32(len(rows)) > UNWIND_MAX_ROWS {
+        // 剩下的库只能按帧指针回溯
+        this.full = true
+        return lib
+    }
+    keys := make([]uint32, len(rows))
+    for i := range rows {
+        keys[i] = this.next_row + uint32(i)
+    }
+    if _, err := this.rows_map.BatchUpdate(keys, rows, nil); err != nil {
+        // 不支持批量更新的内核上逐条写入
+        for i := range rows {
+            if err := this.rows_map.Update(unsafe.Pointer(&keys[i]), unsafe.Pointer(&rows[i]), ebpf.UpdateAny); err != nil {
+                return lib
+            }
+        }
+    }
+    lib.rowStart = this.next_row
+    lib.rowCount = uint32(len(rows))
+    for i := UNWIND_CHUNK_ROWS; i < len(rows); i += UNWIND_CHUNK_ROWS {
+        lib.chunkPcs = append(lib.chunkPcs, rows[i].Pc)
+    }
+    this.next_row += uint32(len(rows))
+    return lib
+}
+
+// 只取带路径的可执行映射 按起始地址排序
+func (this *unwindLoader) execMappings(content string) []string {
+    var lines []string
+    for _, line := range strings.Split(content, "\n") {
+        fields := strings.Fields(line)
+        if len(fields) < 6 || len(fields[1]) < 3 || fields[1][2] != 'x' || !strings.HasPrefix(fields[5], "/") {
+            continue
+        }
+        lines = append(lines, line)
+    }
+    return lines
+}
+
+func (this *unwindLoader) updateProc(pid uint32) error {
+    content, err := util.ReadMapsByPid(pid)
+    if err != nil {
+        // 进程已经退出
+        delete(this.procs, pid)
+        this.procs_map.Delete(unsafe.Pointer(&pid))
+        event.RemoveHostPid(pid)
+        return nil
+    }
+    lines := this.execMappings(content)
+    key := strings.Join(lines, "\n")
+    if this.procs[pid] == key {
+        return nil
+    }
+    proc := &unwindProc{}
+    for _, line := range lines {
+        if proc.Count >= UNWIND_MAX_MAPPINGS {
+            break
+        }
+        fields := strings.Fields(line)
+        addrs := strings.SplitN(fields[0], "-", 2)
+        start, err1 := strconv.ParseUint(addrs[0], 16, 64)
+        end, err2 := strconv.ParseUint(addrs[1], 16, 64)
+        pgoff, err3 := strconv.ParseUint(fields[2], 16, 64)
+        if err1 != nil || err2 != nil || err3 != nil {
+            continue
+        }
+        lib := this.loadLib(strings.Join(fields[5:], " "))
+        // pc 对应的文件偏移为 pc - start + pgoff 再按所在段换算为虚拟地址
+        var prog *elf.ProgHeader
+        for i := range lib.progs {
+            p := &lib.progs[i]
+            if pgoff+(end-start) > p.Off && pgoff < p.Off+p.Filesz {
+                prog = p
+                break
+            }
+        }
+        if prog == nil || lib.rowCount == 0 {
+            m := &proc.Maps[proc.Count]
+            m.Start = start
+            m.End = end
+            proc.Count++
+            continue
+        }
+        // 按规则分段拆分映射 每段只在自己的规则中查找
+        bias := start - pgoff + prog.Off - prog.Vaddr
+        for i := 0; i <= len(lib.chunkPcs) && proc.Count < UNWIND_MAX_MAPPINGS; i++ {
+            chunk_start, chunk_end := start, end
+            if i > 0 && lib.chunkPcs[i-1]+bias > chunk_start {
+                chunk_start = lib.chunkPcs[i-1] + bias
+            }
+            if i < len(lib.chunkPcs) && lib.chunkPcs[i]+bias < chunk_end {
+                chunk_end = lib.chunkPcs[i] + bias
+            }
+            if chunk_start >= chunk_end {
+                continue
+            }
+            m := &proc.Maps[proc.Count]
+            m.Start = chunk_start
+            m.End = chunk_end
+            m.Bias = bias
+            m.RowStart = lib.rowStart + uint32(i*UNWIND_CHUNK_ROWS)
+            m.RowCount = lib.rowCount - uint32(i*UNWIND_CHUNK_ROWS)
+            if m.RowCount > UNWIND_CHUNK_ROWS {
+                m.RowCount = UNWIND_CHUNK_ROWS
+            }
+            proc.Count++
+        }
+    }
+    sort.Slice(proc.Maps[:proc.Count], func(i, j int) bool {
+        return proc.Maps[i].Start < proc.Maps[j].Start
+    })
+    if err := this.procs_map.Update(unsafe.Pointer(&pid), unsafe.Pointer(proc), ebpf.UpdateAny); err != nil {
+        return fmt.Errorf("update unwind_procs for pid %d failed, err:%v", pid, err)
+    }
+    this.procs[pid] = key
+    return nil
+}
+
+// 目标进程和产生过事件的进程都加载规则 映射有变化时重新写入
+// 新进程加载之前的事件 以及 dlopen 之后还没刷新的库 都会退回到帧指针回溯
+func (this *Module) unwindLoop(find_map func(string) (*ebpf.Map, error)) {
+    rows_map, err := find_map("unwind_rows")
+    if err != nil {
+        this.logger.Printf("bpf unwind failed, err:%v", err)
+        return
+    }
+    procs_map, err := find_map("unwind_procs")
+    if err != nil {
+        this.logger.Printf("bpf unwind failed, err:%v", err)
+        return
+    }
+    loader := &unwindLoader{
+        rows_map:  rows_map,
+        procs_map: procs_map,
+        libs:      make(map[string]*unwindLib),
+        procs:     make(map[uint32]string),
+    }
+    ticker := time.NewTicker(UNWIND_REFRESH_INTERVAL)
+    defer ticker.Stop()
+    warned := false
+    for {
+        // stackplz 运行在宿主机的命名空间 通过 /proc 得到的目标进程 pid 就是宿主机上的 pid
+        pids := append([]uint32{}, this.mconf.PidWhitelist...)
+        pids = append(pids, event.GetHostPidList()...)
+        for _, pid := range pids {
+            err := loader.updateProc(pid)
+            if err != nil {
+                this.logger.Printf("bpf unwind, err:%v", err)
+            }
+        }
+        if loader.full && !warned {
+            this.logger.Printf("bpf unwind rows exceed %d, other libraries fall back to frame pointers", UNWIND_MAX_ROWS)
+            warned = true
+        }
+        if this.mconf.Debug {
+            this.logger.Printf("bpf unwind libs:%d rows:%d procs:%d", len(loader.libs), loader.next_row, len(loader.procs))
+        }
+        select {
+        case <-this.ctx.Done():
+            return
+        case <-ticker.C:
+        }
+    }
+}
@@ -60,6 +60,7 @@ func BrkIt(opts *BrkOptions) {
 	mconfig.StackSize = Gconfig.StackSize
 	mconfig.ShowRegs = Gconfig.ShowRegs
 	mconfig.GetOff = Gconfig.GetOff
+	mconfig.BpfStats = Gconfig.BpfStats
 	mconfig.BrkPid = opts.BrkPid
 	mconfig.BrkAddr = opts.BrkAddr
 	mconfig.BrkLen = opts.BrkLen
@@ -69,6 +70,7 @@ func BrkIt(opts *BrkOptions) {
 	err := mod.Run()
 	if err != nil {
 		Logger.Printf("%s\tmodule Run failed, [skip it]. error:%+v", mod.Name(), err)
+		util.RestoreBpfStats()
 		os.Exit(1)
 	}
 }
@@ -122,6 +124,7 @@ func StartRpcServer(stopper chan os.Signal, rpcPath string) {
 		<-stopper
 		Logger.Println("\nReceived Ctrl+C, shutting down...")
 		_ = l.Close()
+		util.RestoreBpfStats()
 		os.Exit(0)
 	}()
 
@@ -144,14 +147,7 @@ func handleConnection(conn net.Conn) {
 	defer conn.Close()
 
 	for {
-		var size uint32 = 0
-		err := binary.Read(conn, binary.LittleEndian, &size)
-		if err != nil {
-			return
-		}
-
-		buffer := make([]byte, size)
-		err = binary.Read(conn, binary.LittleEndian, &buffer)
+		buffer, err := readMsg(conn)
 		if err != nil {
 			return
 		}
@@ -0,0 +1,171 @@
+package rpc
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"net"
+	"os"
+	"stackplz/user/config"
+	"stackplz/user/event"
+
+	"golang.org/x/sys/unix"
+)
+
+// 客户端发来的请求只是一小段 json 超过这个长度直接断开
+const MAX_REQUEST_SIZE = 64 * 1024
+
+// 守护进程模式 所有会话共用已经挂载的 eBPF 程序
+// 协议与 rpc 模式相同 都是 [size][payload]
+// 客户端先发送 SessionRequest 收到 RespMsg 之后 持续收到格式化好的事件 断开连接即结束会话
+// 监听 unix socket 只接受 root 和守护进程自身用户的连接
+func StartSessionServer(mconfig *config.ModuleConfig, daemonPath string) {
+	// 上次退出时留下的 socket 文件
+	if err := os.Remove(daemonPath); err != nil && !os.IsNotExist(err) {
+		Logger.Println("Error Remove:", err)
+		return
+	}
+	l, err := net.ListenUnix("unix", &net.UnixAddr{Name: daemonPath, Net: "unix"})
+	if err != nil {
+		Logger.Println("Error ListenUnix:", err)
+		return
+	}
+	if err := os.Chmod(daemonPath, 0600); err != nil {
+		Logger.Println("Error Chmod:", err)
+		_ = l.Close()
+		return
+	}
+
+	go func() {
+		<-Ctx.Done()
+		_ = l.Close()
+	}()
+
+	Logger.Printf("daemon waiting for sessions on %s", daemonPath)
+
+	for {
+		conn, err := l.AcceptUnix()
+		if err != nil {
+			return
+		}
+		if err := checkPeer(conn); err != nil {
+			Logger.Printf("session rejected, err:%v", err)
+			conn.Close()
+			continue
+		}
+		go handleSession(conn, mconfig)
+	}
+}
+
+// 通过 SO_PEERCRED 取对端的 uid
+func checkPeer(conn *net.UnixConn) error {
+	raw, err := conn.SyscallConn()
+	if err != nil {
+		return err
+	}
+	var cred *unix.Ucred
+	var cred_err error
+	err = raw.Control(func(fd uintptr) {
+		cred, cred_err = unix.GetsockoptUcred(int(fd), unix.SOL_SOCKET, unix.SO_PEERCRED)
+	})
+	if err != nil {
+		return err
+	}
+	if cred_err != nil {
+		return cred_err
+	}
+	if cred.Uid != 0 && cred.Uid != uint32(os.Getuid()) {
+		return errors.New(fmt.Sprintf("peer pid:%d uid:%d is not allowed", cred.Pid, cred.Uid))
+	}
+	return nil
+}
+
+func readMsg(conn net.Conn) ([]byte, error) {
+	var size uint32 = 0
+	err := binary.Read(conn, binary.LittleEndian, &size)
+	if err != nil {
+		return nil, err
+	}
+	if size > MAX_REQUEST_SIZE {
+		return nil, errors.New(fmt.Sprintf("message size %d exceeds %d", size, MAX_REQUEST_SIZE))
+	}
+	buffer := make([]byte, size)
+	err = binary.Read(conn, binary.LittleEndian, &buffer)
+	if err != nil {
+		return nil, err
+	}
+	return buffer, nil
+}
+
+func writeMsg(conn net.Conn, payload []byte) error {
+	err := binary.Write(conn, binary.LittleEndian, uint32(len(payload)))
+	if err != nil {
+		return err
+	}
+	return binary.Write(conn, binary.LittleEndian, payload)
+}
+
+func writeResp(conn net.Conn, status string, msg string) error {
+	resp, err := json.Marshal(RespMsg{Status: status, Msg: msg})
+	if err != nil {
+		return err
+	}
+	return writeMsg(conn, resp)
+}
+
+func handleSession(conn net.Conn, mconfig *config.ModuleConfig) {
+	defer conn.Close()
+
+	buffer, err := readMsg(conn)
+	if err != nil {
+		return
+	}
+
+	filter, req, err := mconfig.ParseSessionRequest(buffer)
+	if err != nil {
+		writeResp(conn, "error", fmt.Sprintf("ParseSessionRequest failed, err:%v", err))
+		return
+	}
+	session, err := event.OpenSession(filter)
+	if err != nil {
+		writeResp(conn, "error", fmt.Sprintf("OpenSession failed, err:%v", err))
+		return
+	}
+	Logger.Printf("session %d open, %s", session.Slot, req.String())
+	defer func() {
+		err := event.CloseSession(session)
+		if err != nil {
+			Logger.Printf("session %d close failed, err:%v", session.Slot, err)
+		}
+		Logger.Printf("session %d closed, dropped:%d", session.Slot, session.GetDropped())
+	}()
+	if writeResp(conn, "ok", fmt.Sprintf("session %d", session.Slot)) != nil {
+		return
+	}
+
+	// 客户端不会再发送数据 读到错误说明连接已经断开
+	closed := make(chan struct{})
+	go func() {
+		var b [1]byte
+		for {
+			if _, err := conn.Read(b[:]); err != nil {
+				close(closed)
+				return
+			}
+		}
+	}()
+
+	for {
+		select {
+		case <-Ctx.Done():
+			return
+		case <-closed:
+			return
+		case s := <-session.Events:
+			if writeMsg(conn, []byte(s)) != nil {
+				return
+			}
+		}
+	}
+}
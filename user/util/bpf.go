@@ -1,7 +1,12 @@
 package util
 
 import (
+    "bufio"
     "fmt"
+    "os"
+    "strconv"
+    "strings"
+    "sync"
 
     "golang.org/x/sys/unix"
 )
@@ -82,3 +87,112 @@ func CheckKernelConfig() error {
     }
     return nil
 }
+
+// 检查符号是否都存在于 /proc/kallsyms 返回缺失的符号
+func FindMissingKallsyms(symbols []string) ([]string, error) {
+    f, err := os.Open("/proc/kallsyms")
+    if err != nil {
+        return nil, err
+    }
+    defer f.Close()
+    wanted := make(map[string]bool)
+    for _, symbol := range symbols {
+        wanted[symbol] = false
+    }
+    scanner := bufio.NewScanner(f)
+    for scanner.Scan() {
+        parts := strings.Fields(scanner.Text())
+        if len(parts) < 3 {
+            continue
+        }
+        if _, ok := wanted[parts[2]]; ok {
+            wanted[parts[2]] = true
+        }
+    }
+    if err := scanner.Err(); err != nil {
+        return nil, err
+    }
+    var missing []string
+    for _, symbol := range symbols {
+        if !wanted[symbol] {
+            missing = append(missing, symbol)
+        }
+    }
+    return missing, nil
+}
+
+const BPF_STATS_ENABLED = "/proc/sys/kernel/bpf_stats_enabled"
+
+var bpf_stats_once sync.Once
+var bpf_stats_lock sync.Mutex
+var bpf_stats_restore = func() {}
+
+// 开启内核对 eBPF 程序运行次数和时间的统计 多个模块共用 只在第一次调用时开启
+// 开启后每次运行都要多读两次时钟 所以默认是关闭的
+func EnableBpfStats() error {
+    var err error
+    bpf_stats_once.Do(func() {
+        err = enableBpfStats()
+    })
+    return err
+}
+
+func enableBpfStats() error {
+    old, err := os.ReadFile(BPF_STATS_ENABLED)
+    if err != nil {
+        return err
+    }
+    if strings.TrimSpace(string(old)) == "1" {
+        return nil
+    }
+    err = os.WriteFile(BPF_STATS_ENABLED, []byte("1"), 0644)
+    if err != nil {
+        return err
+    }
+    bpf_stats_lock.Lock()
+    defer bpf_stats_lock.Unlock()
+    bpf_stats_restore = func() {
+        os.WriteFile(BPF_STATS_ENABLED, old, 0644)
+    }
+    return nil
+}
+
+// 恢复开启之前的值 所有退出路径都要调用 重复调用没有影响
+func RestoreBpfStats() {
+    bpf_stats_lock.Lock()
+    defer bpf_stats_lock.Unlock()
+    bpf_stats_restore()
+    bpf_stats_restore = func() {}
+}
+
+// 从 fdinfo 读取程序累计的 run_cnt 和 run_time_ns 5.1 以下的内核没有这两项
+func ReadBpfProgStats(fd int) (uint64, uint64, error) {
+    content, err := os.ReadFile(fmt.Sprintf("/proc/self/fdinfo/%d", fd))
+    if err != nil {
+        return 0, 0, err
+    }
+    var run_cnt, run_time_ns uint64
+    found := 0
+    for _, line := range strings.Split(string(content), "\n") {
+        parts := strings.Fields(line)
+        if len(parts) != 2 {
+            continue
+        }
+        switch parts[0] {
+        case "run_cnt:":
+            run_cnt, err = strconv.ParseUint(parts[1], 10, 64)
+        case "run_time_ns:":
+            run_time_ns, err = strconv.ParseUint(parts[1], 10, 64)
+        default:
+            continue
+        }
+        if err != nil {
+            return 0, 0, err
+        }
+        found++
+    }
+    if found != 2 {
+        return 0, 0, fmt.Errorf("run_cnt/run_time_ns not found in fdinfo of fd %d", fd)
+    }
+    return run_cnt, run_time_ns, nil
+}
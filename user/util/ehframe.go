@@ -0,0 +1,561 @@
+package util
+
+import (
+	"debug/elf"
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"sort"
+)
+
+// 与 unwind_row_t 一致 对 [Pc, 下一条规则的 Pc) 有效
+// 偏移都是相对 CFA 的 RaOff 为 0 表示返回地址还在 lr 中 FpOff 为 0 表示 x29 没有被保存
+type UnwindRow struct {
+	Pc      uint64
+	CfaOff  int16
+	CfaReg  uint8
+	Padding uint8
+	RaOff   int16
+	FpOff   int16
+}
+
+// 与 unwind_reg_e 一致
+const (
+	UNWIND_REG_SP uint8 = iota
+	UNWIND_REG_FP
+	UNWIND_REG_NONE
+	UNWIND_REG_END
+)
+
+// aarch64 的 DWARF 寄存器编号
+const (
+	dwarfRegFP = 29
+	dwarfRegSP = 31
+)
+
+const (
+	dwCFA_nop                 = 0x00
+	dwCFA_set_loc             = 0x01
+	dwCFA_advance_loc1        = 0x02
+	dwCFA_advance_loc2        = 0x03
+	dwCFA_advance_loc4        = 0x04
+	dwCFA_offset_extended     = 0x05
+	dwCFA_restore_extended    = 0x06
+	dwCFA_undefined           = 0x07
+	dwCFA_same_value          = 0x08
+	dwCFA_register            = 0x09
+	dwCFA_remember_state      = 0x0a
+	dwCFA_restore_state       = 0x0b
+	dwCFA_def_cfa             = 0x0c
+	dwCFA_def_cfa_register    = 0x0d
+	dwCFA_def_cfa_offset      = 0x0e
+	dwCFA_def_cfa_expression  = 0x0f
+	dwCFA_expression          = 0x10
+	dwCFA_offset_extended_sf  = 0x11
+	dwCFA_def_cfa_sf          = 0x12
+	dwCFA_def_cfa_offset_sf   = 0x13
+	dwCFA_val_offset          = 0x14
+	dwCFA_val_offset_sf       = 0x15
+	dwCFA_val_expression      = 0x16
+	dwCFA_negate_ra_state     = 0x2d
+	dwCFA_GNU_args_size       = 0x2e
+	dwCFA_GNU_negative_offset = 0x2f
+	dwCFA_advance_loc         = 0x40
+	dwCFA_offset              = 0x80
+	dwCFA_restore             = 0xc0
+	dwEH_PE_omit              = 0xff
+	dwEH_PE_pcrel             = 0x10
+	dwEH_PE_indirect          = 0x80
+	dwEH_PE_format_mask       = 0x0f
+	dwEH_PE_application_mask  = 0x70
+)
+
+// 寄存器的保存位置 只关心 x29 和 lr
+const (
+	regSame = iota
+	regOffset
+	regUndefined
+	regOther
+)
+
+type regRule struct {
+	kind   int
+	offset int64
+}
+
+type cfaState struct {
+	cfaReg  uint64
+	cfaOff  int64
+	cfaExpr bool
+	fp      regRule
+	ra      regRule
+}
+
+type ehReader struct {
+	data []byte
+	pos  int
+	err  error
+}
+
+func (this *ehReader) fail() {
+	if this.err == nil {
+		this.err = errors.New(fmt.Sprintf("eh_frame truncated at 0x%x", this.pos))
+	}
+	this.pos = len(this.data)
+}
+
+func (this *ehReader) u8() uint8 {
+	if this.pos+1 > len(this.data) {
+		this.fail()
+		return 0
+	}
+	v := this.data[this.pos]
+	this.pos++
+	return v
+}
+
+func (this *ehReader) u16() uint16 {
+	if this.pos+2 > len(this.data) {
+		this.fail()
+		return 0
+	}
+	v := binary.LittleEndian.Uint16(this.data[this.pos:])
+	this.pos += 2
+	return v
+}
+
+func (this *ehReader) u32() uint32 {
+	if this.pos+4 > len(this.data) {
+		this.fail()
+		return 0
+	}
+	v := binary.LittleEndian.Uint32(this.data[this.pos:])
+	this.pos += 4
+	return v
+}
+
+func (this *ehReader) u64() uint64 {
+	if this.pos+8 > len(this.data) {
+		this.fail()
+		return 0
+	}
+	v := binary.LittleEndian.Uint64(this.data[this.pos:])
+	this.pos += 8
+	return v
+}
+
+func (this *ehReader) uleb() uint64 {
+	var v uint64
+	var shift uint
+	for {
+		b := this.u8()
+		if this.err != nil {
+			return 0
+		}
+		if shift < 64 {
+			v |= uint64(b&0x7f) << shift
+		}
+		shift += 7
+		if b&0x80 == 0 {
+			return v
+		}
+	}
+}
+
+func (this *ehReader) sleb() int64 {
+	var v int64
+	var shift uint
+	for {
+		b := this.u8()
+		if this.err != nil {
+			return 0
+		}
+		if shift < 64 {
+			v |= int64(b&0x7f) << shift
+		}
+		shift += 7
+		if b&0x80 == 0 {
+			if shift < 64 && b&0x40 != 0 {
+				v |= -1 << shift
+			}
+			return v
+		}
+	}
+}
+
+func (this *ehReader) cstring() string {
+	start := this.pos
+	for this.pos < len(this.data) && this.data[this.pos] != 0 {
+		this.pos++
+	}
+	s := string(this.data[start:this.pos])
+	this.u8()
+	return s
+}
+
+// 按 DW_EH_PE_* 读取指针 section_addr 是 .eh_frame 的虚拟地址 用于 pcrel
+func (this *ehReader) pointer(enc uint8, section_addr uint64) uint64 {
+	if enc == dwEH_PE_omit {
+		return 0
+	}
+	field_addr := section_addr + uint64(this.pos)
+	var v uint64
+	switch enc & dwEH_PE_format_mask {
+	case 0x00:
+		v = this.u64()
+	case 0x01:
+		v = this.uleb()
+	case 0x02:
+		v = uint64(this.u16())
+	case 0x03:
+		v = uint64(this.u32())
+	case 0x04:
+		v = this.u64()
+	case 0x09:
+		v = uint64(this.sleb())
+	case 0x0a:
+		v = uint64(int64(int16(this.u16())))
+	case 0x0b:
+		v = uint64(int64(int32(this.u32())))
+	case 0x0c:
+		v = this.u64()
+	default:
+		this.err = errors.New(fmt.Sprintf("unsupported pointer encoding 0x%x", enc))
+		this.pos = len(this.data)
+		return 0
+	}
+	if enc&dwEH_PE_application_mask == dwEH_PE_pcrel {
+		v += field_addr
+	}
+	return v
+}
+
+type ehCIE struct {
+	codeAlign  uint64
+	dataAlign  int64
+	raReg      uint64
+	fdeEnc     uint8
+	hasAugData bool
+	initial    []byte
+}
+
+// 把 CFA 规则转换为 unwind_row_t 能表示的形式
+func (this *cfaState) row(pc uint64) UnwindRow {
+	row := UnwindRow{Pc: pc}
+	if this.ra.kind == regUndefined {
+		row.CfaReg = UNWIND_REG_END
+		return row
+	}
+	if this.cfaExpr || this.ra.kind == regOther || this.fp.kind == regOther {
+		row.CfaReg = UNWIND_REG_NONE
+		return row
+	}
+	switch this.cfaReg {
+	case dwarfRegSP:
+		row.CfaReg = UNWIND_REG_SP
+	case dwarfRegFP:
+		row.CfaReg = UNWIND_REG_FP
+	default:
+		row.CfaReg = UNWIND_REG_NONE
+		return row
+	}
+	fits := func(v int64) bool {
+		return v >= -32768 && v <= 32767
+	}
+	if !fits(this.cfaOff) || !fits(this.ra.offset) || !fits(this.fp.offset) {
+		row.CfaReg = UNWIND_REG_NONE
+		return row
+	}
+	row.CfaOff = int16(this.cfaOff)
+	if this.ra.kind == regOffset {
+		row.RaOff = int16(this.ra.offset)
+	}
+	if this.fp.kind == regOffset {
+		row.FpOff = int16(this.fp.offset)
+	}
+	// 偏移为 0 有特殊含义 实际上保存位置不会正好是 CFA
+	if this.ra.kind == regOffset && row.RaOff == 0 || this.fp.kind == regOffset && row.FpOff == 0 {
+		row.CfaReg = UNWIND_REG_NONE
+	}
+	return row
+}
+
+// 执行 CFA 指令 每次地址前进时输出一条规则
+func execCFA(cie *ehCIE, insns []byte, state *cfaState, initial *cfaState, loc uint64, end uint64, section_addr uint64, fde_enc uint8, rows []UnwindRow) ([]UnwindRow, error) {
+	r := &ehReader{data: insns}
+	var stack []cfaState
+	emit := func(next uint64) {
+		if next > loc {
+			rows = append(rows, state.row(loc))
+		}
+		loc = next
+	}
+	setReg := func(reg uint64, rule regRule) {
+		switch reg {
+		case dwarfRegFP:
+			state.fp = rule
+		case cie.raReg:
+			state.ra = rule
+		}
+	}
+	restoreReg := func(reg uint64) {
+		if initial == nil {
+			return
+		}
+		switch reg {
+		case dwarfRegFP:
+			state.fp = initial.fp
+		case cie.raReg:
+			state.ra = initial.ra
+		}
+	}
+	for r.pos < len(r.data) && r.err == nil {
+		op := r.u8()
+		switch op & 0xc0 {
+		case dwCFA_advance_loc:
+			emit(loc + uint64(op&0x3f)*cie.codeAlign)
+			continue
+		case dwCFA_offset:
+			setReg(uint64(op&0x3f), regRule{regOffset, int64(r.uleb()) * cie.dataAlign})
+			continue
+		case dwCFA_restore:
+			restoreReg(uint64(op & 0x3f))
+			continue
+		}
+		switch op {
+		case dwCFA_nop, dwCFA_negate_ra_state:
+			// 返回地址的 PAC 签名在 eBPF 中直接去掉
+		case dwCFA_set_loc:
+			emit(r.pointer(fde_enc, section_addr))
+		case dwCFA_advance_loc1:
+			emit(loc + uint64(r.u8())*cie.codeAlign)
+		case dwCFA_advance_loc2:
+			emit(loc + uint64(r.u16())*cie.codeAlign)
+		case dwCFA_advance_loc4:
+			emit(loc + uint64(r.u32())*cie.codeAlign)
+		case dwCFA_offset_extended:
+			reg := r.uleb()
+			setReg(reg, regRule{regOffset, int64(r.uleb()) * cie.dataAlign})
+		case dwCFA_offset_extended_sf:
+			reg := r.uleb()
+			setReg(reg, regRule{regOffset, r.sleb() * cie.dataAlign})
+		case dwCFA_GNU_negative_offset:
+			reg := r.uleb()
+			setReg(reg, regRule{regOffset, -int64(r.uleb()) * cie.dataAlign})
+		case dwCFA_restore_extended:
+			restoreReg(r.uleb())
+		case dwCFA_undefined:
+			setReg(r.uleb(), regRule{regUndefined, 0})
+		case dwCFA_same_value:
+			setReg(r.uleb(), regRule{regSame, 0})
+		case dwCFA_register:
+			reg := r.uleb()
+			if src := r.uleb(); src != reg {
+				setReg(reg, regRule{regOther, 0})
+			}
+		case dwCFA_remember_state:
+			stack = append(stack, *state)
+		case dwCFA_restore_state:
+			if len(stack) > 0 {
+				// 位置不属于保存的状态
+				*state = stack[len(stack)-1]
+				stack = stack[:len(stack)-1]
+			}
+		case dwCFA_def_cfa:
+			state.cfaReg = r.uleb()
+			state.cfaOff = int64(r.uleb())
+			state.cfaExpr = false
+		case dwCFA_def_cfa_sf:
+			state.cfaReg = r.uleb()
+			state.cfaOff = r.sleb() * cie.dataAlign
+			state.cfaExpr = false
+		case dwCFA_def_cfa_register:
+			state.cfaReg = r.uleb()
+			state.cfaExpr = false
+		case dwCFA_def_cfa_offset:
+			state.cfaOff = int64(r.uleb())
+		case dwCFA_def_cfa_offset_sf:
+			state.cfaOff = r.sleb() * cie.dataAlign
+		case dwCFA_def_cfa_expression:
+			r.pos += int(r.uleb())
+			state.cfaExpr = true
+		case dwCFA_expression, dwCFA_val_expression:
+			reg := r.uleb()
+			r.pos += int(r.uleb())
+			setReg(reg, regRule{regOther, 0})
+		case dwCFA_val_offset:
+			reg := r.uleb()
+			r.uleb()
+			setReg(reg, regRule{regOther, 0})
+		case dwCFA_val_offset_sf:
+			reg := r.uleb()
+			r.sleb()
+			setReg(reg, regRule{regOther, 0})
+		case dwCFA_GNU_args_size:
+			r.uleb()
+		default:
+			return rows, errors.New(fmt.Sprintf("unsupported CFA op 0x%x", op))
+		}
+	}
+	if r.err != nil {
+		return rows, r.err
+	}
+	if end > 0 {
+		emit(end)
+	}
+	return rows, nil
+}
+
+// 解析 .eh_frame 得到按 pc 排序的回溯规则 地址是库中的虚拟地址
+// 每个 FDE 结束的位置追加一条 UNWIND_REG_NONE 避免覆盖到后面没有规则的代码
+func ParseEhFrame(f *elf.File) ([]UnwindRow, error) {
+	if f.Machine != elf.EM_AARCH64 {
+		return nil, errors.New(fmt.Sprintf("unsupported machine %s", f.Machine))
+	}
+	section := f.Section(".eh_frame")
+	if section == nil {
+		return nil, errors.New("no .eh_frame section")
+	}
+	data, err := section.Data()
+	if err != nil {
+		return nil, err
+	}
+	cies := make(map[int]*ehCIE)
+	var rows []UnwindRow
+	var ends []UnwindRow
+	r := &ehReader{data: data}
+	for r.pos < len(r.data) && r.err == nil {
+		entry_start := r.pos
+		length := uint64(r.u32())
+		if length == 0 {
+			// 结束标记
+			break
+		}
+		if length == 0xffffffff {
+			length = r.u64()
+		}
+		body_start := r.pos
+		entry_end := body_start + int(length)
+		if entry_end > len(r.data) || entry_end < body_start {
+			return rows, errors.New(fmt.Sprintf("bad eh_frame entry at 0x%x", entry_start))
+		}
+		id_pos := r.pos
+		id := r.u32()
+		if id == 0 {
+			cie, err := parseCIE(&ehReader{data: r.data[:entry_end], pos: r.pos}, section.Addr)
+			if err != nil {
+				return rows, err
+			}
+			cies[entry_start] = cie
+			r.pos = entry_end
+			continue
+		}
+		cie, ok := cies[id_pos-int(id)]
+		if !ok {
+			r.pos = entry_end
+			continue
+		}
+		fr := &ehReader{data: r.data[:entry_end], pos: r.pos}
+		pc_begin := fr.pointer(cie.fdeEnc, section.Addr)
+		pc_range := fr.pointer(cie.fdeEnc&dwEH_PE_format_mask, section.Addr)
+		if cie.hasAugData {
+			fr.pos += int(fr.uleb())
+		}
+		if fr.err != nil || fr.pos > entry_end {
+			r.pos = entry_end
+			continue
+		}
+		initial := cfaState{cfaReg: dwarfRegSP}
+		rows_before := len(rows)
+		var discard []UnwindRow
+		// CIE 的初始指令不产生规则 只得到初始状态
+		if _, err := execCFA(cie, cie.initial, &initial, nil, pc_begin, 0, section.Addr, cie.fdeEnc, discard); err != nil {
+			r.pos = entry_end
+			continue
+		}
+		state := initial
+		rows, err = execCFA(cie, fr.data[fr.pos:entry_end], &state, &initial, pc_begin, pc_begin+pc_range, section.Addr, cie.fdeEnc, rows)
+		if err != nil {
+			// 这个函数的规则不可信 全部丢弃
+			rows = rows[:rows_before]
+		} else {
+			ends = append(ends, UnwindRow{Pc: pc_begin + pc_range, CfaReg: UNWIND_REG_NONE})
+		}
+		r.pos = entry_end
+	}
+	if r.err != nil {
+		return nil, r.err
+	}
+	// 结束标记和下一个函数的第一条规则地址相同时 以函数的规则为准
+	rows = append(rows, ends...)
+	sort.SliceStable(rows, func(i, j int) bool {
+		if rows[i].Pc != rows[j].Pc {
+			return rows[i].Pc < rows[j].Pc
+		}
+		return rows[i].CfaReg != UNWIND_REG_NONE && rows[j].CfaReg == UNWIND_REG_NONE
+	})
+	var merged []UnwindRow
+	for _, row := range rows {
+		if len(merged) > 0 {
+			last := &merged[len(merged)-1]
+			if last.Pc == row.Pc {
+				continue
+			}
+			// 与前一条规则相同的不需要单独保存
+			if last.CfaReg == row.CfaReg && last.CfaOff == row.CfaOff && last.RaOff == row.RaOff && last.FpOff == row.FpOff {
+				continue
+			}
+		}
+		merged = append(merged, row)
+	}
+	return merged, nil
+}
+
+func parseCIE(r *ehReader, section_addr uint64) (*ehCIE, error) {
+	cie := &ehCIE{fdeEnc: 0}
+	version := r.u8()
+	augmentation := r.cstring()
+	if version >= 4 {
+		// address_size segment_size
+		r.u8()
+		r.u8()
+	}
+	cie.codeAlign = r.uleb()
+	cie.dataAlign = r.sleb()
+	if version == 1 {
+		cie.raReg = uint64(r.u8())
+	} else {
+		cie.raReg = r.uleb()
+	}
+	if len(augmentation) > 0 && augmentation[0] == 'z' {
+		cie.hasAugData = true
+		aug_len := r.uleb()
+		aug_end := r.pos + int(aug_len)
+		for _, c := range augmentation[1:] {
+			switch c {
+			case 'R':
+				cie.fdeEnc = r.u8()
+			case 'P':
+				enc := r.u8()
+				r.pointer(enc&^dwEH_PE_indirect, section_addr)
+			case 'L':
+				r.u8()
+			case 'S', 'B', 'G':
+			default:
+				// 不认识的扩展 后面的数据按长度跳过
+				r.pos = aug_end
+			}
+		}
+		r.pos = aug_end
+	} else if augmentation != "" {
+		return nil, errors.New(fmt.Sprintf("unsupported CIE augmentation %s", augmentation))
+	}
+	if r.err != nil {
+		return nil, r.err
+	}
+	if r.pos > len(r.data) {
+		return nil, errors.New("bad CIE")
+	}
+	cie.initial = r.data[r.pos:]
+	return cie, nil
+}
@@ -0,0 +1,140 @@
+package util
+
+import (
+	"reflect"
+	"testing"
+)
+
+func TestEhReaderLeb(t *testing.T) {
+	tests := []struct {
+		data []byte
+		uleb uint64
+		sleb int64
+	}{
+		{[]byte{0x02}, 2, 2},
+		{[]byte{0x7f}, 127, -1},
+		{[]byte{0x80, 0x01}, 128, 128},
+		{[]byte{0xe5, 0x8e, 0x26}, 624485, 624485},
+		{[]byte{0xc0, 0xbb, 0x78}, 1973696, -123456},
+	}
+	for _, tt := range tests {
+		if v := (&ehReader{data: tt.data}).uleb(); v != tt.uleb {
+			t.Errorf("uleb(% x) = %d, want %d", tt.data, v, tt.uleb)
+		}
+		if v := (&ehReader{data: tt.data}).sleb(); v != tt.sleb {
+			t.Errorf("sleb(% x) = %d, want %d", tt.data, v, tt.sleb)
+		}
+	}
+}
+
+// aarch64 上常见的 CIE codeAlign=4 dataAlign=-8 返回地址在 x30 初始 CFA 为 sp
+var testCIE = &ehCIE{codeAlign: 4, dataAlign: -8, raReg: 30, initial: []byte{dwCFA_def_cfa, 31, 0}}
+
+func TestExecCFA(t *testing.T) {
+	tests := []struct {
+		name  string
+		insns []byte
+		rows  []UnwindRow
+		err   bool
+	}{
+		{
+			name:  "leaf",
+			insns: nil,
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_SP},
+			},
+		},
+		{
+			// stp x29, x30, [sp, #-16]! ; mov x29, sp
+			name: "frame record",
+			insns: []byte{
+				dwCFA_advance_loc | 1, dwCFA_def_cfa_offset, 16,
+				dwCFA_offset | 30, 1, dwCFA_offset | 29, 2,
+				dwCFA_advance_loc | 1, dwCFA_def_cfa, 29, 16,
+			},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_SP},
+				{Pc: 0x1004, CfaReg: UNWIND_REG_SP, CfaOff: 16, RaOff: -8, FpOff: -16},
+				{Pc: 0x1008, CfaReg: UNWIND_REG_FP, CfaOff: 16, RaOff: -8, FpOff: -16},
+			},
+		},
+		{
+			name: "remember restore",
+			insns: []byte{
+				dwCFA_advance_loc | 1, dwCFA_def_cfa_offset, 32, dwCFA_offset | 30, 1,
+				dwCFA_advance_loc | 1, dwCFA_remember_state, dwCFA_def_cfa_offset, 0, dwCFA_restore | 30,
+				dwCFA_advance_loc | 1, dwCFA_restore_state,
+			},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_SP},
+				{Pc: 0x1004, CfaReg: UNWIND_REG_SP, CfaOff: 32, RaOff: -8},
+				{Pc: 0x1008, CfaReg: UNWIND_REG_SP},
+				{Pc: 0x100c, CfaReg: UNWIND_REG_SP, CfaOff: 32, RaOff: -8},
+			},
+		},
+		{
+			name:  "undefined ra",
+			insns: []byte{dwCFA_undefined, 30},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_END},
+			},
+		},
+		{
+			name:  "cfa expression",
+			insns: []byte{dwCFA_def_cfa_expression, 2, 0x8f, 0x00},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_NONE},
+			},
+		},
+		{
+			name:  "ra in other register",
+			insns: []byte{dwCFA_register, 30, 16},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_NONE},
+			},
+		},
+		{
+			name:  "cfa off other register",
+			insns: []byte{dwCFA_def_cfa, 19, 16},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_NONE},
+			},
+		},
+		{
+			name:  "advance_loc2",
+			insns: []byte{dwCFA_advance_loc2, 0x02, 0x00, dwCFA_def_cfa_offset, 16},
+			rows: []UnwindRow{
+				{Pc: 0x1000, CfaReg: UNWIND_REG_SP},
+				{Pc: 0x1008, CfaReg: UNWIND_REG_SP, CfaOff: 16},
+			},
+		},
+		{
+			name:  "unsupported op",
+			insns: []byte{0x3f},
+			err:   true,
+		},
+		{
+			name:  "truncated",
+			insns: []byte{dwCFA_advance_loc4, 0x01},
+			err:   true,
+		},
+	}
+	for _, tt := range tests {
+		initial := cfaState{cfaReg: dwarfRegSP}
+		if _, err := execCFA(testCIE, testCIE.initial, &initial, nil, 0x1000, 0, 0, 0, nil); err != nil {
+			t.Fatalf("initial instructions err:%v", err)
+		}
+		state := initial
+		rows, err := execCFA(testCIE, tt.insns, &state, &initial, 0x1000, 0x1010, 0, 0, nil)
+		if (err != nil) != tt.err {
+			t.Errorf("%s: err:%v, want err:%v", tt.name, err, tt.err)
+			continue
+		}
+		if tt.err {
+			continue
+		}
+		if !reflect.DeepEqual(rows, tt.rows) {
+			t.Errorf("%s: rows = %+v, want %+v", tt.name, rows, tt.rows)
+		}
+	}
+}
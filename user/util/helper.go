@@ -353,6 +353,10 @@ const (
 	PID_BLACKLIST_START uint32 = PID_WHITELIST_START + 0x400
 	TID_WHITELIST_START uint32 = PID_BLACKLIST_START + 0x400
 	TID_BLACKLIST_START uint32 = TID_WHITELIST_START + 0x400
+	ARM_SYSCALL_START   uint32 = TID_BLACKLIST_START + 0x400
+	SYS_COALESCE_START  uint32 = ARM_SYSCALL_START + 0x400
+	SYS_IO_START        uint32 = SYS_COALESCE_START + 0x400
+	SYS_FLOW_START      uint32 = SYS_IO_START + 0x400
 )
 
 var START_OFFSETS map[uint32]string = map[uint32]string{
@@ -364,6 +368,10 @@ var START_OFFSETS map[uint32]string = map[uint32]string{
 	PID_BLACKLIST_START: "PID_BLACKLIST_START",
 	TID_WHITELIST_START: "TID_WHITELIST_START",
 	TID_BLACKLIST_START: "TID_BLACKLIST_START",
+	ARM_SYSCALL_START:   "ARM_SYSCALL_START",
+	SYS_COALESCE_START:  "SYS_COALESCE_START",
+	SYS_IO_START:        "SYS_IO_START",
+	SYS_FLOW_START:      "SYS_FLOW_START",
 }
 
 // 格式化输出相关
@@ -488,6 +496,20 @@ const (
 	HW_BREAKPOINT_INVALID uint32 = HW_BREAKPOINT_RW | HW_BREAKPOINT_X
 )
 
+func BrkTypeName(brk_type uint32) string {
+	switch brk_type {
+	case HW_BREAKPOINT_R:
+		return "r"
+	case HW_BREAKPOINT_W:
+		return "w"
+	case HW_BREAKPOINT_RW:
+		return "rw"
+	case HW_BREAKPOINT_X:
+		return "x"
+	}
+	return "?"
+}
+
 func RunCommand(executable string, args ...string) (string, error) {
 	cmd := exec.Command(executable, args...)
 	stdout, err := cmd.StdoutPipe()